@@ -0,0 +1,138 @@
+/****************************************************************************
+ * bench/bench_color.c
+ * Visit a set of one cache line buffers in page sized granules, allocated
+ * with gran_alloc() (every buffer at page offset 0, so all of them compete
+ * for the same cache sets) and with gran_alloc_colored(), and compare the
+ * time per buffer visited.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gran.h"
+
+#define LOG2GRAN   12
+#define HEAPSIZE   (8 << 20)
+#define BUFSIZE    64
+#define MAXBUFS    1024
+#define NVISITS    ((uint64_t)1 << 24)   /* Buffers visited per measurement */
+
+static volatile uint64_t g_sink;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Sum every buffer over and over, in an order that the prefetcher cannot
+ * follow; returns ns per buffer visited.
+ */
+
+static double walk(uint64_t **buf, int nbufs)
+{
+  uint64_t start;
+  uint64_t sum = 0;
+  uint64_t npasses = NVISITS / nbufs;
+  uint64_t pass;
+  int      i;
+  int      j;
+
+  start = now_ns();
+  for (pass = 0; pass < npasses; pass++)
+    {
+      for (i = 0; i < nbufs; i++)
+        {
+          for (j = 0; j < BUFSIZE / 8; j++)
+            {
+              sum += buf[i][j];
+            }
+        }
+    }
+
+  g_sink = sum;
+  return (double)(now_ns() - start) / (npasses * nbufs);
+}
+
+static double run(struct mm_gran *gran, int nbufs, int colored)
+{
+  uint64_t *buf[MAXBUFS];
+  uint64_t *order[MAXBUFS];
+  uint64_t *tmp;
+  double    ns;
+  int       i;
+  int       j;
+
+  for (i = 0; i < nbufs; i++)
+    {
+      buf[i] = colored ? gran_alloc_colored(gran, BUFSIZE) :
+                         gran_alloc(gran, BUFSIZE);
+      memset(buf[i], i, BUFSIZE);
+    }
+
+  /* The same shuffle for both runs */
+
+  srand(nbufs);
+  memcpy(order, buf, nbufs * sizeof(buf[0]));
+  for (i = nbufs - 1; i > 0; i--)
+    {
+      j        = rand() % (i + 1);
+      tmp      = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+
+  ns = walk(order, nbufs);
+
+  for (i = 0; i < nbufs; i++)
+    {
+      gran_free(gran, buf[i], BUFSIZE);
+    }
+
+  return ns;
+}
+
+int main(void)
+{
+  struct mm_gran *gran;
+  void           *heap;
+  int             nbufs;
+
+  heap = aligned_alloc(4096, HEAPSIZE);
+  gran = gran_initialize(heap, HEAPSIZE, LOG2GRAN, LOG2GRAN);
+
+  printf("%-8s %10s %14s %14s %8s\n", "nbufs", "hot_KiB", "plain_ns/buf",
+         "colored_ns/buf", "speedup");
+  for (nbufs = 8; nbufs <= MAXBUFS; nbufs <<= 1)
+    {
+      double plain   = run(gran, nbufs, 0);
+      double colored = run(gran, nbufs, 1);
+
+      printf("%-8d %10.1f %14.1f %14.1f %8.2f\n", nbufs, nbufs * BUFSIZE / 1024.0,
+             plain, colored, plain / colored);
+    }
+
+  gran_release(gran);
+  free(heap);
+  return 0;
+}
@@ -0,0 +1,136 @@
+/****************************************************************************
+ * bench/bench_containers.cxx
+ * Container heavy workloads on gran_memory_resource and on the default
+ * (new/delete) memory resource.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "gran.hxx"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/* 128 byte granules: allocations up to 4 KiB, so vectors stay below 1000
+ * ints and maps below 400 entries (the bucket array is one allocation).
+ */
+
+#define LOG2GRAN   7
+#define HEAPSIZE   (64 << 20)
+#define ROUNDS     20000
+
+/* Build and destroy vectors of random length */
+
+static void vectors(std::pmr::memory_resource *res)
+{
+  for (int round = 0; round < ROUNDS; round++)
+    {
+      std::pmr::vector<int> v(res);
+      int n = 1 + rand() % 900;
+
+      for (int i = 0; i < n; i++)
+        {
+          v.push_back(i);
+        }
+    }
+}
+
+/* Insert and erase in a set of hash maps */
+
+static void maps(std::pmr::memory_resource *res)
+{
+  std::pmr::vector<std::pmr::unordered_map<int, int>> m(res);
+
+  for (int i = 0; i < 16; i++)
+    {
+      m.emplace_back();
+      m.back().reserve(380);
+    }
+
+  for (int round = 0; round < ROUNDS * 20; round++)
+    {
+      std::pmr::unordered_map<int, int> &map = m[rand() % 16];
+      int key = rand() % 380;
+
+      if (!map.erase(key))
+        {
+          map.emplace(key, round);
+        }
+    }
+}
+
+/* Lists that grow at one end and shrink at the other */
+
+static void lists(std::pmr::memory_resource *res)
+{
+  std::pmr::list<long> l(res);
+
+  for (int round = 0; round < ROUNDS * 20; round++)
+    {
+      l.push_back(round);
+      if (l.size() > 2000 || (rand() & 1))
+        {
+          l.pop_front();
+        }
+    }
+}
+
+static double run(void (*workload)(std::pmr::memory_resource *),
+                  std::pmr::memory_resource *res)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  srand(1);
+  workload(res);
+  return std::chrono::duration<double, std::milli>(
+           std::chrono::steady_clock::now() - start).count();
+}
+
+int main(void)
+{
+  static const struct
+  {
+    const char *name;
+    void      (*workload)(std::pmr::memory_resource *);
+  } workloads[] =
+  {
+    { "vector", vectors },
+    { "unordered_map", maps },
+    { "list", lists },
+  };
+
+  void           *heap = aligned_alloc(4096, HEAPSIZE);
+  struct mm_gran *gran = gran_initialize(heap, HEAPSIZE, LOG2GRAN, LOG2GRAN);
+  gran_memory_resource res(gran);
+
+  printf("%-14s %12s %12s\n", "workload", "default_ms", "gran_ms");
+  for (const auto &w : workloads)
+    {
+      double def = run(w.workload, std::pmr::new_delete_resource());
+      double gr  = run(w.workload, &res);
+
+      printf("%-14s %12.1f %12.1f\n", w.name, def, gr);
+    }
+
+  gran_release(gran);
+  free(heap);
+  return 0;
+}
@@ -0,0 +1,196 @@
+/****************************************************************************
+ * bench/bench_hint.c
+ * Replay an allocation trace of short lived, long lived and pinned buffers
+ * with gran_alloc() and with gran_alloc_hint() and compare the longest free
+ * run (mxfree) that the heap keeps.  The bursty trace has phases in which
+ * short lived buffers live much longer, so their demand swells and shrinks
+ * again while long lived buffers keep being allocated.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#define LOG2GRAN   6
+#define NGRANULES  4096
+#define HEAPSIZE   (4096 + (NGRANULES << LOG2GRAN))
+#define NSTEPS     200000
+#define NPINNED    32
+#define WHEELSIZE  2048
+#define SAMPLE     100
+#define PERIOD     10000 /* Bursty trace: a burst every PERIOD steps */
+#define BURST      2000  /* lasting BURST steps */
+
+/* One live buffer of the trace, queued on the step it is freed */
+
+struct item
+{
+  struct item *next;
+  void        *mem;
+  size_t       size;
+  int          hint;
+};
+
+struct result
+{
+  double   avgmxfree;
+  uint32_t minmxfree;
+  uint32_t nfail;
+};
+
+static struct item *g_wheel[WHEELSIZE];
+
+/* The trace is generated from a fixed seed, so both runs replay the same
+ * sequence of requests.  Pinned buffers are allocated first, as at
+ * initialization time, and never freed.
+ */
+
+static void replay(int hinted, int bursty, struct result *res)
+{
+  struct graninfo info;
+  struct mm_gran *gran;
+  struct item    *it;
+  void           *heap;
+  uint64_t        sum = 0;
+  unsigned int    nsamples = 0;
+  unsigned int    lifetime;
+  int             step;
+  int             r;
+
+  heap = aligned_alloc(4096, HEAPSIZE);
+  gran = gran_initialize(heap, HEAPSIZE, LOG2GRAN, LOG2GRAN);
+
+  res->minmxfree = UINT32_MAX;
+  res->nfail     = 0;
+  srand(7);
+
+  for (step = 0; step < NSTEPS; step++)
+    {
+      /* Free what expires now */
+
+      while ((it = g_wheel[step % WHEELSIZE]) != NULL)
+        {
+          g_wheel[step % WHEELSIZE] = it->next;
+          if (hinted)
+            {
+              gran_free_hint(gran, it->mem, it->size, it->hint);
+            }
+          else
+            {
+              gran_free(gran, it->mem, it->size);
+            }
+
+          free(it);
+        }
+
+      /* Then 80% short lived and 20% long lived */
+
+      it       = malloc(sizeof(*it));
+      it->size = (1 + rand() % 8) << LOG2GRAN;
+      r        = rand() % 100;
+      if (step < NPINNED)
+        {
+          it->hint = GRAN_HINT_PINNED;
+          lifetime = 0;
+        }
+      else if (r < 20)
+        {
+          it->hint = GRAN_HINT_LONG;
+          lifetime = 200 + rand() % 1800;
+        }
+      else
+        {
+          it->hint = GRAN_HINT_SHORT;
+          lifetime = 1 + rand() % 64;
+          if (bursty && step % PERIOD >= PERIOD - BURST)
+            {
+              lifetime = 1 + rand() % 400;
+            }
+        }
+
+      it->mem = hinted ? gran_alloc_hint(gran, it->size, it->hint) :
+                         gran_alloc(gran, it->size);
+      if (it->mem == NULL)
+        {
+          res->nfail++;
+          free(it);
+        }
+      else if (lifetime == 0)
+        {
+          free(it);
+        }
+      else
+        {
+          it->next = g_wheel[(step + lifetime) % WHEELSIZE];
+          g_wheel[(step + lifetime) % WHEELSIZE] = it;
+        }
+
+      if (step % SAMPLE == 0)
+        {
+          gran_info(gran, &info);
+          sum += info.mxfree;
+          nsamples++;
+          if (info.mxfree < res->minmxfree)
+            {
+              res->minmxfree = info.mxfree;
+            }
+        }
+    }
+
+  res->avgmxfree = (double)sum / nsamples;
+
+  for (step = 0; step < WHEELSIZE; step++)
+    {
+      while ((it = g_wheel[step]) != NULL)
+        {
+          g_wheel[step] = it->next;
+          free(it);
+        }
+    }
+
+  gran_release(gran);
+  free(heap);
+}
+
+int main(void)
+{
+  static const char *traces[] =
+  {
+    "steady", "bursty"
+  };
+
+  struct result plain;
+  struct result hinted;
+  int           bursty;
+
+  printf("%-7s %-10s %12s %12s %8s\n", "trace", "placement", "avg_mxfree", "min_mxfree", "nfail");
+  for (bursty = 0; bursty < 2; bursty++)
+    {
+      replay(0, bursty, &plain);
+      replay(1, bursty, &hinted);
+
+      printf("%-7s %-10s %12.1f %12u %8u\n", traces[bursty], "gran_alloc",
+             plain.avgmxfree, plain.minmxfree, plain.nfail);
+      printf("%-7s %-10s %12.1f %12u %8u\n", traces[bursty], "hinted",
+             hinted.avgmxfree, hinted.minmxfree, hinted.nfail);
+    }
+
+  return 0;
+}
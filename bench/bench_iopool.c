@@ -0,0 +1,247 @@
+/****************************************************************************
+ * bench/bench_iopool.c
+ * Write and read back a tmpfs file through io_uring with buffers from a
+ * gran_iopool (IORING_OP_WRITE_FIXED/READ_FIXED) and with the same buffers
+ * unregistered (IORING_OP_WRITE/READ), for a range of buffer sizes.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "gran.h"
+
+#define LOG2GRAN   12
+#define HEAPSIZE   (64 << 20)
+#define QDEPTH     32
+#define FILESIZE   (64 << 20)
+#define NBYTES     ((size_t)1 << 30)   /* Written and read per size */
+#define TMPFILE    "/dev/shm/bench_iopool"
+
+/* Just enough of an io_uring to submit a batch and wait for it */
+
+struct ring
+{
+  int                  fd;
+  unsigned int        *sqtail;
+  unsigned int        *sqmask;
+  unsigned int        *sqarray;
+  struct io_uring_sqe *sqes;
+  unsigned int        *cqhead;
+  unsigned int        *cqtail;
+  unsigned int        *cqmask;
+  struct io_uring_cqe *cqes;
+};
+
+static int ring_setup(struct ring *ring)
+{
+  struct io_uring_params p;
+  size_t                 sqsize;
+  size_t                 cqsize;
+  uint8_t               *sq;
+  uint8_t               *cq;
+
+  memset(&p, 0, sizeof(p));
+  ring->fd = syscall(__NR_io_uring_setup, QDEPTH, &p);
+  if (ring->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+      return -1;
+    }
+
+  sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  sq     = mmap(NULL, sqsize > cqsize ? sqsize : cqsize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring->fd, IORING_OFF_SQES);
+  if (sq == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+      return -1;
+    }
+
+  cq            = sq;
+  ring->sqtail  = (unsigned int *)(sq + p.sq_off.tail);
+  ring->sqmask  = (unsigned int *)(sq + p.sq_off.ring_mask);
+  ring->sqarray = (unsigned int *)(sq + p.sq_off.array);
+  ring->cqhead  = (unsigned int *)(cq + p.cq_off.head);
+  ring->cqtail  = (unsigned int *)(cq + p.cq_off.tail);
+  ring->cqmask  = (unsigned int *)(cq + p.cq_off.ring_mask);
+  ring->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+}
+
+static void ring_prep(struct ring *ring, int opcode, int fd, void *buf,
+                      size_t len, off_t off, int bufidx)
+{
+  unsigned int         tail = *ring->sqtail;
+  unsigned int         idx  = tail & *ring->sqmask;
+  struct io_uring_sqe *sqe  = &ring->sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode    = opcode;
+  sqe->fd        = fd;
+  sqe->addr      = (uintptr_t)buf;
+  sqe->len       = len;
+  sqe->off       = off;
+  sqe->buf_index = bufidx;
+  ring->sqarray[idx] = idx;
+  __atomic_store_n(ring->sqtail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Submit n prepared SQEs and reap their completions */
+
+static void ring_run(struct ring *ring, unsigned int n, size_t len)
+{
+  unsigned int head;
+
+  syscall(__NR_io_uring_enter, ring->fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0);
+
+  head = *ring->cqhead;
+  while (head != __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE))
+    {
+      if (ring->cqes[head & *ring->cqmask].res != (int)len)
+        {
+          fprintf(stderr, "I/O failed: %d\n", ring->cqes[head & *ring->cqmask].res);
+          exit(1);
+        }
+
+      head++;
+    }
+
+  __atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Write QDEPTH buffers to consecutive offsets and read them back until
+ * NBYTES went each way.  Returns MB/s of both directions together.
+ */
+
+static double run(struct ring *ring, struct gran_iopool *pool, int fd,
+                  size_t size, int fixed)
+{
+  unsigned int bufidx[QDEPTH];
+  void        *buf[QDEPTH];
+  uint64_t     start;
+  size_t       done;
+  off_t        off = 0;
+  int          i;
+
+  for (i = 0; i < QDEPTH; i++)
+    {
+      buf[i] = gran_iopool_alloc(pool, size, &bufidx[i]);
+      memset(buf[i], i, size);
+    }
+
+  start = now_ns();
+  for (done = 0; done < NBYTES; done += QDEPTH * size)
+    {
+      if (off + QDEPTH * size > FILESIZE)
+        {
+          off = 0;
+        }
+
+      for (i = 0; i < QDEPTH; i++)
+        {
+          ring_prep(ring, fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+                    fd, buf[i], size, off + i * size, fixed ? bufidx[i] : 0);
+        }
+
+      ring_run(ring, QDEPTH, size);
+
+      for (i = 0; i < QDEPTH; i++)
+        {
+          ring_prep(ring, fixed ? IORING_OP_READ_FIXED : IORING_OP_READ,
+                    fd, buf[i], size, off + i * size, fixed ? bufidx[i] : 0);
+        }
+
+      ring_run(ring, QDEPTH, size);
+      off += QDEPTH * size;
+    }
+
+  for (i = 0; i < QDEPTH; i++)
+    {
+      gran_iopool_free(pool, buf[i], size);
+    }
+
+  return 2.0 * done / (now_ns() - start) * 1000;
+}
+
+int main(void)
+{
+  struct gran_iopool pool;
+  struct mm_gran    *gran;
+  struct ring        ring;
+  void              *heap;
+  size_t             size;
+  int                fd;
+  int                ret;
+
+  if (ring_setup(&ring) < 0)
+    {
+      printf("io_uring not available\n");
+      return 0;
+    }
+
+  fd = open(TMPFILE, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0 || ftruncate(fd, FILESIZE) < 0)
+    {
+      printf("cannot create " TMPFILE "\n");
+      return 0;
+    }
+
+  unlink(TMPFILE);
+
+  heap = aligned_alloc(4096, HEAPSIZE);
+  gran = gran_initialize(heap, HEAPSIZE, LOG2GRAN, LOG2GRAN);
+  ret  = gran_iopool_register(&pool, gran, ring.fd);
+  if (ret < 0)
+    {
+      printf("gran_iopool_register failed: %s\n", strerror(-ret));
+      return 0;
+    }
+
+  printf("%-8s %14s %14s %8s\n", "bufsize", "fixed_MB/s", "plain_MB/s", "ratio");
+  for (size = 4096; size <= (32 << LOG2GRAN); size <<= 1)
+    {
+      double fixed = run(&ring, &pool, fd, size, 1);
+      double plain = run(&ring, &pool, fd, size, 0);
+
+      printf("%-8zu %14.0f %14.0f %8.2f\n", size, fixed, plain, fixed / plain);
+    }
+
+  gran_iopool_unregister(&pool);
+  gran_release(gran);
+  free(heap);
+  close(fd);
+  return 0;
+}
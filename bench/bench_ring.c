@@ -0,0 +1,239 @@
+/****************************************************************************
+ * bench/bench_ring.c
+ * Producer/consumer throughput of variable length messages through a ring
+ * from gran_alloc_ring().  With the mirrored mapping every message is
+ * copied in with one memcpy() and processed in place; the split-copy
+ * variant uses the first view only and splits messages that wrap, on both
+ * sides.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gran.h"
+
+#define LOG2GRAN   12
+#define HEAPSIZE   (16 << 20)
+#define NBYTES     ((uint64_t)1 << 30)   /* Payload per run */
+#define MAXMSG     2048
+#define NSIZES     1024
+
+/* Messages are a 64-bit length followed by the payload, padded to eight
+ * bytes, so the length itself never wraps.
+ */
+
+#define MSGSPACE(len) (8 + (((len) + 7) & ~(size_t)7))
+
+/* The producer fills the ring and the consumer drains it in turn on one
+ * thread, so that the result measures the copying and not the scheduler.
+ */
+
+struct channel
+{
+  uint8_t      *buf;
+  size_t        size;
+  int           mirrored;
+  uint64_t      head;
+  uint64_t      tail;
+  uint64_t      sent;
+  uint64_t      sum;
+  unsigned int  next;
+};
+
+static size_t  g_sizes[NSIZES];
+static uint8_t g_src[MAXMSG];
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Payloads start eight byte aligned, so they are summed a word at a time */
+
+static uint64_t checksum(const uint8_t *p, size_t len)
+{
+  const uint64_t *w = (const uint64_t *)p;
+  uint64_t        sum = 0;
+  size_t          i;
+
+  for (i = 0; i < len / 8; i++)
+    {
+      sum += w[i];
+    }
+
+  for (i = len & ~(size_t)7; i < len; i++)
+    {
+      sum += p[i];
+    }
+
+  return sum;
+}
+
+/* Write messages until the next one does not fit */
+
+static void produce(struct channel *ch)
+{
+  size_t off;
+  size_t len;
+  size_t first;
+
+  for (; ; )
+    {
+      len = g_sizes[ch->next % NSIZES];
+      if (ch->sent >= NBYTES || ch->head + MSGSPACE(len) - ch->tail > ch->size)
+        {
+          return;
+        }
+
+      off = ch->head % ch->size;
+      *(uint64_t *)(ch->buf + off) = len;
+      off = (off + 8) % ch->size;
+
+      first = ch->size - off;
+      if (ch->mirrored || len <= first)
+        {
+          memcpy(ch->buf + off, g_src, len);
+        }
+      else
+        {
+          memcpy(ch->buf + off, g_src, first);
+          memcpy(ch->buf, g_src + first, len - first);
+        }
+
+      ch->head += MSGSPACE(len);
+      ch->sent += len;
+      ch->next++;
+    }
+}
+
+/* Process every message in the ring.  A message has to be contiguous to
+ * be processed, so the split-copy variant reassembles wrapped ones.
+ */
+
+static void consume(struct channel *ch)
+{
+  uint8_t scratch[MAXMSG] __attribute__((aligned(8)));
+  size_t  off;
+  size_t  len;
+  size_t  first;
+
+  while (ch->tail != ch->head)
+    {
+      off = ch->tail % ch->size;
+      len = *(uint64_t *)(ch->buf + off);
+      off = (off + 8) % ch->size;
+
+      first = ch->size - off;
+      if (ch->mirrored || len <= first)
+        {
+          ch->sum += checksum(ch->buf + off, len);
+        }
+      else
+        {
+          memcpy(scratch, ch->buf + off, first);
+          memcpy(scratch + first, ch->buf, len - first);
+          ch->sum += checksum(scratch, len);
+        }
+
+      ch->tail += MSGSPACE(len);
+    }
+}
+
+/* Returns MB/s of payload */
+
+static double run(struct mm_gran *gran, size_t size, int mirrored, uint64_t *sum)
+{
+  struct channel   ch;
+  struct gran_ring ring;
+  uint64_t         start;
+  uint64_t         ns;
+
+  if (gran_alloc_ring(gran, size, &ring) < 0)
+    {
+      return 0;
+    }
+
+  memset(&ch, 0, sizeof(ch));
+  ch.buf      = ring.base;
+  ch.size     = ring.size;
+  ch.mirrored = mirrored;
+
+  start = now_ns();
+  while (ch.sent < NBYTES)
+    {
+      produce(&ch);
+      consume(&ch);
+    }
+
+  ns = now_ns() - start;
+
+  *sum = ch.sum;
+  gran_free_ring(gran, &ring);
+  return (double)NBYTES / ns * 1000;
+}
+
+int main(void)
+{
+  struct mm_gran *gran;
+  uint64_t        sum1;
+  uint64_t        sum2;
+  size_t          size;
+  int             i;
+
+  gran = gran_initialize_memfd(HEAPSIZE, LOG2GRAN);
+  if (gran == NULL)
+    {
+      printf("memfd heaps not available\n");
+      return 0;
+    }
+
+  srand(11);
+  for (i = 0; i < NSIZES; i++)
+    {
+      g_sizes[i] = 16 + rand() % (MAXMSG - 16);
+    }
+
+  for (i = 0; i < MAXMSG; i++)
+    {
+      g_src[i] = rand();
+    }
+
+  printf("%-8s %14s %14s %8s\n", "ringsize", "mirrored_MB/s", "split_MB/s", "ratio");
+  for (size = 16 << 10; size <= (128 << 10); size <<= 1)
+    {
+      double mirrored = run(gran, size, 1, &sum1);
+      double split    = run(gran, size, 0, &sum2);
+
+      if (sum1 != sum2)
+        {
+          fprintf(stderr, "checksum mismatch\n");
+          return 1;
+        }
+
+      printf("%-8zu %14.0f %14.0f %8.2f\n", size, mirrored, split, mirrored / split);
+    }
+
+  gran_release(gran);
+  return 0;
+}
@@ -0,0 +1,182 @@
+/****************************************************************************
+ * bench/bench_uffd.c
+ * First touch latency of pages in a userfaultfd backed heap, with and
+ * without GRAN_UFFD_ZEROPAGE, against ordinary anonymous memory.  The
+ * median is taken from the handler side histogram of gran_uffd_stats().
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gran.h"
+
+#define HEAPSIZE  ((size_t)1 << 30)
+#define LOG2GRAN  12
+#define NCHUNKS   256
+#define CHUNK     32                  /* Pages per allocation, the maximum */
+#define NPAGES    (NCHUNKS * CHUNK)
+
+static uint8_t *g_chunk[NCHUNKS];
+static size_t   g_pagesize;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Read (if asked) and then write the first byte of every page of every
+ * chunk, returning the average time per page.
+ */
+
+static double touch(int readfirst)
+{
+  volatile uint8_t *p;
+  uint64_t          start = now_ns();
+  size_t            i;
+  int               c;
+
+  for (c = 0; c < NCHUNKS; c++)
+    {
+      p = g_chunk[c];
+      for (i = 0; i < CHUNK; i++)
+        {
+          if (readfirst)
+            {
+              (void)p[i * g_pagesize];
+            }
+
+          p[i * g_pagesize] = 1;
+        }
+    }
+
+  return (double)(now_ns() - start) / NPAGES;
+}
+
+static void alloc_chunks(struct mm_gran *gran)
+{
+  int c;
+
+  for (c = 0; c < NCHUNKS; c++)
+    {
+      g_chunk[c] = gran_alloc(gran, CHUNK * g_pagesize);
+    }
+}
+
+static void free_chunks(struct mm_gran *gran)
+{
+  int c;
+
+  for (c = 0; c < NCHUNKS; c++)
+    {
+      gran_free(gran, g_chunk[c], CHUNK * g_pagesize);
+    }
+}
+
+/* Upper bound of the bucket that holds the median fault */
+
+static uint64_t median_ns(struct gran_uffd_stats *before,
+                          struct gran_uffd_stats *after)
+{
+  uint64_t n = after->nfaults - before->nfaults;
+  uint64_t sum = 0;
+  int      i;
+
+  for (i = 0; i < GRAN_UFFD_NBUCKETS; i++)
+    {
+      sum += after->hist[i] - before->hist[i];
+      if (sum * 2 >= n && n > 0)
+        {
+          return (uint64_t)1 << (i + 1);
+        }
+    }
+
+  return 0;
+}
+
+static void run(const char *name, unsigned int flags, int readfirst)
+{
+  struct gran_uffd_stats before;
+  struct gran_uffd_stats after;
+  struct mm_gran        *gran;
+  double                 first;
+  double                 refault;
+
+  gran = gran_initialize_uffd(HEAPSIZE, LOG2GRAN, flags);
+  if (gran == NULL)
+    {
+      printf("%-18s %12s\n", name, "unsupported");
+      return;
+    }
+
+  alloc_chunks(gran);
+  gran_uffd_stats(gran, &before);
+  first = touch(readfirst);
+  gran_uffd_stats(gran, &after);
+
+  /* Hand the pages back and fault them in again */
+
+  free_chunks(gran);
+  gran_uffd_reclaim(gran);
+  alloc_chunks(gran);
+  refault = touch(readfirst);
+
+  printf("%-18s %12.0f %12.0f %12llu %10llu\n", name, first, refault,
+         (unsigned long long)median_ns(&before, &after),
+         (unsigned long long)(after.nfaults - before.nfaults));
+  gran_release(gran);
+}
+
+int main(void)
+{
+  uint8_t *p;
+  double   first;
+  int      c;
+
+  g_pagesize = sysconf(_SC_PAGESIZE);
+
+  printf("%-18s %12s %12s %12s %10s\n", "backing", "ns/page", "refault_ns",
+         "handler_p50", "nfaults");
+
+  /* Anonymous memory, laid out in the same chunks */
+
+  p = mmap(NULL, NPAGES * g_pagesize, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  for (c = 0; c < NCHUNKS; c++)
+    {
+      g_chunk[c] = p + (size_t)c * CHUNK * g_pagesize;
+    }
+
+  first = touch(0);
+  madvise(p, NPAGES * g_pagesize, MADV_DONTNEED);
+  printf("%-18s %12.0f %12.0f %12s %10s\n", "anonymous", first,
+         touch(0), "-", "-");
+  munmap(p, NPAGES * g_pagesize);
+
+  run("uffd copy", 0, 0);
+  run("uffd copy, read", 0, 1);
+  run("uffd zeropage", GRAN_UFFD_ZEROPAGE, 0);
+  run("uffd zeropage, rd", GRAN_UFFD_ZEROPAGE, 1);
+  return 0;
+}
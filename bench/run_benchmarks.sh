@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Build and run the granule allocator benchmarks.
+#
+# Usage: bench/run_benchmarks.sh [bench_name ...]
+#
+# Every bench/bench_*.c and bench/bench_*.cxx is built with optimization
+# against the allocator sources (every mm_gran*.c except the malloc
+# interposer) and run.  With arguments only the named benchmarks are run.
+# CFLAGS adds compiler flags.
+#
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+FLAGS="-O2 -DNDEBUG -Wall -pthread -I. $CFLAGS"
+
+for src in mm_gran*.c; do
+  [ "$src" = mm_granmalloc.c ] && continue
+  gcc $FLAGS -c "$src" -o "$OUT/${src%.c}.o"
+done
+
+if [ $# -eq 0 ]; then
+  set -- $(ls bench/bench_*.c bench/bench_*.cxx 2>/dev/null | sed 's|bench/||; s|\.c.*$||')
+fi
+
+for name in "$@"; do
+  if [ -f "bench/$name.cxx" ]; then
+    g++ -std=c++17 $FLAGS "bench/$name.cxx" "$OUT"/*.o -o "$OUT/$name"
+  else
+    gcc $FLAGS "bench/$name.c" "$OUT"/*.o -o "$OUT/$name" -lm
+  fi
+
+  echo "== $name"
+  "$OUT/$name"
+done
@@ -29,6 +29,7 @@
 #include "config.h"
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <stdint.h>
 
 #ifdef CONFIG_GRAN
@@ -47,8 +48,79 @@
  *   granule allocator from interrupt level logic.
  * CONFIG_DEBUG_GRAN - Just like CONFIG_DEBUG_MM, but only generates output
  *   from the gran allocation logic.
+ * CONFIG_GRAN_REGISTRY_SHIFT - Log base 2 of the address space chunk size
+ *   used by the heap registry (gran_register()).  Default 20 (1 MiB).
+ * CONFIG_GRAN_REGISTRY_NHEAPS - Maximum number of registered heaps.
+ *   Default 8.
+ * CONFIG_GRAN_IOPOOL_REGION_SHIFT - Log base 2 of the size of each io_uring
+ *   fixed buffer that gran_iopool_register() registers.  Default 30
+ *   (1 GiB, the kernel limit).
+ * CONFIG_GRAN_NEPOCHS - Number of allocation epochs that can be live at
+ *   the same time once gran_epoch_initialize() is called.  Default 4.
+ * CONFIG_GRAN_COLOR_LINE - Cache line size used by gran_alloc_colored()
+ *   to stagger allocations within their granules.  Default 64.
+ * CONFIG_GRAN_ZONE_NGRANULES - A mixed granularity heap serves a request
+ *   from the zone with the smallest granules in which it needs at most
+ *   this many granules.  Default 8.
  */
 
+/* Conditions reported by gran_watermark_state() and the watermark
+ * notification callback.
+ */
+
+#define GRAN_WMARK_NFREE    0x01 /* nfree fell below its low watermark */
+#define GRAN_WMARK_MXFREE   0x02 /* mxfree fell below its low watermark */
+
+/* Lifetime hints for gran_alloc_hint() */
+
+#define GRAN_HINT_SHORT     0 /* Short lived; first fit from the bottom */
+#define GRAN_HINT_LONG      1 /* Long lived; from the top, below pinned */
+#define GRAN_HINT_PINNED    2 /* Never freed; topmost */
+#define GRAN_HINT_NCLASSES  3
+
+/* Flags for gran_numa_initialize() */
+
+#define GRAN_NUMA_INTERLEAVE 0x01 /* Add a sub-heap interleaved over all nodes */
+#define GRAN_NUMA_SIMULATE   0x02 /* Simulated topology; no memory policy */
+
+/* Flags for gran_initialize_uffd() */
+
+#define GRAN_UFFD_ZEROPAGE   0x01 /* Map the shared zero page on read faults */
+
+/* Number of buckets of the fault service time histogram */
+
+#define GRAN_UFFD_NBUCKETS   32
+
+/* Declare the C interface of a heap with a compile time geometry that a
+ * C++ translation unit defines with GRAN_HEAP_DEFINE() from gran.hxx:
+ *
+ *   GRAN_HEAP_DECLARE(g_dmaheap);
+ *
+ *   void *mem = g_dmaheap_alloc(47);
+ *   g_dmaheap_free(mem, 47);
+ *
+ * Such a heap has no struct mm_gran, so it is not passed as a handle to
+ * gran_alloc() and friends; the heap is named by the functions instead.
+ * A caller moves to it by replacing gran_alloc(handle, size) with
+ * name_alloc(size), gran_free(handle, memory, size) with
+ * name_free(memory, size) and gran_info(handle, info) with name_info(info).
+ */
+
+#ifdef __cplusplus
+#  define GRAN_HEAP_LINKAGE extern "C"
+#else
+#  define GRAN_HEAP_LINKAGE extern
+#endif
+
+#define GRAN_HEAP_DECLARE(name) \
+  GRAN_HEAP_LINKAGE void *name##_alloc(size_t size); \
+  GRAN_HEAP_LINKAGE void name##_free(void *memory, size_t size); \
+  GRAN_HEAP_LINKAGE void name##_info(struct graninfo *info)
+
+/* Returned by gran_alloc_handle() on failure */
+
+#define GRAN_INVALID_HANDLE UINT32_MAX
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
@@ -63,6 +135,202 @@ struct graninfo
   uint32_t  mxfree;    /* The max continous of free granules */
 };
 
+/* A growable array stored in one granule allocation.  When it grows, the
+ * vector first claims the granules that follow its storage and only
+ * relocates when they are in use.  The fields may be read directly.
+ */
+
+struct gran_vector
+{
+  struct mm_gran *gran;     /* The heap that holds the elements */
+  void           *data;     /* Start of the elements, NULL if none */
+  size_t          elemsize; /* Size of one element in bytes */
+  size_t          nelem;    /* Number of elements in use */
+  size_t          capacity; /* Allocated bytes (whole granules) */
+};
+
+/* A reference counted view of a granule allocation.  Slices of a buffer
+ * share its allocation; the count lives in a side array of the heap,
+ * indexed by the first granule (head) of the allocation.
+ */
+
+struct gran_buf
+{
+  void     *data;           /* Start of the buffer or slice */
+  size_t    len;            /* Length of the buffer or slice */
+  uint32_t  head;           /* First granule of the allocation */
+};
+
+/* A run of granules that is mapped twice, back to back.  base..base+size
+ * and base+size..base+2*size show the same memory.
+ */
+
+struct gran_ring
+{
+  void     *base;           /* Start of the first view */
+  size_t    size;           /* Size of one view (whole granules) */
+  void     *alloc;          /* The allocation inside the heap */
+};
+
+/* A window of the heap used for FIFO allocation.  Memory is handed out at
+ * head; map has a bit set for each granule in use and used counts them.
+ */
+
+struct gran_stream
+{
+  struct mm_gran *gran;     /* The heap that holds the window */
+  uint32_t        first;    /* First granule of the window */
+  uint32_t        end;      /* One past the last granule of the window */
+  uint32_t        head;     /* Next granule to allocate */
+  uint32_t        used;     /* Number of granules in use */
+  uint32_t       *map;      /* Granules in use, one bit each, from first */
+  uint8_t        *tags;     /* Length of each allocation at its first granule */
+};
+
+/* A scratch arena.  Memory is handed out by advancing next through the
+ * current extent; all extents are returned together by gran_arena_end().
+ */
+
+struct gran_arena_extent;
+
+struct gran_arena
+{
+  struct mm_gran           *gran;    /* The heap that holds the extents */
+  struct gran_arena_extent *extents; /* Most recently claimed extent */
+  uintptr_t                 next;    /* Next free byte of that extent */
+  uintptr_t                 end;     /* End of that extent */
+};
+
+/* A reclaim callback for gran_alloc().  shrink() is asked to free at
+ * least ngranules granules of the heap (for example by dropping cached
+ * objects with gran_free()) and returns the number it actually freed.
+ */
+
+struct gran_shrinker
+{
+  size_t (*shrink)(struct mm_gran *gran, size_t ngranules, void *arg);
+  void                 *arg;      /* Passed to shrink() */
+  int                   priority; /* Lower values are called first */
+  uint32_t              pass;     /* Used by the heap */
+  struct gran_shrinker *next;     /* Used by the heap */
+};
+
+/* Statistics of one lifetime hint class */
+
+struct gran_hintinfo
+{
+  uint32_t  nalloc;         /* Successful allocations */
+  uint32_t  nfail;          /* Failed allocations */
+  uint32_t  nfallback;      /* Allocations placed outside the class region */
+  uint32_t  nlive;          /* Granules allocated and not yet freed */
+};
+
+/* Statistics of one node of a NUMA heap set */
+
+struct gran_numa_info
+{
+  uint32_t  nlocal;         /* Allocations served from the caller's node */
+  uint32_t  nremote;        /* Allocations that fell back to another node */
+  uint32_t  nfree;          /* Free granules of the node's sub-heap */
+  uint32_t  mxfree;         /* Longest free run of the node's sub-heap */
+};
+
+struct gran_numa;
+
+/* Fault statistics of a userfaultfd backed heap.  hist[i] counts the
+ * faults whose handling took 2**i to 2**(i+1)-1 nanoseconds.
+ */
+
+struct gran_uffd_stats
+{
+  uint64_t  nfaults;        /* Pages populated on first touch */
+  uint64_t  nreclaimed;     /* Pages returned by gran_uffd_reclaim() */
+  uint64_t  hist[GRAN_UFFD_NBUCKETS];
+};
+
+/* One zone of a mixed granularity heap.  Zones are listed by increasing
+ * log2gran; a size of 0 gives the zone the rest of the heap.
+ */
+
+struct gran_zone
+{
+  uint8_t   log2gran;       /* Log base 2 of the granule size of the zone */
+  size_t    size;           /* Bytes of the heap given to the zone */
+};
+
+/* A movable allocation.  gran_compact() may move it; mem always holds
+ * the current address and relocate() is called after every move.  The
+ * structure is owned by the caller while the allocation exists.
+ */
+
+struct gran_movable
+{
+  void     *mem;            /* Current address of the allocation */
+  size_t    size;           /* Size passed to gran_alloc_movable() */
+  void    (*relocate)(struct gran_movable *m, void *oldmem, void *arg);
+  void     *arg;            /* Passed to relocate() */
+  struct gran_movable *prev; /* Used by the heap */
+  struct gran_movable *next; /* Used by the heap */
+};
+
+/* Memory pressure watermarks, in granules.  A condition is asserted when
+ * its value falls below the low watermark and cleared when it reaches the
+ * high watermark again.  mxfree is the longest free run, capped at the 32
+ * granule allocation limit.  Each change is reported once, through
+ * notify() and/or by writing 1 to eventfd (-1 for none).
+ */
+
+struct gran_watermarks
+{
+  uint32_t  nfree_low;      /* Assert GRAN_WMARK_NFREE below this */
+  uint32_t  nfree_high;     /* Clear GRAN_WMARK_NFREE at or above this */
+  uint32_t  mxfree_low;     /* Assert GRAN_WMARK_MXFREE below this */
+  uint32_t  mxfree_high;    /* Clear GRAN_WMARK_MXFREE at or above this */
+  void    (*notify)(struct mm_gran *gran, unsigned int state, void *arg);
+  void     *arg;            /* Passed to notify() */
+  int       eventfd;        /* eventfd to signal, or -1 */
+};
+
+/* A granule heap registered with io_uring as fixed buffers */
+
+struct gran_iopool
+{
+  struct mm_gran *gran;     /* The heap that holds the buffers */
+  int             ringfd;   /* The io_uring the heap is registered with, or -1 */
+  unsigned int    nbufs;    /* Number of regions, one fixed buffer each */
+};
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_handle_to_ptr and gran_ptr_to_handle
+ *
+ * Description:
+ *   Convert between an allocation handle (the granule number of its first
+ *   granule) and a pointer.  base and log2gran are gran_heapstart() and
+ *   gran_log2gran() of the heap; callers that convert often can keep them
+ *   and the conversion is one shift and one add.
+ *
+ * Input Parameters:
+ *   base     - Start of the granule area, as returned by gran_heapstart()
+ *   log2gran - Log base 2 of the granule size, from gran_log2gran()
+ *   memh     - The allocation handle
+ *   memory   - A pointer to memory previously allocated by gran_alloc.
+ *
+ ****************************************************************************/
+
+static inline void *gran_handle_to_ptr(void *base, uint8_t log2gran, uint32_t memh)
+{
+  return (char *)base + ((uintptr_t)memh << log2gran);
+}
+
+static inline uint32_t gran_ptr_to_handle(void *base, uint8_t log2gran, const void *memory)
+{
+  return (uint32_t)(((uintptr_t)memory - (uintptr_t)base) >> log2gran);
+}
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -130,6 +398,132 @@ extern "C"
 
 struct mm_gran *gran_initialize(void *heapstart, size_t heapsize, uint8_t log2gran, uint8_t log2align);
 
+/****************************************************************************
+ * Name: gran_initialize_memfd
+ *
+ * Description:
+ *   Set up a granule allocator instance on a heap that is backed by an
+ *   anonymous memory file (memfd) instead of caller memory.  Only such a
+ *   heap supports gran_alloc_ring(), because the same pages have to be
+ *   mapped a second time.  The granule size must be at least one page.
+ *   gran_release() unmaps the heap and closes the file.
+ *
+ * Input Parameters:
+ *   heapsize  - Size of heap in bytes
+ *   log2gran  - Log base 2 of the size of one granule
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned that may be used with other
+ *   granule allocator interfaces; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_memfd(size_t heapsize, uint8_t log2gran);
+
+/****************************************************************************
+ * Name: gran_initialize_uffd
+ *
+ * Description:
+ *   Set up a granule allocator instance on a reserved virtual range whose
+ *   pages are only populated when they are first touched.  The faults are
+ *   served by a userfaultfd handler thread.  Experimental.
+ *
+ * Input Parameters:
+ *   heapsize  - Size of heap in bytes
+ *   log2gran  - Log base 2 of the size of one granule
+ *   flags     - GRAN_UFFD_ZEROPAGE or 0
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned that may be used with other
+ *   granule allocator interfaces; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_uffd(size_t heapsize, uint8_t log2gran, unsigned int flags);
+
+/****************************************************************************
+ * Name: gran_uffd_reclaim
+ *
+ * Description:
+ *   Return the pages of a userfaultfd backed heap that hold no allocated
+ *   granule to the kernel.  They are populated again on the next touch.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_uffd
+ *
+ * Returned Value:
+ *   The number of pages returned, or a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+ssize_t gran_uffd_reclaim(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_uffd_stats
+ *
+ * Description:
+ *   Return the fault statistics of a userfaultfd backed heap.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_uffd
+ *   stats  - Returns the statistics
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if the heap is not backed by
+ *   userfaultfd.
+ *
+ ****************************************************************************/
+
+int gran_uffd_stats(struct mm_gran *gran, struct gran_uffd_stats *stats);
+
+/****************************************************************************
+ * Name: gran_initialize_zoned
+ *
+ * Description:
+ *   Set up one heap that is split into zones with different granule
+ *   sizes, each with its own GAT.  gran_alloc() serves a request from the
+ *   zone with the smallest granules in which it needs at most
+ *   CONFIG_GRAN_ZONE_NGRANULES granules (or the last zone).  Only when
+ *   that zone is full does it move on, first to the zones with larger
+ *   granules and then to the smaller ones that can still hold the request
+ *   in 32 granules.  If the granule sizes of neighbouring zones are at
+ *   most CONFIG_GRAN_ZONE_NGRANULES times apart, no request takes twice
+ *   its size or more.  gran_free() finds the zone from the address and
+ *   gran_info() reports all zones in units of the smallest granule.  gran_extend(), gran_reset(),
+ *   gran_alloc_wait(), gran_lookup() and gran_release() cover all zones
+ *   as well.  Arenas, buffers, handles, movables, hinted, colored and ring
+ *   allocations, vectors and I/O pools only use the first zone.
+ *
+ * Input Parameters:
+ *   heapstart - Start of the heap
+ *   heapsize  - Size of heap in bytes
+ *   zones     - The zones, by increasing log2gran
+ *   nzones    - Number of zones
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned; NULL is returned if the
+ *   zones do not fit in the heap or a zone could not be set up.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_zoned(void *heapstart, size_t heapsize,
+                                      const struct gran_zone *zones, unsigned int nzones);
+
+/****************************************************************************
+ * Name: gran_heapstart and gran_log2gran
+ *
+ * Description:
+ *   Return the start of the granule area of a heap (the address of granule
+ *   0) and the log base 2 of its granule size.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ ****************************************************************************/
+
+void *gran_heapstart(struct mm_gran *gran);
+uint8_t gran_log2gran(struct mm_gran *gran);
+
 /****************************************************************************
  * Name: gran_release
  *
@@ -157,7 +551,8 @@ void gran_release(struct mm_gran *gran);
  *   before any other allocations are made.
  *
  *   Reserved memory can never be allocated (it can be freed however which
- *   essentially unreserves the memory).
+ *   essentially unreserves the memory).  It stays allocated across
+ *   gran_reset().
  *
  * Input Parameters:
  *   handle - The handle previously returned by gran_initialize
@@ -165,11 +560,89 @@ void gran_release(struct mm_gran *gran);
  *   size   - The size of the region to be reserved
  *
  * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the
+ *   reservation could not be recorded, in which case nothing is reserved.
+ *
+ ****************************************************************************/
+
+int gran_reserve(struct mm_gran *gran, uintptr_t start, size_t size);
+
+/****************************************************************************
+ * Name: gran_reset
+ *
+ * Description:
+ *   Free every allocation in the heap at once, leaving only the ranges
+ *   passed to gran_reserve() allocated.  Movable allocations are freed as
+ *   well; their mem is set to NULL.  The live counts of gran_hint_info()
+ *   drop to zero.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_reset(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_epoch_initialize
+ *
+ * Description:
+ *   Enable epoch tagging.  Every later allocation is tagged with the
+ *   current epoch, starting with epoch 0.  Memory owned by streams,
+ *   arenas, rings, reference counted buffers and vectors is not tagged.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_epoch_initialize(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_epoch_begin
+ *
+ * Description:
+ *   Start the next epoch.  At most CONFIG_GRAN_NEPOCHS epochs can hold
+ *   allocations at the same time.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   The number of the new epoch on success; -EBUSY if that epoch still
+ *   holds allocations.
+ *
+ ****************************************************************************/
+
+int gran_epoch_begin(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_epoch_release
+ *
+ * Description:
+ *   Free every allocation that is still tagged with an epoch.  Movable
+ *   allocations of the epoch are freed as well; their mem is set to NULL.
+ *   Streams, arenas, rings, reference counted buffers and vectors keep
+ *   their memory; it is only freed by their own release functions.
+ *   The epoch does not record the lifetime class of hinted allocations,
+ *   so their live counts in gran_hint_info() are not reduced.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   epoch  - The epoch to release
+ *
+ * Returned Value:
  *   None
  *
  ****************************************************************************/
 
-void gran_reserve(struct mm_gran *gran, uintptr_t start, size_t size);
+void gran_epoch_release(struct mm_gran *gran, int epoch);
 
 /****************************************************************************
  * Name: gran_alloc
@@ -194,39 +667,1063 @@ void gran_reserve(struct mm_gran *gran, uintptr_t start, size_t size);
 void *gran_alloc(struct mm_gran *gran, size_t size);
 
 /****************************************************************************
- * Name: gran_free
+ * Name: gran_alloc_wait
  *
  * Description:
- *   Return memory to the granule heap.
+ *   Allocate memory from the granule heap.  If there is not enough free
+ *   memory the caller sleeps until a free makes the request plausible or
+ *   the timeout expires.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   size    - The size of the memory region to allocate.
+ *   timeout - The maximum time to wait in milliseconds, negative to wait
+ *             forever
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on timeout or failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_wait(struct mm_gran *gran, size_t size, int timeout);
+
+/****************************************************************************
+ * Name: gran_alloc_hint
+ *
+ * Description:
+ *   Allocate memory from the granule heap with a lifetime hint.  Each
+ *   class has its own region, sized by the live granules of the class:
+ *   short lived allocations at the bottom of the heap, long lived ones
+ *   below the pinned ones at the top.  Allocations that do not fit in
+ *   their region are counted as fallbacks.
  *
  * Input Parameters:
  *   handle - The handle previously returned by gran_initialize
- *   memory - A pointer to memory previously allocated by gran_alloc.
+ *   size   - The size of the memory region to allocate.
+ *   hint   - GRAN_HINT_SHORT, GRAN_HINT_LONG or GRAN_HINT_PINNED
  *
  * Returned Value:
- *   None
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
  *
  ****************************************************************************/
 
-void gran_free(struct mm_gran *gran, void *memory, size_t size);
+void *gran_alloc_hint(struct mm_gran *gran, size_t size, int hint);
 
 /****************************************************************************
- * Name: gran_info
+ * Name: gran_free_hint
  *
  * Description:
- *   Return information about the granule heap.
+ *   Free memory allocated by gran_alloc_hint() and update the statistics
+ *   of its class.  gran_free() may be used too, but then the memory stays
+ *   counted as live.
  *
  * Input Parameters:
  *   handle - The handle previously returned by gran_initialize
- *   info   - Memory location to return the gran allocator info.
+ *   memory - Memory returned by gran_alloc_hint()
+ *   size   - The size passed to gran_alloc_hint()
+ *   hint   - The hint passed to gran_alloc_hint()
  *
  * Returned Value:
- *   Zero (OK) is returned on success; a negated errno value is return on
- *   any failure.
+ *   None
  *
  ****************************************************************************/
 
-void gran_info(struct mm_gran *gran, struct graninfo *info);
+void gran_free_hint(struct mm_gran *gran, void *memory, size_t size, int hint);
+
+/****************************************************************************
+ * Name: gran_hint_info
+ *
+ * Description:
+ *   Return the statistics of one lifetime hint class.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   hint   - The hint class
+ *   info   - Returns the statistics
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_hint_info(struct mm_gran *gran, int hint, struct gran_hintinfo *info);
+
+/****************************************************************************
+ * Name: gran_alloc_colored
+ *
+ * Description:
+ *   Allocate memory from the granule heap at a rotating cache line offset
+ *   inside its granules, so that buffers allocated one after another do
+ *   not all start in the same cache sets.  The memory is freed with
+ *   gran_free() and the same size.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer aligned to CONFIG_GRAN_COLOR_LINE is
+ *   returned; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_colored(struct mm_gran *gran, size_t size);
+
+/****************************************************************************
+ * Name: gran_numa_initialize
+ *
+ * Description:
+ *   Create one granule heap per NUMA node, each bound to its node, and
+ *   optionally one heap interleaved over all nodes.
+ *
+ * Input Parameters:
+ *   nodesize - Size of each sub-heap in bytes
+ *   log2gran - Log base 2 of the size of one granule
+ *   nnodes   - Number of nodes, or 0 to use the nodes of the system
+ *   flags    - GRAN_NUMA_INTERLEAVE and/or GRAN_NUMA_SIMULATE
+ *
+ * Returned Value:
+ *   A handle for the other gran_numa interfaces, or NULL on failure.
+ *
+ ****************************************************************************/
+
+struct gran_numa *gran_numa_initialize(size_t nodesize, uint8_t log2gran,
+                                       unsigned int nnodes, unsigned int flags);
+
+/****************************************************************************
+ * Name: gran_numa_release
+ *
+ * Description:
+ *   Release all sub-heaps of a NUMA heap set.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_numa_release(struct gran_numa *numa);
+
+/****************************************************************************
+ * Name: gran_numa_alloc
+ *
+ * Description:
+ *   Allocate from the sub-heap of the calling CPU's node, falling back to
+ *   the other nodes.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_numa_alloc(struct gran_numa *numa, size_t size);
+
+/****************************************************************************
+ * Name: gran_numa_alloc_interleaved
+ *
+ * Description:
+ *   Allocate from the interleaved sub-heap, for data shared by all nodes.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure or without GRAN_NUMA_INTERLEAVE.
+ *
+ ****************************************************************************/
+
+void *gran_numa_alloc_interleaved(struct gran_numa *numa, size_t size);
+
+/****************************************************************************
+ * Name: gran_numa_free
+ *
+ * Description:
+ *   Return memory to the sub-heap that contains it.
+ *
+ * Input Parameters:
+ *   numa   - The handle returned by gran_numa_initialize
+ *   memory - Memory returned by gran_numa_alloc*()
+ *   size   - The size passed when it was allocated
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_numa_free(struct gran_numa *numa, void *memory, size_t size);
+
+/****************************************************************************
+ * Name: gran_numa_info
+ *
+ * Description:
+ *   Return the statistics of one node.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   node - The node
+ *   info - Returns the statistics
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if there is no such node.
+ *
+ ****************************************************************************/
+
+int gran_numa_info(struct gran_numa *numa, unsigned int node, struct gran_numa_info *info);
+
+/****************************************************************************
+ * Name: gran_shrinker_register
+ *
+ * Description:
+ *   Add a shrinker that gran_alloc() calls, in order of priority, when it
+ *   cannot find enough free granules.  The allocation is retried after
+ *   each shrinker that freed memory.  Shrinkers may register and
+ *   unregister shrinkers; an allocation from a shrinker fails instead of
+ *   shrinking the same heap again.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   shrinker - The shrinker; owned by the caller until unregistered
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_shrinker_register(struct mm_gran *gran, struct gran_shrinker *shrinker);
+
+/****************************************************************************
+ * Name: gran_shrinker_unregister
+ *
+ * Description:
+ *   Remove a shrinker from the heap.  When this returns the shrinker is
+ *   not running and will not be called again, unless it is called from
+ *   a shrinker of the same heap, which is the running pass itself.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   shrinker - A shrinker passed to gran_shrinker_register()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_shrinker_unregister(struct mm_gran *gran, struct gran_shrinker *shrinker);
+
+/****************************************************************************
+ * Name: gran_alloc_movable
+ *
+ * Description:
+ *   Allocate memory that gran_compact() is allowed to move.  relocate()
+ *   is called with the heap locked, so it must not call into the heap.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   m        - The movable allocation to fill in
+ *   size     - The size of the memory region to allocate.
+ *   relocate - Called after the memory was moved, or NULL
+ *   arg      - Passed to relocate()
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_alloc_movable(struct mm_gran *gran, struct gran_movable *m, size_t size,
+                       void (*relocate)(struct gran_movable *m, void *oldmem, void *arg),
+                       void *arg);
+
+/****************************************************************************
+ * Name: gran_free_movable
+ *
+ * Description:
+ *   Free a movable allocation.  Does nothing if the allocation was already
+ *   freed by gran_reset() or gran_epoch_release().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   m      - The movable allocation
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_movable(struct mm_gran *gran, struct gran_movable *m);
+
+/****************************************************************************
+ * Name: gran_compact
+ *
+ * Description:
+ *   Move movable allocations into the lowest free runs below them so that
+ *   free space gathers at the top of the heap.  An allocation with no free
+ *   run below it slides down into the free granules directly below it,
+ *   even if the new run overlaps the old one.  The work is bounded by a
+ *   byte budget so that the heap can be compacted incrementally.  The
+ *   relocate() callbacks run with the heap locked.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   budget - The maximum number of bytes to move
+ *
+ * Returned Value:
+ *   The number of bytes moved, or a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+ssize_t gran_compact(struct mm_gran *gran, size_t budget);
+
+/****************************************************************************
+ * Name: gran_compact_remap
+ *
+ * Description:
+ *   Let gran_compact() move the pages of an allocation with mremap()
+ *   instead of copying them, when the new run does not overlap the old
+ *   one.  Only for heaps whose granules are whole pages and whose memory
+ *   is private anonymous memory: the pages left behind are replaced by
+ *   new zero pages.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL is returned if the granules
+ *   are smaller than a page or the heap is a memfd or userfaultfd heap.
+ *
+ ****************************************************************************/
+
+int gran_compact_remap(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_alloc_constrained
+ *
+ * Description:
+ *   Allocate memory from the granule heap that lies entirely inside the
+ *   address range [lo, hi) and does not cross a multiple of 'boundary'.
+ *   This serves devices with a limited DMA reach or with buffers that may
+ *   not cross, say, a 64 KiB line from the one heap.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   size     - The size of the memory region to allocate.
+ *   lo       - Lowest acceptable address
+ *   hi       - One past the highest acceptable address
+ *   boundary - Power of two address boundary that the allocation may not
+ *              cross, or zero for none.  It may not be smaller than a
+ *              granule.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_constrained(struct mm_gran *gran, size_t size,
+                             uintptr_t lo, uintptr_t hi, size_t boundary);
+
+/****************************************************************************
+ * Name: gran_free
+ *
+ * Description:
+ *   Return memory to the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   memory - A pointer to memory previously allocated by gran_alloc.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free(struct mm_gran *gran, void *memory, size_t size);
+
+/****************************************************************************
+ * Name: gran_extend
+ *
+ * Description:
+ *   Resize an allocation in place.  Growing claims the granules that
+ *   immediately follow the allocation and fails if any of them is in use;
+ *   the allocation is never moved.  Shrinking returns the trailing
+ *   granules to the heap.  Granules gained by growing are tagged with the
+ *   epoch of the allocation, not the current one.
+ *
+ *   NOTE: The resized allocation is still limited to 32 granules.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   memory  - A pointer to memory previously allocated by gran_alloc.
+ *   oldsize - The size of the allocation as passed to gran_alloc.
+ *   newsize - The requested new size of the allocation.
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the following
+ *   granules are not free.  The allocation is unchanged on failure.
+ *
+ ****************************************************************************/
+
+int gran_extend(struct mm_gran *gran, void *memory, size_t oldsize, size_t newsize);
+
+/****************************************************************************
+ * Name: gran_alloc_handle
+ *
+ * Description:
+ *   Allocate memory from the granule heap and return it as a 32-bit
+ *   handle, the granule number of the first granule.  Convert it with
+ *   gran_handle_to_ptr().
+ *
+ *   NOTE: The heap state holds absolute addresses, so only the process
+ *   that initialized the heap may allocate and free in it, even if the
+ *   memory is shared.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, the handle of the allocated memory is returned;
+ *   GRAN_INVALID_HANDLE is returned on failure.
+ *
+ ****************************************************************************/
+
+uint32_t gran_alloc_handle(struct mm_gran *gran, size_t size);
+
+/****************************************************************************
+ * Name: gran_free_handle
+ *
+ * Description:
+ *   Return memory allocated with gran_alloc_handle() to the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   memh   - The allocation handle
+ *   size   - The size that was passed to gran_alloc_handle()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_handle(struct mm_gran *gran, uint32_t memh, size_t size);
+
+/****************************************************************************
+ * Name: gran_register
+ *
+ * Description:
+ *   Add a heap to the registry used by gran_lookup() and gran_free_any().
+ *   Registration is expected to be rare; it takes a lock and may allocate
+ *   radix table pages.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EEXIST is returned if the heap is
+ *   already registered and -ENOMEM if the registry is full or a table
+ *   could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_register(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_unregister
+ *
+ * Description:
+ *   Remove a heap from the registry.  The caller must make sure that no
+ *   other thread is still looking up addresses in the heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_unregister(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_lookup
+ *
+ * Description:
+ *   Find the registered heap that contains an address.  This takes no lock:
+ *   normally it is two table loads and a range check.
+ *
+ * Input Parameters:
+ *   memory - Any address
+ *
+ * Returned Value:
+ *   The heap that contains the address, or NULL if there is none.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_lookup(const void *memory);
+
+/****************************************************************************
+ * Name: gran_free_any
+ *
+ * Description:
+ *   Return memory to whichever registered heap it was allocated from.
+ *
+ * Input Parameters:
+ *   memory - A pointer to memory previously allocated by gran_alloc.
+ *   size   - The size that was passed to gran_alloc.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_any(void *memory, size_t size);
+
+/****************************************************************************
+ * Name: gran_alloc_sg
+ *
+ * Description:
+ *   Allocate memory from the granule heap as up to maxsegs separate runs.
+ *   One pass over the GAT collects the largest free runs and the request
+ *   is served from them, largest first.  This succeeds on a fragmented
+ *   heap as long as enough memory is free in few enough pieces.  Neither
+ *   the total size nor the size of a segment is limited to 32 granules;
+ *   each free run is used as one segment.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   size    - The total size of the memory to allocate.
+ *   maxsegs - The number of entries in iov[]
+ *   iov     - Returns the segments.  The iov_len of every segment but the
+ *             last is a whole number of granules.
+ *
+ * Returned Value:
+ *   The number of segments used on success; -ENOMEM if the request cannot
+ *   be served in maxsegs segments, in which case nothing is allocated.
+ *
+ ****************************************************************************/
+
+int gran_alloc_sg(struct mm_gran *gran, size_t size, int maxsegs, struct iovec *iov);
+
+/****************************************************************************
+ * Name: gran_free_sg
+ *
+ * Description:
+ *   Return memory allocated with gran_alloc_sg() to the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   iov    - The segments returned by gran_alloc_sg()
+ *   nsegs  - The number of segments returned by gran_alloc_sg()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_sg(struct mm_gran *gran, const struct iovec *iov, int nsegs);
+
+/****************************************************************************
+ * Name: gran_iopool_register
+ *
+ * Description:
+ *   Register the whole granule heap with an io_uring instance as fixed
+ *   buffers, so that IORING_OP_READ_FIXED/WRITE_FIXED can be used on
+ *   memory from gran_iopool_alloc() without pinning pages for each I/O.
+ *   The ring must not have any other buffers registered.  If ringfd is
+ *   negative, registration is skipped: buffers still never span two
+ *   regions, so the pool can be used with plain reads and writes where
+ *   io_uring is not available.
+ *
+ * Input Parameters:
+ *   pool   - The pool state to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *   ringfd - The io_uring file descriptor, or -1
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_iopool_register(struct gran_iopool *pool, struct mm_gran *gran, int ringfd);
+
+/****************************************************************************
+ * Name: gran_iopool_unregister
+ *
+ * Description:
+ *   Unregister the fixed buffers of the pool.  All I/O using them must
+ *   have completed.  Nothing is done if registration was skipped.
+ *
+ * Input Parameters:
+ *   pool - The pool state
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_iopool_unregister(struct gran_iopool *pool);
+
+/****************************************************************************
+ * Name: gran_iopool_alloc
+ *
+ * Description:
+ *   Allocate an I/O buffer from the pool.  The buffer never spans two
+ *   registered regions, so it can be used with the fixed buffer index
+ *   that is returned.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   size   - The size of the buffer
+ *   bufidx - Returns the index to place in the buf_index field of the SQE
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the buffer is returned; NULL is
+ *   returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_iopool_alloc(struct gran_iopool *pool, size_t size, unsigned int *bufidx);
+
+/****************************************************************************
+ * Name: gran_iopool_bufindex
+ *
+ * Description:
+ *   Return the fixed buffer index that covers an address in the pool.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   memory - An address inside the heap
+ *
+ * Returned Value:
+ *   The fixed buffer index.
+ *
+ ****************************************************************************/
+
+unsigned int gran_iopool_bufindex(struct gran_iopool *pool, const void *memory);
+
+/****************************************************************************
+ * Name: gran_iopool_free
+ *
+ * Description:
+ *   Return an I/O buffer to the pool.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   memory - A buffer previously returned by gran_iopool_alloc()
+ *   size   - The size that was passed to gran_iopool_alloc()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_iopool_free(struct gran_iopool *pool, void *memory, size_t size);
+
+/****************************************************************************
+ * Name: gran_buf_initialize
+ *
+ * Description:
+ *   Enable reference counted buffers on a granule heap.  This allocates
+ *   the reference count array, one 32-bit entry per granule, outside of
+ *   the heap.  It is released by gran_release().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the array
+ *   could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_buf_initialize(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_buf_alloc
+ *
+ * Description:
+ *   Allocate a reference counted buffer.  The buffer starts with one
+ *   reference.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the buffer
+ *   buf    - Returns the buffer
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_buf_alloc(struct mm_gran *gran, size_t size, struct gran_buf *buf);
+
+/****************************************************************************
+ * Name: gran_buf_ref
+ *
+ * Description:
+ *   Take one more reference to the allocation behind a buffer or slice.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_buf_ref(struct mm_gran *gran, const struct gran_buf *buf);
+
+/****************************************************************************
+ * Name: gran_buf_unref
+ *
+ * Description:
+ *   Drop one reference.  The last reference frees the whole allocation,
+ *   whichever buffer or slice it was taken through.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer.  It may not be used after this call.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_buf_unref(struct mm_gran *gran, struct gran_buf *buf);
+
+/****************************************************************************
+ * Name: gran_buf_slice
+ *
+ * Description:
+ *   Make a sub-buffer that shares the memory of a buffer without copying.
+ *   The slice holds its own reference and is released with
+ *   gran_buf_unref() like any other buffer.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer or slice to take the sub-buffer from
+ *   offset - Start of the slice relative to buf->data
+ *   len    - Length of the slice
+ *   slice  - Returns the slice
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL is returned if the range is
+ *   not inside the buffer.
+ *
+ ****************************************************************************/
+
+int gran_buf_slice(struct mm_gran *gran, const struct gran_buf *buf,
+                   size_t offset, size_t len, struct gran_buf *slice);
+
+/****************************************************************************
+ * Name: gran_alloc_ring
+ *
+ * Description:
+ *   Allocate a run of granules and map it twice, back to back, in virtual
+ *   address space.  Accesses up to size bytes past the end of the first
+ *   view land at the start of the run again, so a ring buffer can be read
+ *   and written contiguously across the wrap point.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_memfd
+ *   size   - The size of the ring; rounded up to whole granules
+ *   ring   - Returns the ring
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_alloc_ring(struct mm_gran *gran, size_t size, struct gran_ring *ring);
+
+/****************************************************************************
+ * Name: gran_free_ring
+ *
+ * Description:
+ *   Unmap both views of a ring and return its granules to the heap.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_memfd
+ *   ring   - The ring returned by gran_alloc_ring
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_ring(struct mm_gran *gran, struct gran_ring *ring);
+
+/****************************************************************************
+ * Name: gran_stream_initialize
+ *
+ * Description:
+ *   Reserve a window of contiguous granules in the heap for FIFO
+ *   allocation.  gran_alloc() keeps working on the rest of the heap.
+ *
+ * Input Parameters:
+ *   stream - The stream state to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the window in bytes
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_stream_initialize(struct gran_stream *stream, struct mm_gran *gran, size_t size);
+
+/****************************************************************************
+ * Name: gran_stream_alloc
+ *
+ * Description:
+ *   Allocate memory at the head of the stream without searching the GAT.
+ *   The head skips over memory that is still in use to granules that
+ *   were freed out of order.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *   size   - The size of the memory to allocate (at most 127 granules)
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned if the window is full.
+ *
+ ****************************************************************************/
+
+void *gran_stream_alloc(struct gran_stream *stream, size_t size);
+
+/****************************************************************************
+ * Name: gran_stream_free
+ *
+ * Description:
+ *   Free memory allocated with gran_stream_alloc().  The memory can be
+ *   allocated from the stream again right away, also when it is freed out
+ *   of order.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *   memory - Memory returned by gran_stream_alloc()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_stream_free(struct gran_stream *stream, void *memory);
+
+/****************************************************************************
+ * Name: gran_stream_release
+ *
+ * Description:
+ *   Return the window of a stream to the heap.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_stream_release(struct gran_stream *stream);
+
+/****************************************************************************
+ * Name: gran_arena_begin
+ *
+ * Description:
+ *   Start an empty scratch arena on a granule heap.
+ *
+ * Input Parameters:
+ *   arena  - The arena to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_arena_begin(struct gran_arena *arena, struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_arena_alloc
+ *
+ * Description:
+ *   Allocate scratch memory from an arena by advancing a pointer.  New
+ *   extents of up to 32 granules are claimed from the heap as needed.
+ *
+ * Input Parameters:
+ *   arena - The arena
+ *   size  - The size of the memory to allocate
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer aligned to max_align_t is returned;
+ *   NULL is returned on failure or if size is zero.
+ *
+ ****************************************************************************/
+
+void *gran_arena_alloc(struct gran_arena *arena, size_t size);
+
+/****************************************************************************
+ * Name: gran_arena_end
+ *
+ * Description:
+ *   Return every extent of the arena to the heap at once.  All memory
+ *   allocated from the arena becomes invalid.
+ *
+ * Input Parameters:
+ *   arena - The arena
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_arena_end(struct gran_arena *arena);
+
+/****************************************************************************
+ * Name: gran_info
+ *
+ * Description:
+ *   Return information about the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   info   - Memory location to return the gran allocator info.
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is return on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+void gran_info(struct mm_gran *gran, struct graninfo *info);
+
+/****************************************************************************
+ * Name: gran_watermark_set
+ *
+ * Description:
+ *   Set the memory pressure watermarks of a heap, or disable them.  The
+ *   free counters are then maintained on every allocation and free, and
+ *   crossings are reported from those paths without polling gran_info().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   wm     - The watermarks, or NULL to disable
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if a low watermark is above
+ *   its high watermark; -ENOMEM if the counters could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_watermark_set(struct mm_gran *gran, const struct gran_watermarks *wm);
+
+/****************************************************************************
+ * Name: gran_watermark_state
+ *
+ * Description:
+ *   Return the watermark conditions that are currently asserted.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   A combination of GRAN_WMARK_NFREE and GRAN_WMARK_MXFREE.
+ *
+ ****************************************************************************/
+
+unsigned int gran_watermark_state(struct mm_gran *gran);
+
+/****************************************************************************
+ * Name: gran_vector_init
+ *
+ * Description:
+ *   Initialize an empty vector.  No memory is allocated until the first
+ *   element is added.
+ *
+ * Input Parameters:
+ *   vec      - The vector to initialize
+ *   handle   - The handle previously returned by gran_initialize
+ *   elemsize - The size of one element in bytes
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_vector_init(struct gran_vector *vec, struct mm_gran *gran, size_t elemsize);
+
+/****************************************************************************
+ * Name: gran_vector_reserve
+ *
+ * Description:
+ *   Make room for at least nelem elements.  The vector first tries to claim
+ *   the granules that immediately follow its storage with gran_extend() and
+ *   only relocates (doubling its capacity) when they are in use.
+ *
+ *   NOTE: The storage is a single allocation, so it is limited to 32
+ *   granules like any other allocation.
+ *
+ * Input Parameters:
+ *   vec   - The vector
+ *   nelem - The number of elements that must fit
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the storage
+ *   could not be grown.  The vector is unchanged on failure.
+ *
+ ****************************************************************************/
+
+int gran_vector_reserve(struct gran_vector *vec, size_t nelem);
+
+/****************************************************************************
+ * Name: gran_vector_append
+ *
+ * Description:
+ *   Append elements to the end of the vector, growing it as needed.
+ *
+ * Input Parameters:
+ *   vec   - The vector
+ *   elem  - The elements to copy in, or NULL to leave them uninitialized
+ *   nelem - The number of elements to append
+ *
+ * Returned Value:
+ *   A pointer to the first appended element; NULL is returned if the
+ *   vector could not be grown.
+ *
+ ****************************************************************************/
+
+void *gran_vector_append(struct gran_vector *vec, const void *elem, size_t nelem);
+
+/****************************************************************************
+ * Name: gran_vector_release
+ *
+ * Description:
+ *   Return the storage of the vector to the heap and make it empty.
+ *
+ * Input Parameters:
+ *   vec - The vector
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_vector_release(struct gran_vector *vec);
 
 #undef EXTERN
 #ifdef __cplusplus
@@ -0,0 +1,742 @@
+/****************************************************************************
+ * include/nuttx/mm/gran.hxx
+ * C++ adapters for the granule memory allocator.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#ifndef __INCLUDE_NUTTX_MM_GRAN_HXX
+#define __INCLUDE_NUTTX_MM_GRAN_HXX
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "gran.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L
+#  include <span>
+#endif
+
+#ifdef CONFIG_GRAN
+
+namespace gran
+{
+
+/* Granule geometry of a heap */
+
+inline std::size_t granule_size(struct mm_gran *gran) noexcept
+{
+  return (std::size_t)1 << gran_log2gran(gran);
+}
+
+inline uint32_t ngranules(struct mm_gran *gran, std::size_t size) noexcept
+{
+  return (size + granule_size(gran) - 1) >> gran_log2gran(gran);
+}
+
+/****************************************************************************
+ * Name: gran::allocate_bytes
+ *
+ * Description:
+ *   Allocate 'bytes' from the granule heap with at least 'alignment'
+ *   alignment.  Requests that the heap cannot satisfy (too large for one
+ *   allocation or over-aligned) fail with std::bad_alloc.
+ *
+ *   Zero sized requests are given one granule so that every allocation
+ *   has a unique address.  gran_free() must then be called with the same
+ *   rounding; gran::free_bytes() does that.
+ *
+ ****************************************************************************/
+
+inline void *allocate_bytes(struct mm_gran *gran, std::size_t bytes,
+                            std::size_t alignment)
+{
+  void *mem;
+
+  if (bytes == 0)
+    {
+      bytes = 1;
+    }
+
+  if (bytes > 32 * granule_size(gran) || alignment > granule_size(gran))
+    {
+      throw std::bad_alloc();
+    }
+
+  mem = gran_alloc(gran, bytes);
+  if (mem == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+
+  /* Granules are only aligned to log2align relative to the heap start */
+
+  if (((uintptr_t)mem & (alignment - 1)) != 0)
+    {
+      gran_free(gran, mem, bytes);
+      throw std::bad_alloc();
+    }
+
+  return mem;
+}
+
+inline void free_bytes(struct mm_gran *gran, void *mem,
+                       std::size_t bytes) noexcept
+{
+  gran_free(gran, mem, bytes == 0 ? 1 : bytes);
+}
+
+/****************************************************************************
+ * Name: gran::extent
+ *
+ * Description:
+ *   A move-only owner of one granule allocation.  The extent remembers the
+ *   heap, the memory and its size rounded up to whole granules, so the
+ *   memory is returned with the right size when the extent is destroyed
+ *   and callers no longer carry (pointer, size) pairs around.  data() and
+ *   size() only read the extent, without calls into the allocator.
+ *
+ *   Usage:
+ *
+ *     gran::extent buf(g_gran, 1500);
+ *     if (buf && buf.grow(3000)) ...
+ *
+ ****************************************************************************/
+
+class extent
+{
+public:
+  extent() noexcept
+    : m_gran(nullptr), m_data(nullptr), m_size(0)
+  {
+  }
+
+  /* Allocate 'size' bytes from the heap.  On failure the extent is empty */
+
+  extent(struct mm_gran *gran, std::size_t size) noexcept
+    : m_gran(nullptr), m_data(nullptr), m_size(0)
+  {
+    void *mem = size > 0 && size <= 32 * granule_size(gran) ?
+                gran_alloc(gran, size) : nullptr;
+
+    if (mem != nullptr)
+      {
+        m_gran = gran;
+        m_data = (std::byte *)mem;
+        m_size = (std::size_t)gran::ngranules(gran, size) << gran_log2gran(gran);
+      }
+  }
+
+  extent(const extent &) = delete;
+  extent &operator=(const extent &) = delete;
+
+  extent(extent &&other) noexcept
+    : m_gran(std::exchange(other.m_gran, nullptr)),
+      m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0))
+  {
+  }
+
+  extent &operator=(extent &&other) noexcept
+  {
+    if (this != &other)
+      {
+        reset();
+        m_gran = std::exchange(other.m_gran, nullptr);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+      }
+
+    return *this;
+  }
+
+  ~extent()
+  {
+    reset();
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return m_gran != nullptr;
+  }
+
+  std::byte *data() const noexcept
+  {
+    return m_data;
+  }
+
+  std::size_t size() const noexcept
+  {
+    return m_size;
+  }
+
+  uint32_t ngranules() const noexcept
+  {
+    return m_gran == nullptr ? 0 : m_size >> gran_log2gran(m_gran);
+  }
+
+  struct mm_gran *gran() const noexcept
+  {
+    return m_gran;
+  }
+
+#if __cplusplus >= 202002L
+  operator std::span<std::byte>() const noexcept
+  {
+    return std::span<std::byte>(data(), size());
+  }
+#endif
+
+  /* Grow or shrink in place with gran_extend().  Returns false and leaves
+   * the extent unchanged if the following granules are in use.
+   */
+
+  bool grow(std::size_t newsize) noexcept
+  {
+    if (m_gran == nullptr || newsize == 0 ||
+        gran_extend(m_gran, m_data, m_size, newsize) < 0)
+      {
+        return false;
+      }
+
+    m_size = (std::size_t)gran::ngranules(m_gran, newsize) << gran_log2gran(m_gran);
+    return true;
+  }
+
+  /* Give up ownership.  The caller becomes responsible for freeing the
+   * memory, so size() must be read before calling release().
+   */
+
+  void *release() noexcept
+  {
+    void *mem = m_data;
+
+    m_gran = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+    return mem;
+  }
+
+  void reset() noexcept
+  {
+    if (m_gran != nullptr)
+      {
+        gran_free(m_gran, m_data, m_size);
+        m_gran = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+      }
+  }
+
+private:
+  struct mm_gran *m_gran;
+  std::byte      *m_data;
+  std::size_t     m_size;
+};
+
+/****************************************************************************
+ * Name: gran::vector
+ *
+ * Description:
+ *   A move-only C++ view of struct gran_vector for trivially copyable
+ *   element types.  Growth extends the storage in place when the following
+ *   granules are free and relocates with memcpy otherwise.
+ *
+ ****************************************************************************/
+
+template <typename T>
+class vector
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "gran::vector relocates elements with memcpy");
+
+public:
+  explicit vector(struct mm_gran *gran) noexcept
+  {
+    gran_vector_init(&m_vec, gran, sizeof(T));
+  }
+
+  vector(const vector &) = delete;
+  vector &operator=(const vector &) = delete;
+
+  vector(vector &&other) noexcept
+    : m_vec(other.m_vec)
+  {
+    other.m_vec.data     = nullptr;
+    other.m_vec.nelem    = 0;
+    other.m_vec.capacity = 0;
+  }
+
+  vector &operator=(vector &&other) noexcept
+  {
+    if (this != &other)
+      {
+        gran_vector_release(&m_vec);
+        m_vec                = other.m_vec;
+        other.m_vec.data     = nullptr;
+        other.m_vec.nelem    = 0;
+        other.m_vec.capacity = 0;
+      }
+
+    return *this;
+  }
+
+  ~vector()
+  {
+    gran_vector_release(&m_vec);
+  }
+
+  /* Returns false if the storage could not be grown */
+
+  bool reserve(std::size_t n) noexcept
+  {
+    return gran_vector_reserve(&m_vec, n) == 0;
+  }
+
+  bool push_back(const T &value) noexcept
+  {
+    return gran_vector_append(&m_vec, &value, 1) != nullptr;
+  }
+
+  bool append(const T *values, std::size_t n) noexcept
+  {
+    return gran_vector_append(&m_vec, values, n) != nullptr;
+  }
+
+  void clear() noexcept
+  {
+    m_vec.nelem = 0;
+  }
+
+  T *data() const noexcept
+  {
+    return static_cast<T *>(m_vec.data);
+  }
+
+  std::size_t size() const noexcept
+  {
+    return m_vec.nelem;
+  }
+
+  std::size_t capacity() const noexcept
+  {
+    return m_vec.capacity / sizeof(T);
+  }
+
+  bool empty() const noexcept
+  {
+    return m_vec.nelem == 0;
+  }
+
+  T &operator[](std::size_t i) const noexcept
+  {
+    return data()[i];
+  }
+
+  T *begin() const noexcept
+  {
+    return data();
+  }
+
+  T *end() const noexcept
+  {
+    return data() + m_vec.nelem;
+  }
+
+private:
+  struct gran_vector m_vec;
+};
+
+} // namespace gran
+
+/****************************************************************************
+ * Name: gran_memory_resource
+ *
+ * Description:
+ *   A std::pmr::memory_resource that serves every request from one granule
+ *   heap.  The heap is not owned by the resource.  Because the sized
+ *   deallocate of memory_resource maps directly onto gran_free(), no
+ *   per-block header is needed.
+ *
+ *   Usage:
+ *
+ *     gran_memory_resource res(g_gran);
+ *     std::pmr::vector<int> v(&res);
+ *
+ ****************************************************************************/
+
+class gran_memory_resource : public std::pmr::memory_resource
+{
+public:
+  explicit gran_memory_resource(struct mm_gran *gran) noexcept
+    : m_gran(gran)
+  {
+  }
+
+  struct mm_gran *gran() const noexcept
+  {
+    return m_gran;
+  }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override
+  {
+    return gran::allocate_bytes(m_gran, bytes, alignment);
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override
+  {
+    (void)alignment;
+    gran::free_bytes(m_gran, p, bytes);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other)
+    const noexcept override
+  {
+    const gran_memory_resource *res =
+      dynamic_cast<const gran_memory_resource *>(&other);
+
+    return res != nullptr && res->m_gran == m_gran;
+  }
+
+  struct mm_gran *m_gran;
+};
+
+/****************************************************************************
+ * Name: gran_allocator
+ *
+ * Description:
+ *   A size-aware standard allocator over one granule heap.  It holds only
+ *   the heap pointer, and deallocate(p, n) is passed straight to
+ *   gran_free().
+ *
+ *   Usage:
+ *
+ *     std::vector<int, gran_allocator<int>> v(gran_allocator<int>(g_gran));
+ *
+ ****************************************************************************/
+
+template <typename T>
+class gran_allocator
+{
+public:
+  using value_type = T;
+
+  explicit gran_allocator(struct mm_gran *gran) noexcept
+    : m_gran(gran)
+  {
+  }
+
+  template <typename U>
+  gran_allocator(const gran_allocator<U> &other) noexcept
+    : m_gran(other.gran())
+  {
+  }
+
+  T *allocate(std::size_t n)
+  {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      {
+        throw std::bad_array_new_length();
+      }
+
+    return static_cast<T *>(gran::allocate_bytes(m_gran, n * sizeof(T),
+                                                 alignof(T)));
+  }
+
+  void deallocate(T *p, std::size_t n) noexcept
+  {
+    gran::free_bytes(m_gran, p, n * sizeof(T));
+  }
+
+  struct mm_gran *gran() const noexcept
+  {
+    return m_gran;
+  }
+
+private:
+  struct mm_gran *m_gran;
+};
+
+template <typename T, typename U>
+inline bool operator==(const gran_allocator<T> &a,
+                       const gran_allocator<U> &b) noexcept
+{
+  return a.gran() == b.gran();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const gran_allocator<T> &a,
+                       const gran_allocator<U> &b) noexcept
+{
+  return a.gran() != b.gran();
+}
+
+/****************************************************************************
+ * Name: gran_heap
+ *
+ * Description:
+ *   A granule heap whose geometry is fixed at compile time.  The heap
+ *   memory and the GAT are members of the object, so a gran_heap with
+ *   static storage duration needs no initialization call.  The GAT has the
+ *   same format as the one of struct mm_gran (bit n of entry n / 32 is set
+ *   when granule n is allocated) and allocations are limited to 32
+ *   granules in the same way, but every shift and mask is a constant and
+ *   the loops over the GAT have a constant trip count, so the compiler can
+ *   fold and unroll them.
+ *
+ *   Usage:
+ *
+ *     static gran_heap<6, 4, 65536> g_dmaheap;
+ *
+ *     void *mem = g_dmaheap.alloc(47);
+ *     g_dmaheap.free(mem, 47);
+ *
+ *   GRAN_HEAP_DEFINE() wraps an instance in C functions that C code
+ *   declares with GRAN_HEAP_DECLARE() from gran.h.
+ *
+ ****************************************************************************/
+
+template <unsigned int Log2Gran, unsigned int Log2Align, std::size_t HeapBytes>
+class gran_heap
+{
+  static_assert(Log2Gran > 0 && Log2Gran < 32,
+                "the granule size must be 2 bytes to 2 GiB");
+  static_assert(Log2Align <= Log2Gran,
+                "log2gran must be greater than or equal to log2align");
+  static_assert((HeapBytes >> Log2Gran) > 0 &&
+                (HeapBytes >> Log2Gran) <= UINT32_MAX,
+                "the heap must hold 1 to 2**32-1 granules");
+
+public:
+  static constexpr std::size_t granule_size = std::size_t(1) << Log2Gran;
+  static constexpr uint32_t    ngranules    = HeapBytes >> Log2Gran;
+  static constexpr uint32_t    ngat         = (ngranules + 31) >> 5;
+  static constexpr std::size_t max_alloc    = 32 * granule_size;
+
+  gran_heap() noexcept
+    : m_gat{}
+  {
+  }
+
+  gran_heap(const gran_heap &) = delete;
+  gran_heap &operator=(const gran_heap &) = delete;
+
+  /* Allocate 'size' bytes.  Returns nullptr if size is 0 or more than 32
+   * granules, or if there is no free run that large.
+   */
+
+  void *alloc(std::size_t size) noexcept
+  {
+    uint64_t starts;
+    uint32_t ngran;
+    uint32_t gatidx;
+    uint32_t granno;
+
+    if (size == 0 || size > max_alloc)
+      {
+        return nullptr;
+      }
+
+    ngran = nrequired(size);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (gatidx = 0; gatidx < ngat; gatidx++)
+      {
+        /* Runs that start in this entry may continue into the next one */
+
+        starts = runs(~(entry(gatidx) | (uint64_t)entry(gatidx + 1) << 32),
+                      ngran) & 0xffffffff;
+        if (starts != 0)
+          {
+            granno = (gatidx << 5) + __builtin_ctzll(starts);
+            update(granno, ngran, true);
+            return m_heap + ((std::size_t)granno << Log2Gran);
+          }
+      }
+
+    return nullptr;
+  }
+
+  /* Return memory from alloc() with the size that was passed to alloc() */
+
+  void free(void *memory, std::size_t size) noexcept
+  {
+    uintptr_t offset = (uintptr_t)memory - (uintptr_t)m_heap;
+
+    assert(contains(memory) && (offset & (granule_size - 1)) == 0 &&
+           size > 0 && size <= max_alloc);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    update(offset >> Log2Gran, nrequired(size), false);
+  }
+
+  void *base() noexcept
+  {
+    return m_heap;
+  }
+
+  bool contains(const void *memory) const noexcept
+  {
+    return (uintptr_t)memory - (uintptr_t)m_heap <
+           ((uintptr_t)ngranules << Log2Gran);
+  }
+
+  /* Same statistics as gran_info() */
+
+  void info(struct graninfo *info) noexcept
+  {
+    uint32_t value;
+    uint32_t run    = 0;
+    uint32_t gatidx;
+    unsigned int bit;
+
+    info->log2gran  = Log2Gran;
+    info->ngranules = ngranules;
+    info->nfree     = 0;
+    info->mxfree    = 0;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (gatidx = 0; gatidx < ngat; gatidx++)
+      {
+        value        = entry(gatidx);
+        info->nfree += 32 - __builtin_popcount(value);
+
+        for (bit = 0; bit < 32; bit++)
+          {
+            run = (value & ((uint32_t)1 << bit)) ? 0 : run + 1;
+            if (run > info->mxfree)
+              {
+                info->mxfree = run;
+              }
+          }
+      }
+  }
+
+private:
+  /* GAT bits past the last granule, which always read as allocated */
+
+  static constexpr uint32_t tailmask =
+    (ngranules & 31) == 0 ? 0 : 0xffffffff << (ngranules & 31);
+
+  static constexpr uint32_t nrequired(std::size_t size) noexcept
+  {
+    return (size + granule_size - 1) >> Log2Gran;
+  }
+
+  uint32_t entry(uint32_t gatidx) const noexcept
+  {
+    return gatidx >= ngat ? 0xffffffff :
+           gatidx == ngat - 1 ? m_gat[gatidx] | tailmask : m_gat[gatidx];
+  }
+
+  /* Return the bit positions of 'freemap' where ngran set bits start */
+
+  static uint64_t runs(uint64_t freemap, uint32_t ngran) noexcept
+  {
+    uint32_t have = 1;
+    uint32_t shift;
+
+    while (have < ngran)
+      {
+        shift    = have < ngran - have ? have : ngran - have;
+        freemap &= freemap >> shift;
+        have    += shift;
+      }
+
+    return freemap;
+  }
+
+  void update(uint32_t granno, uint32_t ngran, bool allocated) noexcept
+  {
+    uint64_t mask   = (((uint64_t)1 << ngran) - 1) << (granno & 31);
+    uint32_t gatidx = granno >> 5;
+
+    assert(granno + ngran <= ngranules);
+
+    if (allocated)
+      {
+        assert((m_gat[gatidx] & (uint32_t)mask) == 0);
+        m_gat[gatidx] |= (uint32_t)mask;
+      }
+    else
+      {
+        assert((m_gat[gatidx] & (uint32_t)mask) == (uint32_t)mask);
+        m_gat[gatidx] &= ~(uint32_t)mask;
+      }
+
+    if ((mask >> 32) != 0)
+      {
+        if (allocated)
+          {
+            assert((m_gat[gatidx + 1] & (uint32_t)(mask >> 32)) == 0);
+            m_gat[gatidx + 1] |= (uint32_t)(mask >> 32);
+          }
+        else
+          {
+            assert((m_gat[gatidx + 1] & (uint32_t)(mask >> 32)) ==
+                   (uint32_t)(mask >> 32));
+            m_gat[gatidx + 1] &= ~(uint32_t)(mask >> 32);
+          }
+      }
+  }
+
+  alignas((std::size_t)1 << Log2Align)
+  unsigned char m_heap[(std::size_t)ngranules << Log2Gran];
+  uint32_t      m_gat[ngat];
+  std::mutex    m_lock;
+};
+
+/* Define a gran_heap instance together with the C functions that
+ * GRAN_HEAP_DECLARE() declares, so C callers can use a specialized heap.
+ * Use it once, at file scope, in a C++ translation unit.  The functions
+ * take no handle: gran_alloc() and friends only know the run time heap
+ * layout, and teaching them about instances would cost every run time
+ * heap a branch.
+ */
+
+#define GRAN_HEAP_DEFINE(name, log2gran, log2align, heapbytes) \
+  static gran_heap<log2gran, log2align, heapbytes> name##_instance; \
+  extern "C" void *name##_alloc(size_t size) \
+  { \
+    return name##_instance.alloc(size); \
+  } \
+  extern "C" void name##_free(void *memory, size_t size) \
+  { \
+    name##_instance.free(memory, size); \
+  } \
+  extern "C" void name##_info(struct graninfo *info) \
+  { \
+    name##_instance.info(info); \
+  }
+
+#endif /* CONFIG_GRAN */
+#endif /* __INCLUDE_NUTTX_MM_GRAN_HXX */
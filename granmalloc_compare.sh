@@ -0,0 +1,66 @@
+#!/bin/sh
+#
+# Run a workload with the glibc allocator and with libgranmalloc.so and
+# compare wall time and peak RSS.
+#
+# Usage: ./granmalloc_compare.sh [command [args...]]
+#        ./granmalloc_compare.sh --build
+#
+# Without a command, the allocator sources are compiled with gcc.  The
+# library is built from every mm_gran*.c in this directory if it is
+# missing; --build (re)builds it and exits.  RUNS sets the number of runs
+# per allocator (default 3).  LIB overrides the path of the library.
+#
+
+set -e
+
+cd "$(dirname "$0")"
+
+LIB=${LIB:-$PWD/libgranmalloc.so}
+RUNS=${RUNS:-3}
+
+# The library is the interposer plus the whole allocator, so this glob is
+# the only list of its sources.
+
+if [ ! -f "$LIB" ] || [ "$1" = --build ]; then
+  gcc -shared -fPIC -O2 -fno-builtin -pthread -Wl,--no-undefined \
+      mm_gran*.c -o "$LIB"
+fi
+
+if [ "$1" = --build ]; then
+  exit 0
+fi
+
+if [ $# -eq 0 ]; then
+  set -- sh -c 'for f in mm_gran*.c; do gcc -O2 -c "$f" -o /dev/null; done'
+fi
+
+# Print "<wall seconds> <peak RSS KiB>" for one run of the command.  The
+# first argument is the library to preload into the command, or "" for
+# none.  The peak RSS is the largest of all processes the command ran.
+
+measure()
+{
+  python3 - "$@" <<'PY'
+import os, resource, subprocess, sys, time
+env = dict(os.environ)
+if sys.argv[1]:
+    env["LD_PRELOAD"] = sys.argv[1]
+t0 = time.monotonic()
+rc = subprocess.call(sys.argv[2:], stdout=subprocess.DEVNULL, env=env)
+t1 = time.monotonic()
+if rc != 0:
+    sys.exit("command failed with status %d" % rc)
+rss = resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss
+print("%.3f %d" % (t1 - t0, rss))
+PY
+}
+
+printf '%-8s %4s %10s %12s\n' allocator run wall_s maxrss_kib
+
+i=1
+while [ $i -le "$RUNS" ]; do
+  printf '%-8s %4d %10s %12s\n' glibc $i $(measure "" "$@")
+  printf '%-8s %4d %10s %12s\n' gran $i $(measure "$LIB" "$@")
+  i=$((i + 1))
+done
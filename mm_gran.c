@@ -3,6 +3,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "gran.h"
 #include "mm_gran.h"
@@ -74,6 +77,7 @@ struct mm_gran *gran_initialize(void *heapstart, size_t heapsize, uint8_t log2gr
     unsigned long      mask;
     unsigned long      alignedsize;
     unsigned int       ngranules;
+    unsigned int       gatidx;
 
     /* 
      * Check parameters if debug is on.  Note the size of a granule is
@@ -122,11 +126,69 @@ struct mm_gran *gran_initialize(void *heapstart, size_t heapsize, uint8_t log2gr
         gran->log2gran  = log2gran;
         gran->ngranules = ngranules;
         gran->heapstart = alignedstart;
+        gran->refcnt    = NULL;
+        gran->resv      = NULL;
+        gran->epochmap  = NULL;
+        gran->epoch     = 0;
+        gran->waitseq   = 0;
+        gran->nwaiters  = 0;
+        gran->minwait   = UINT32_MAX;
+        gran->shrinkers = NULL;
+        gran->shrinkseq = 0;
+        gran->wmark     = NULL;
+        gran->movables  = NULL;
+        gran->remap     = 0;
+        gran->shortend  = 0;
+        gran->longstart = ngranules;
+        gran->pinlow    = ngranules;
+        gran->pinmap    = NULL;
+        gran->color     = 0;
+        gran->uffd      = NULL;
+        gran->zones     = NULL;
+        memset(gran->hintinfo, 0, sizeof(gran->hintinfo));
+        gran->memfd     = -1;
+        gran->mapsize   = 0;
+        pthread_mutex_init(&gran->exclsem, NULL);
+        pthread_mutex_init(&gran->shrinklock, NULL);
+        pthread_mutex_init(&gran->shrinkrun, NULL);
+
+        /* All granules start out free */
+        gran->gatrun    = (uint8_t *)&gran->gat[SIZEOF_GAT(ngranules)];
+        memset(gran->gat, 0, SIZEOF_GAT(ngranules) * sizeof(uint32_t));
+
+        for (gatidx = 0; gatidx < SIZEOF_GAT(ngranules); gatidx++)
+        {
+            gran_update_run(gran, gatidx);
+        }
     }
 
     return gran;
 }
 
+/****************************************************************************
+ * Name: gran_heapstart and gran_log2gran
+ *
+ * Description:
+ *   Return the start of the granule area of a heap and the log base 2 of
+ *   its granule size.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ ****************************************************************************/
+
+void *gran_heapstart(struct mm_gran *gran)
+{
+    assert(gran != NULL);
+    return (void *)gran->heapstart;
+}
+
+uint8_t gran_log2gran(struct mm_gran *gran)
+{
+    assert(gran != NULL);
+    return GRAN_LOG2GRAN(gran);
+}
+
 /****************************************************************************
  * Name: gran_release
  *
@@ -146,7 +208,41 @@ void gran_release(struct mm_gran *gran)
 {
     assert(gran != NULL);
 
-    free(gran);
+    pthread_mutex_destroy(&gran->exclsem);
+    pthread_mutex_destroy(&gran->shrinklock);
+    pthread_mutex_destroy(&gran->shrinkrun);
+    free(gran->refcnt);
+    free(gran->resv);
+    free(gran->epochmap);
+    free(gran->pinmap);
+    free(gran->wmark);
+
+    /* The other zones of a mixed granularity heap */
+    if (gran->zones != NULL)
+    {
+        gran_zone_release(gran);
+    }
+
+    /* A memfd heap owns its mapping and file */
+    if (gran->memfd >= 0)
+    {
+        int fd = gran->memfd;
+
+        munmap(gran, gran->mapsize);
+        close(fd);
+        return;
+    }
+
+    /* A userfaultfd heap owns its mapping and fault handler */
+    if (gran->uffd != NULL)
+    {
+        gran_uffd_release(gran);
+        return;
+    }
+
+    /* Otherwise the state structure lives at the start of the caller's
+     * heap and is not freed here.
+     */
 }
 
 #endif /* CONFIG_GRAN */
@@ -27,30 +27,163 @@
 
 #include "config.h"
 
+#include <pthread.h>
 #include <stdint.h>
 
+#include "gran.h"
+
 /****************************************************************************
  * Pre-processor Definitions
  ****************************************************************************/
 
+/* Granule geometry of a heap.  Heaps with a compile time granule size are
+ * provided by the gran_heap template of gran.hxx.
+ */
+
+#define GRAN_LOG2GRAN(g)      ((g)->log2gran)
+
+#define GRAN_SIZE(g)          ((size_t)1 << GRAN_LOG2GRAN(g))
+#define GRAN_MASK(g)          (GRAN_SIZE(g) - 1)
+#define GRAN_NGRANULES(g, s)  (((s) + GRAN_MASK(g)) >> GRAN_LOG2GRAN(g))
+
+/* Largest request in granules that a zone of a mixed granularity heap is
+ * asked for first, see gran_initialize_zoned()
+ */
+
+#ifndef CONFIG_GRAN_ZONE_NGRANULES
+#  define CONFIG_GRAN_ZONE_NGRANULES 8
+#endif
+
+/* Number of epoch tag bitmaps, see gran_epoch_initialize() */
+
+#ifndef CONFIG_GRAN_NEPOCHS
+#  define CONFIG_GRAN_NEPOCHS 4
+#endif
+
 /* Sizes of things */
 
 #define SIZEOF_GAT(n) \
   ((n + 31) >> 5)
 #define SIZEOF_MM_GRAN(n) \
-  (sizeof(struct mm_gran) + sizeof(uint32_t) * (SIZEOF_GAT(n) - 1))
+  (sizeof(struct mm_gran) + sizeof(uint32_t) * (SIZEOF_GAT(n) - 1) + \
+   SIZEOF_GAT(n))
+
+/* Per GAT entry free run summary.  One byte is kept for each 32-bit GAT
+ * entry:  The low 6 bits hold the longest run of free granules anywhere in
+ * the entry (0..32) and the two high bits tell whether the LS and MS
+ * granules of the entry are free.  The leading/trailing free counts can
+ * never exceed the longest run, so the flags are enough to bound them.
+ */
+
+#define GRAN_RUN_MXFREE_MASK  0x3f /* Longest run of free granules */
+#define GRAN_RUN_LSFREE       0x40 /* LS granule of the entry is free */
+#define GRAN_RUN_MSFREE       0x80 /* MS granule of the entry is free */
+
+#define GRAN_RUN_MXFREE(r)    ((r) & GRAN_RUN_MXFREE_MASK)
+#define GRAN_RUN_NLSFREE(r)   (((r) & GRAN_RUN_LSFREE) ? GRAN_RUN_MXFREE(r) : 0)
+#define GRAN_RUN_NMSFREE(r)   (((r) & GRAN_RUN_MSFREE) ? GRAN_RUN_MXFREE(r) : 0)
 
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+/* Incrementally maintained free counters for watermark notifications.
+ * span[] holds, per GAT entry, the longest free run (up to 32 granules)
+ * that lies in the entry or starts in it and continues into the next one;
+ * runcnt[]/runmask keep a histogram of those values so that the largest
+ * is found without a rescan.
+ */
+
+struct gran_wmark
+{
+    struct gran_watermarks cfg; /* Watermarks and notification target */
+    uint32_t   nfree;      /* Number of free granules */
+    uint32_t   runcnt[33]; /* Number of GAT entries per span value */
+    uint64_t   runmask;    /* Bit n is set when runcnt[n] is non-zero */
+    unsigned int state;    /* GRAN_WMARK_* conditions currently asserted */
+    uint8_t   *nfreew;     /* Free granules per GAT entry */
+    uint8_t   *span;       /* Longest free run per GAT entry, see above */
+};
+
+/* A set of per-node granule heaps (see gran_numa_initialize()).  All
+ * sub-heaps lie in one reservation, nodesize bytes each, so the node of
+ * an address is found by division.  The interleaved heap, if any, comes
+ * after the last node.
+ */
+
+struct gran_numa_node
+{
+    struct mm_gran *gran;      /* The sub-heap bound to this node */
+    uint32_t   nlocal;         /* Allocations served from this node */
+    uint32_t   nremote;        /* Allocations of this node served remotely */
+};
+
+struct gran_numa
+{
+    uintptr_t  base;           /* Start of the reservation */
+    size_t     nodesize;       /* Size of each sub-heap */
+    size_t     mapsize;        /* Size of the reservation */
+    unsigned int nnodes;       /* Number of nodes */
+    unsigned int flags;        /* GRAN_NUMA_* flags */
+    struct mm_gran *interleave; /* Interleaved sub-heap, NULL if none */
+    struct gran_numa_node node[1]; /* Per node state */
+};
+
+/* The zones of a mixed granularity heap other than the first one, which
+ * is the heap handle itself.  Zones are ordered by increasing granule size.
+ */
+
+struct gran_zones
+{
+    unsigned int nzones;       /* Number of entries in zone[] */
+    struct mm_gran *zone[1];   /* The zone heaps */
+};
+
+/* A notification collected under the critical section and delivered
+ * after it is left.
+ */
+
+struct gran_wmark_event
+{
+    void     (*notify)(struct mm_gran *gran, unsigned int state, void *arg);
+    void      *arg;
+    int        eventfd;
+    unsigned int state;
+};
+
 /* This structure represents the state of one granule allocation */
 
 struct mm_gran
 {
     uint8_t    log2gran;  /* Log base 2 of the size of one granule */
     uint32_t   ngranules; /* The total number of (aligned) granules in the heap */
+    pthread_mutex_t exclsem; /* For exclusive access to the GAT */
     uintptr_t  heapstart; /* The aligned start of the granule heap */
+    uint8_t   *gatrun;    /* Free run summary, one byte per GAT entry */
+    uint32_t  *refcnt;    /* Buffer reference counts, NULL if not enabled */
+    uint32_t  *resv;      /* Reserved granules (GAT layout), NULL if none */
+    uint32_t  *epochmap;  /* Epoch tag bitmaps, NULL if not enabled */
+    uint8_t    epoch;     /* Epoch that new allocations are tagged with */
+    uint32_t   waitseq;   /* Futex word of gran_alloc_wait() */
+    uint32_t   nwaiters;  /* Number of callers in gran_alloc_wait() */
+    uint32_t   minwait;   /* Smallest waiting request in granules */
+    pthread_mutex_t shrinklock; /* Protects the shrinker list */
+    pthread_mutex_t shrinkrun;  /* Serializes shrink passes */
+    uint32_t   shrinkseq; /* Number of the last shrink pass */
+    struct gran_shrinker *shrinkers; /* Shrinkers by priority, NULL if none */
+    struct gran_wmark *wmark; /* Watermark state, NULL if not enabled */
+    struct gran_movable *movables; /* Movable allocations, NULL if none */
+    uint8_t    remap;     /* gran_compact() moves pages with mremap() */
+    uint32_t   shortend;  /* End of the GRAN_HINT_SHORT region */
+    uint32_t   longstart; /* Start of the GRAN_HINT_LONG region */
+    uint32_t   pinlow;    /* Lowest granule of a GRAN_HINT_PINNED allocation */
+    uint32_t  *pinmap;    /* Pinned granules (GAT layout), NULL if none */
+    uint32_t   color;     /* Next cache color of gran_alloc_colored() */
+    struct gran_uffd *uffd; /* userfaultfd backend, NULL if not used */
+    struct gran_zones *zones; /* Zones with larger granules, NULL if none */
+    struct gran_hintinfo hintinfo[GRAN_HINT_NCLASSES]; /* Per class statistics */
+    int        memfd;     /* Backing file of a memfd heap, else -1 */
+    size_t     mapsize;   /* Size of the memfd mapping */
     uint32_t   gat[1];    /* Start of the granule allocation table */
 };
 
@@ -69,8 +202,53 @@ struct mm_gran
  *
  * Returned Value:
  *   gran_enter_critical() may return any error reported by
- *   nxsem_wait_uninterruptible()
- *mm_gran/_s *priv);
+ *   pthread_mutex_lock()
+ *
+ ****************************************************************************/
+
+int gran_enter_critical(struct mm_gran *priv);
+void gran_leave_critical(struct mm_gran *priv);
+
+/****************************************************************************
+ * Name: gran_alloc_local
+ *
+ * Description:
+ *   Allocate memory like gran_alloc(), but only from the GAT of this heap.
+ *   The other zones of a mixed granularity heap are never used, so the
+ *   result can be passed to gran_clear_allocated() and indexes the side
+ *   tables of the heap.  Interfaces built on top of the GAT use this
+ *   instead of gran_alloc().
+ *
+ * Input Parameters:
+ *   priv - The granule heap state structure.
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   The allocated memory or NULL on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_local(struct mm_gran *priv, size_t size);
+
+/****************************************************************************
+ * Name: gran_alloc_owned
+ *
+ * Description:
+ *   Allocate memory like gran_alloc_local(), but without an epoch tag.
+ *   Memory that is owned by a heap interface (arena extents, rings,
+ *   reference counted buffers, vectors) is allocated this way so that
+ *   gran_epoch_release() cannot free it behind the back of its owner.
+ *
+ * Input Parameters:
+ *   priv - The granule heap state structure.
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   The allocated memory or NULL on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_owned(struct mm_gran *priv, size_t size);
 
 /****************************************************************************
  * Name: gran_mark_allocated
@@ -90,4 +268,299 @@ struct mm_gran
 
 void gran_mark_allocated(struct mm_gran *priv, uintptr_t alloc, unsigned int ngranules);
 
+/****************************************************************************
+ * Name: gran_mark_epoch
+ *
+ * Description:
+ *   Mark a range of granules as allocated like gran_mark_allocated(), but
+ *   tag them with the given epoch instead of the current one.
+ *
+ * Input Parameters:
+ *   priv  - The granule heap state structure.
+ *   alloc - The address of the allocation.
+ *   ngranules - The number of granules allocated
+ *   epoch - The epoch to tag the granules with, or -1 for none
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_mark_epoch(struct mm_gran *priv, uintptr_t alloc, unsigned int ngranules,
+                     int epoch);
+
+/****************************************************************************
+ * Name: gran_clear_allocated
+ *
+ * Description:
+ *   Mark a range of granules as free.  The caller must hold the critical
+ *   section.
+ *
+ * Input Parameters:
+ *   priv  - The granule heap state structure.
+ *   alloc - The address of the allocation.
+ *   ngranules - The number of granules to free
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_clear_allocated(struct mm_gran *priv, uintptr_t alloc, unsigned int ngranules);
+
+/****************************************************************************
+ * Name: gran_update_run
+ *
+ * Description:
+ *   Recompute the free run summary of one GAT entry.  This must be called
+ *   whenever the GAT entry is modified.
+ *
+ * Input Parameters:
+ *   priv   - The granule heap state structure.
+ *   gatidx - The index of the modified GAT entry
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_update_run(struct mm_gran *priv, unsigned int gatidx);
+
+/****************************************************************************
+ * Name: gran_epoch_mark and gran_epoch_clear
+ *
+ * Description:
+ *   Keep the epoch tag bitmaps in step with the GAT.  gran_epoch_mark()
+ *   tags granules with an epoch; gran_epoch_clear() removes them from
+ *   whichever epoch they belong to.  Only called when epoch tagging is
+ *   enabled.  The caller must hold the critical section.
+ *
+ * Input Parameters:
+ *   priv    - The granule heap state structure.
+ *   epoch   - The epoch to tag the granules with
+ *   gatidx  - The index of the GAT entry
+ *   gatmask - The granules of that entry
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_epoch_mark(struct mm_gran *priv, int epoch, unsigned int gatidx,
+                     uint32_t gatmask);
+void gran_epoch_clear(struct mm_gran *priv, unsigned int gatidx, uint32_t gatmask);
+
+/****************************************************************************
+ * Name: gran_epoch_of
+ *
+ * Description:
+ *   Return the epoch that a granule is tagged with.  The caller must hold
+ *   the critical section.
+ *
+ * Input Parameters:
+ *   priv   - The granule heap state structure.
+ *   granno - The granule number
+ *
+ * Returned Value:
+ *   The epoch of the granule, or -1 if epochs are not enabled or the
+ *   granule is not tagged.
+ *
+ ****************************************************************************/
+
+int gran_epoch_of(struct mm_gran *priv, unsigned int granno);
+
+/****************************************************************************
+ * Name: gran_wait_notify and gran_wait_wake
+ *
+ * Description:
+ *   Wake callers blocked in gran_alloc_wait().  gran_wait_notify() is
+ *   called after granules in gatidx..gatidx+nentries-1 were freed and only
+ *   wakes if the resulting free run may hold the smallest waiting request;
+ *   gran_wait_wake() always wakes.  The caller must hold the critical
+ *   section.
+ *
+ * Input Parameters:
+ *   priv     - The granule heap state structure.
+ *   gatidx   - The first GAT entry that was modified
+ *   nentries - The number of modified GAT entries
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_wait_notify(struct mm_gran *priv, unsigned int gatidx, unsigned int nentries);
+void gran_wait_wake(struct mm_gran *priv);
+
+/****************************************************************************
+ * Name: gran_shrink_alloc
+ *
+ * Description:
+ *   Called by gran_alloc() when the search failed.  The shrinkers of the
+ *   heap are called in order of priority and the allocation is retried
+ *   after each one that freed memory.  The caller must not hold the
+ *   critical section.
+ *
+ * Input Parameters:
+ *   priv  - The granule heap state structure.
+ *   size  - The size of the memory region to allocate.
+ *   alloc - The allocator to retry with, gran_alloc() or
+ *           gran_alloc_local()
+ *
+ * Returned Value:
+ *   The allocated memory or NULL if the shrinkers could not free enough.
+ *
+ ****************************************************************************/
+
+void *gran_shrink_alloc(struct mm_gran *priv, size_t size,
+                        void *(*alloc)(struct mm_gran *priv, size_t size));
+
+/****************************************************************************
+ * Name: gran_wmark_update
+ *
+ * Description:
+ *   Update the watermark counters after a GAT entry was modified.  Called
+ *   by gran_update_run() when watermarks are enabled.
+ *
+ * Input Parameters:
+ *   priv   - The granule heap state structure.
+ *   gatidx - The index of the modified GAT entry
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_wmark_update(struct mm_gran *priv, unsigned int gatidx);
+
+/****************************************************************************
+ * Name: gran_wmark_check and gran_wmark_notify
+ *
+ * Description:
+ *   gran_wmark_check() compares the counters with the watermarks and
+ *   records which conditions changed.  It is called with the critical
+ *   section held, right before it is left.  If it returns true, the event
+ *   is passed to gran_wmark_notify() after the critical section is left.
+ *
+ * Input Parameters:
+ *   priv  - The granule heap state structure.
+ *   event - The notification to deliver
+ *
+ * Returned Value:
+ *   gran_wmark_check() returns true if a watermark was crossed.
+ *
+ ****************************************************************************/
+
+int gran_wmark_check(struct mm_gran *priv, struct gran_wmark_event *event);
+void gran_wmark_notify(struct mm_gran *priv, const struct gran_wmark_event *event);
+
+/****************************************************************************
+ * Name: gran_uffd_release
+ *
+ * Description:
+ *   Stop the fault handler of a userfaultfd backed heap and unmap the
+ *   heap.  Called by gran_release() as its last step.
+ *
+ * Input Parameters:
+ *   priv - The granule heap state structure.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_uffd_release(struct mm_gran *priv);
+
+/****************************************************************************
+ * Name: gran_zone_at and gran_zone_class
+ *
+ * Description:
+ *   Zones of a mixed granularity heap are numbered by granule size, from
+ *   0 for the heap itself to zones->nzones.  gran_zone_at() returns zone
+ *   k; gran_zone_class() returns the zone a request is served from first:
+ *   the smallest one in which it needs at most CONFIG_GRAN_ZONE_NGRANULES
+ *   granules, or the last one.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_zone_at(struct mm_gran *priv, unsigned int k);
+unsigned int gran_zone_class(struct mm_gran *priv, size_t size);
+
+/****************************************************************************
+ * Name: gran_zone_free, gran_zone_info, gran_zone_reset and
+ *       gran_zone_release
+ *
+ * Description:
+ *   Route a free, a gran_info() request, a reset or a release of a mixed
+ *   granularity heap to its other zones.  gran_zone_free() returns false
+ *   if the address is not in any zone.  gran_zone_info() adds the other
+ *   zones to the statistics of the first.
+ *
+ ****************************************************************************/
+
+int gran_zone_free(struct mm_gran *priv, void *memory, size_t size);
+void gran_zone_info(struct mm_gran *priv, struct graninfo *info);
+void gran_zone_reset(struct mm_gran *priv);
+void gran_zone_release(struct mm_gran *priv);
+
+/****************************************************************************
+ * Name: gran_zone_of and gran_zone_end
+ *
+ * Description:
+ *   gran_zone_of() returns the zone of a mixed granularity heap that
+ *   contains an address, or the heap itself if no other zone does.
+ *   gran_zone_end() returns the end of the granules of the last zone.
+ *   Both work on any heap.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_zone_of(struct mm_gran *priv, const void *memory);
+uintptr_t gran_zone_end(struct mm_gran *priv);
+
+/****************************************************************************
+ * Name: gran_movable_drop
+ *
+ * Description:
+ *   Remove movable allocations from the list of the heap after their
+ *   granules were freed in bulk, and set their mem to NULL.  The caller
+ *   must hold the critical section.
+ *
+ * Input Parameters:
+ *   priv - The granule heap state structure.
+ *   map  - Granules that were freed (GAT layout), or NULL for all
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_movable_drop(struct mm_gran *priv, const uint32_t *map);
+
+/****************************************************************************
+ * Name: gran_range_search
+ *
+ * Description:
+ *   Find the first run of free granules inside [firstgran, endgran) that
+ *   does not cross a multiple of 'boundary'.  GAT entries are skipped using
+ *   their free run summaries; inside a candidate entry the free positions
+ *   are visited with a 64-bit window over the entry and its successor.
+ *   The caller must hold the critical section.
+ *
+ * Input Parameters:
+ *   priv      - The granule heap state structure.
+ *   ngranules - The number of granules needed (1..32)
+ *   firstgran - The first granule that may be used
+ *   endgran   - One past the last granule that may be used
+ *   boundary  - Address boundary the run may not cross (power of two, not
+ *               smaller than a granule), or zero for none
+ *
+ * Returned Value:
+ *   The granule number of the run, or -1 if there is none.
+ *
+ ****************************************************************************/
+
+int gran_range_search(struct mm_gran *priv, unsigned int ngranules,
+                      unsigned int firstgran, unsigned int endgran,
+                      size_t boundary);
+
 #endif /* __MM_MM_GRAN_MM_GRAN_H */
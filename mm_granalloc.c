@@ -34,71 +34,75 @@
 #ifdef CONFIG_GRAN
 
 /****************************************************************************
- * Public Functions
+ * Private Functions
  ****************************************************************************/
 
 /****************************************************************************
- * Name: gran_alloc
+ * Name: gran_search
  *
  * Description:
- *   Allocate memory from the granule heap.
- *
- *   NOTE: The current implementation also restricts the maximum allocation
- *   size to 32 granules.  That restriction could be eliminated with some
- *   additional coding effort.
- *
- * Input Parameters:
- *   handle - The handle previously returned by gran_initialize
- *   size   - The size of the memory region to allocate.
- *
- * Returned Value:
- *   On success, a non-NULL pointer to the allocated memory is returned;
- *   NULL is returned on failure.
+ *   Search the GAT of one heap for a free run and claim it, tagged with
+ *   the given epoch (-1 for none).  Neither the other zones nor the
+ *   shrinkers are consulted.
  *
  ****************************************************************************/
 
-void *gran_alloc(struct mm_gran *gran, size_t size)
+static void *gran_search(struct mm_gran *gran, size_t size, int epoch)
 {
     unsigned int ngranules;
-    size_t       tmpmask;
     uintptr_t    alloc;
     uint32_t     curr;
     uint32_t     next;
     uint32_t     mask;
+    uint8_t      run;
+    uint8_t      nextrun;
     int          granidx;
     int          gatidx;
     int          bitidx;
     int          shift;
     int          ret;
 
-    assert(gran != NULL && size <= 32 * (1 << gran->log2gran));
-
-    if (gran != NULL && size > 0)
+    if (size > 0)
     {
         /* How many contiguous granules we we need to find? */
-        tmpmask   = (1 << gran->log2gran) - 1;
-        ngranules = (size + tmpmask) >> gran->log2gran;
+        ngranules = GRAN_NGRANULES(gran, size);
 
         /* Then create mask for that number of granules */
         assert(ngranules <= 32);
         mask = 0xffffffff >> (32 - ngranules);
 
+        ret = gran_enter_critical(gran);
+        if (ret < 0)
+        {
+            return NULL;
+        }
+
         /* Now search the granule allocation table for that number of contiguous */
         for (granidx = 0; granidx < gran->ngranules; granidx += 32)
         {
-            
             /* Get the GAT index associated with the granule table entry */
             gatidx = granidx >> 5;
-            curr = gran->gat[gatidx];
 
-            /* Handle the case where there are no free granules in the entry */
-            if (curr == 0xffffffff)
+            /*
+             * Consult the free run summaries first so that the GAT itself
+             * is only touched for real candidates.  The allocation either
+             * fits inside this entry or it is made of the free MS granules
+             * of this entry plus the free LS granules of the next one.
+             */
+            run = gran->gatrun[gatidx];
+            if (GRAN_RUN_MXFREE(run) < ngranules)
             {
-                continue;
+                nextrun = ((uint32_t)granidx + 32 < gran->ngranules) ? gran->gatrun[gatidx + 1] : 0;
+                if ((unsigned int)(GRAN_RUN_NMSFREE(run) + GRAN_RUN_NLSFREE(nextrun)) < ngranules)
+                {
+                    continue;
+                }
             }
 
+            curr = gran->gat[gatidx];
+
             /* Get the next entry from the GAT to support a 64 bit shift */
-            if (granidx < gran->ngranules)
+            if (granidx + 32 < gran->ngranules)
             {
                 next = gran->gat[gatidx + 1];
             }
@@ -118,7 +122,7 @@ void *gran_alloc(struct mm_gran *gran, size_t size)
              * examined (bitidx >= 32), or until there are insufficient
              * granules left to satisfy the allocation.
              */
-            alloc = gran->heapstart + (granidx << gran->log2gran);
+            alloc = gran->heapstart + (granidx << GRAN_LOG2GRAN(gran));
 
             for (bitidx = 0; bitidx < 32 && (granidx + bitidx + ngranules) <= gran->ngranules; )
             {
@@ -187,9 +191,10 @@ void *gran_alloc(struct mm_gran *gran, size_t size)
                 else if ((curr & mask) == 0)
                 {
                     /* Yes.. mark these granules allocated */
-                    gran_mark_allocated(gran, alloc, ngranules);
+                    gran_mark_epoch(gran, alloc, ngranules, epoch);
 
                     /* And return the allocation address */
+                    gran_leave_critical(gran);
                     return (void *)alloc;
                 }
                 /* The free allocation does not start at this position */
@@ -203,18 +208,166 @@ void *gran_alloc(struct mm_gran *gran, size_t size)
                  * bit shift to move to the next gran position and increment
                  * to the next candidate allocation address.
                  */
-                alloc  += (shift << gran->log2gran);
+                alloc  += (shift << GRAN_LOG2GRAN(gran));
                 curr    = (curr >> shift) | (next << (32 - shift));
                 next  >>= shift;
                 bitidx += shift;
             }
         }
+
+        gran_leave_critical(gran);
     }
 
     return NULL;
 }
 
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc
+ *
+ * Description:
+ *   Allocate memory from the granule heap.
+ *
+ *   NOTE: The current implementation also restricts the maximum allocation
+ *   size to 32 granules.  That restriction could be eliminated with some
+ *   additional coding effort.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc(struct mm_gran *gran, size_t size)
+{
+    struct mm_gran *zone;
+    void           *memory = NULL;
+    unsigned int    nzones;
+    unsigned int    home;
+    unsigned int    i;
+    unsigned int    k;
+
+    assert(gran != NULL);
+
+    if (gran->zones == NULL)
+    {
+        return gran_alloc_local(gran, size);
+    }
+
+    /* Start in the zone of the size class of the request.  When that zone
+     * is full, move on to the zones with larger granules and then to the
+     * smaller ones that can still hold the request.
+     */
+    nzones = gran->zones->nzones + 1;
+    home   = gran_zone_class(gran, size);
+
+    for (i = 0; i < nzones && memory == NULL && size > 0; i++)
+    {
+        k    = home + i < nzones ? home + i : nzones - 1 - i;
+        zone = gran_zone_at(gran, k);
+        if (size > 32 * GRAN_SIZE(zone))
+        {
+            continue;
+        }
+
+        memory = k == 0 ? gran_search(gran, size, gran->epoch) : gran_alloc(zone, size);
+    }
+
+    /* Let the registered shrinkers free memory and search again */
+    if (memory == NULL && size > 0 && gran->shrinkers != NULL)
+    {
+        memory = gran_shrink_alloc(gran, size, gran_alloc);
+    }
+
+    return memory;
+}
+
+/****************************************************************************
+ * Name: gran_alloc_local
+ *
+ * Description:
+ *   Allocate from the GAT of this heap only, never from the other zones of
+ *   a mixed granularity heap.  Used by the interfaces that keep per
+ *   granule state of the heap.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_local(struct mm_gran *gran, size_t size)
+{
+    void *memory;
+
+    assert(gran != NULL && size <= 32 * GRAN_SIZE(gran));
+
+    memory = gran_search(gran, size, gran->epoch);
+
+    /* Let the registered shrinkers free memory and search again */
+    if (memory == NULL && size > 0 && gran->shrinkers != NULL)
+    {
+        memory = gran_shrink_alloc(gran, size, gran_alloc_local);
+    }
+
+    return memory;
+}
+
+/****************************************************************************
+ * Name: gran_alloc_owned
+ *
+ * Description:
+ *   Allocate like gran_alloc_local(), but never tag the memory with an
+ *   epoch.  Used for memory that belongs to a heap interface (the extents
+ *   of an arena, a ring, a buffer or a vector) and must only be freed by
+ *   its owner, never by gran_epoch_release().
+ *
+ ****************************************************************************/
+
+void *gran_alloc_owned(struct mm_gran *gran, size_t size)
+{
+    void *memory;
+
+    assert(gran != NULL && size <= 32 * GRAN_SIZE(gran));
+
+    memory = gran_search(gran, size, -1);
+
+    /* Let the registered shrinkers free memory and search again */
+    if (memory == NULL && size > 0 && gran->shrinkers != NULL)
+    {
+        memory = gran_shrink_alloc(gran, size, gran_alloc_owned);
+    }
+
+    return memory;
+}
+
+/****************************************************************************
+ * Name: gran_mark_allocated
+ *
+ * Description:
+ *   Mark a range of granules as allocated and tag them with the current
+ *   epoch.
+ *
+ ****************************************************************************/
+
 void gran_mark_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngranules)
+{
+    gran_mark_epoch(gran, alloc, ngranules, gran->epoch);
+}
+
+/****************************************************************************
+ * Name: gran_mark_epoch
+ *
+ * Description:
+ *   Mark a range of granules as allocated and tag them with an epoch.
+ *
+ ****************************************************************************/
+
+void gran_mark_epoch(struct mm_gran *gran, uintptr_t alloc, unsigned int ngranules,
+                     int epoch)
 {
     unsigned int granno;
     unsigned int gatidx;
@@ -223,7 +376,7 @@ void gran_mark_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngr
     uint32_t     gatmask;
 
     /* Determine the granule number of the allocation */
-    granno = (alloc - gran->heapstart) >> gran->log2gran;
+    granno = (alloc - gran->heapstart) >> GRAN_LOG2GRAN(gran);
 
     /* Determine the GAT table index associated with the allocation */
     gatidx = granno >> 5;
@@ -238,6 +391,12 @@ void gran_mark_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngr
         assert((gran->gat[gatidx] & gatmask) == 0);
 
         gran->gat[gatidx] |= gatmask;
+        gran_update_run(gran, gatidx);
+        if (gran->epochmap != NULL && epoch >= 0)
+        {
+            gran_epoch_mark(gran, epoch, gatidx, gatmask);
+        }
+
         ngranules -= avail;
 
         /* Mark bits in the second GAT entry */
@@ -245,6 +404,11 @@ void gran_mark_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngr
         assert((gran->gat[gatidx + 1] & gatmask) == 0);
 
         gran->gat[gatidx + 1] |= gatmask;
+        gran_update_run(gran, gatidx + 1);
+        if (gran->epochmap != NULL && epoch >= 0)
+        {
+            gran_epoch_mark(gran, epoch, gatidx + 1, gatmask);
+        }
     }
 
     /* Handle the case where where all of the granules come from one entry */
@@ -256,6 +420,12 @@ void gran_mark_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngr
         assert((gran->gat[gatidx] & gatmask) == 0);
 
         gran->gat[gatidx] |= gatmask;
+        gran_update_run(gran, gatidx);
+        if (gran->epochmap != NULL && epoch >= 0)
+        {
+            gran_epoch_mark(gran, epoch, gatidx, gatmask);
+        }
+
         return;
     }
 }
@@ -0,0 +1,262 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granarena.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Alignment of the memory returned by gran_arena_alloc() */
+
+#define GRAN_ARENA_ALIGN      sizeof(max_align_t)
+#define GRAN_ARENA_ROUNDUP(n) (((n) + GRAN_ARENA_ALIGN - 1) & ~(GRAN_ARENA_ALIGN - 1))
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Every extent of an arena starts with this header, which links it into
+ * the list of extents to return at gran_arena_end().
+ */
+
+struct gran_arena_extent
+{
+    struct gran_arena_extent *next;      /* The previously claimed extent */
+    unsigned int              ngranules; /* Size of this extent */
+};
+
+#define GRAN_ARENA_HDRSIZE    GRAN_ARENA_ROUNDUP(sizeof(struct gran_arena_extent))
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_arena_slack
+ *
+ * Description:
+ *   Return how many bytes the first allocation of an extent may have to
+ *   be moved up to reach GRAN_ARENA_ALIGN, beyond GRAN_ARENA_HDRSIZE.
+ *   Granules are only aligned to the smaller of the granule size and the
+ *   alignment of the heap start, which may be less than GRAN_ARENA_ALIGN.
+ *
+ ****************************************************************************/
+
+static size_t gran_arena_slack(struct mm_gran *gran)
+{
+    uintptr_t align = gran->heapstart & -gran->heapstart;
+
+    if (align > GRAN_SIZE(gran))
+    {
+        align = GRAN_SIZE(gran);
+    }
+
+    return align < GRAN_ARENA_ALIGN ? GRAN_ARENA_ALIGN - align : 0;
+}
+
+/****************************************************************************
+ * Name: gran_arena_refill
+ *
+ * Description:
+ *   Claim a new extent that can hold at least size bytes.  A full chunk of
+ *   32 granules is tried first; on a fragmented heap the arena settles for
+ *   an extent that just fits the request.  The first allocation starts at
+ *   the first GRAN_ARENA_ALIGN boundary after the header.
+ *
+ ****************************************************************************/
+
+static int gran_arena_refill(struct gran_arena *arena, size_t size)
+{
+    struct gran_arena_extent *extent;
+    struct mm_gran           *gran = arena->gran;
+    unsigned int              ngranules;
+
+    ngranules = GRAN_NGRANULES(gran, GRAN_ARENA_HDRSIZE + gran_arena_slack(gran) + size);
+    if (ngranules > 32)
+    {
+        return -ENOMEM;
+    }
+
+    extent = gran_alloc_owned(gran, (size_t)32 << GRAN_LOG2GRAN(gran));
+    if (extent != NULL)
+    {
+        ngranules = 32;
+    }
+    else
+    {
+        extent = gran_alloc_owned(gran, (size_t)ngranules << GRAN_LOG2GRAN(gran));
+        if (extent == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    extent->next      = arena->extents;
+    extent->ngranules = ngranules;
+
+    arena->extents = extent;
+    arena->next    = GRAN_ARENA_ROUNDUP((uintptr_t)extent + sizeof(struct gran_arena_extent));
+    arena->end     = (uintptr_t)extent + ((uintptr_t)ngranules << GRAN_LOG2GRAN(gran));
+    return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_arena_begin
+ *
+ * Description:
+ *   Start an empty scratch arena on a granule heap.  No memory is claimed
+ *   until the first allocation.
+ *
+ * Input Parameters:
+ *   arena  - The arena to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_arena_begin(struct gran_arena *arena, struct mm_gran *gran)
+{
+    assert(arena != NULL && gran != NULL);
+
+    arena->gran    = gran;
+    arena->extents = NULL;
+    arena->next    = 0;
+    arena->end     = 0;
+}
+
+/****************************************************************************
+ * Name: gran_arena_alloc
+ *
+ * Description:
+ *   Allocate scratch memory from an arena by advancing a pointer.  The
+ *   memory is not freed individually; it is returned by gran_arena_end().
+ *
+ * Input Parameters:
+ *   arena - The arena
+ *   size  - The size of the memory to allocate.  At most 32 granules less
+ *           the extent header fit in one extent.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer aligned to max_align_t is returned;
+ *   NULL is returned on failure or if size is zero.
+ *
+ ****************************************************************************/
+
+void *gran_arena_alloc(struct gran_arena *arena, size_t size)
+{
+    uintptr_t alloc;
+
+    /* Zero sized requests fail like in gran_alloc() (a fresh arena would
+     * otherwise return its next pointer, 0), and sizes that cannot fit an
+     * extent are rejected before the rounding can overflow.
+     */
+    if (size == 0 || size > ((size_t)32 << GRAN_LOG2GRAN(arena->gran)))
+    {
+        return NULL;
+    }
+
+    size = GRAN_ARENA_ROUNDUP(size);
+    if (arena->end - arena->next < size)
+    {
+        if (gran_arena_refill(arena, size) < 0)
+        {
+            return NULL;
+        }
+    }
+
+    alloc        = arena->next;
+    arena->next += size;
+    return (void *)alloc;
+}
+
+/****************************************************************************
+ * Name: gran_arena_end
+ *
+ * Description:
+ *   Return every extent of the arena to the heap in a single critical
+ *   section and leave the arena empty.  All memory allocated from the
+ *   arena becomes invalid.
+ *
+ * Input Parameters:
+ *   arena - The arena
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_arena_end(struct gran_arena *arena)
+{
+    struct gran_arena_extent *extent;
+    struct gran_arena_extent *next;
+    struct mm_gran           *gran;
+    int                       ret;
+
+    assert(arena != NULL);
+
+    gran = arena->gran;
+    if (arena->extents == NULL)
+    {
+        return;
+    }
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    for (extent = arena->extents; extent != NULL; extent = next)
+    {
+        next = extent->next;
+        gran_clear_allocated(gran, (uintptr_t)extent, extent->ngranules);
+    }
+
+    gran_leave_critical(gran);
+
+    arena->extents = NULL;
+    arena->next    = 0;
+    arena->end     = 0;
+}
+
+#endif /* CONFIG_GRAN */
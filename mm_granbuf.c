@@ -0,0 +1,230 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granbuf.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Each entry of the reference count array describes the allocation that
+ * starts at that granule:  The low 24 bits hold the reference count and
+ * the high 8 bits the number of granules, so that the last unref can free
+ * the allocation with a single atomic operation.
+ */
+
+#define GRAN_BUF_COUNT_MASK   0x00ffffff
+#define GRAN_BUF_NGRAN_SHIFT  24
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_buf_initialize
+ *
+ * Description:
+ *   Enable reference counted buffers on a granule heap.  This allocates
+ *   the reference count array, one 32-bit entry per granule, outside of
+ *   the heap.  It is released by gran_release().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the array
+ *   could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_buf_initialize(struct mm_gran *gran)
+{
+    assert(gran != NULL);
+
+    if (gran->refcnt == NULL)
+    {
+        gran->refcnt = calloc(gran->ngranules, sizeof(uint32_t));
+        if (gran->refcnt == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_buf_alloc
+ *
+ * Description:
+ *   Allocate a reference counted buffer.  The buffer starts with one
+ *   reference.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the buffer
+ *   buf    - Returns the buffer
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_buf_alloc(struct mm_gran *gran, size_t size, struct gran_buf *buf)
+{
+    void *memory;
+
+    assert(gran != NULL && gran->refcnt != NULL && buf != NULL);
+
+    memory = gran_alloc_owned(gran, size);
+    if (memory == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    buf->data = memory;
+    buf->len  = size;
+    buf->head = ((uintptr_t)memory - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+
+    __atomic_store_n(&gran->refcnt[buf->head],
+                     (GRAN_NGRANULES(gran, size) << GRAN_BUF_NGRAN_SHIFT) | 1,
+                     __ATOMIC_RELEASE);
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_buf_ref
+ *
+ * Description:
+ *   Take one more reference to the allocation behind a buffer or slice.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_buf_ref(struct mm_gran *gran, const struct gran_buf *buf)
+{
+    uint32_t old;
+
+    assert(gran != NULL && buf != NULL);
+
+    old = __atomic_fetch_add(&gran->refcnt[buf->head], 1, __ATOMIC_RELAXED);
+    assert((old & GRAN_BUF_COUNT_MASK) != 0 &&
+           (old & GRAN_BUF_COUNT_MASK) != GRAN_BUF_COUNT_MASK);
+    (void)old;
+}
+
+/****************************************************************************
+ * Name: gran_buf_unref
+ *
+ * Description:
+ *   Drop one reference.  The last reference frees the whole allocation,
+ *   whichever buffer or slice it was taken through.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer.  It may not be used after this call.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_buf_unref(struct mm_gran *gran, struct gran_buf *buf)
+{
+    uint32_t old;
+    void    *memory;
+
+    assert(gran != NULL && buf != NULL);
+
+    old = __atomic_fetch_sub(&gran->refcnt[buf->head], 1, __ATOMIC_ACQ_REL);
+    assert((old & GRAN_BUF_COUNT_MASK) != 0);
+
+    if ((old & GRAN_BUF_COUNT_MASK) == 1)
+    {
+        memory = (void *)(gran->heapstart + ((uintptr_t)buf->head << GRAN_LOG2GRAN(gran)));
+        __atomic_store_n(&gran->refcnt[buf->head], 0, __ATOMIC_RELAXED);
+        gran_free(gran, memory, (size_t)(old >> GRAN_BUF_NGRAN_SHIFT) << GRAN_LOG2GRAN(gran));
+    }
+
+    buf->data = NULL;
+    buf->len  = 0;
+}
+
+/****************************************************************************
+ * Name: gran_buf_slice
+ *
+ * Description:
+ *   Make a sub-buffer that shares the memory of a buffer without copying.
+ *   The slice holds its own reference and is released with
+ *   gran_buf_unref() like any other buffer.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   buf    - The buffer or slice to take the sub-buffer from
+ *   offset - Start of the slice relative to buf->data
+ *   len    - Length of the slice
+ *   slice  - Returns the slice
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL is returned if the range is
+ *   not inside the buffer.
+ *
+ ****************************************************************************/
+
+int gran_buf_slice(struct mm_gran *gran, const struct gran_buf *buf,
+                   size_t offset, size_t len, struct gran_buf *slice)
+{
+    assert(gran != NULL && buf != NULL && slice != NULL);
+
+    if (offset > buf->len || len > buf->len - offset)
+    {
+        return -EINVAL;
+    }
+
+    gran_buf_ref(gran, buf);
+
+    slice->data = (uint8_t *)buf->data + offset;
+    slice->len  = len;
+    slice->head = buf->head;
+    return 0;
+}
+
+#endif /* CONFIG_GRAN */
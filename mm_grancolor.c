@@ -0,0 +1,102 @@
+/****************************************************************************
+ * mm/mm_gran/mm_grancolor.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef CONFIG_GRAN_COLOR_LINE
+#  define CONFIG_GRAN_COLOR_LINE 64
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_colored
+ *
+ * Description:
+ *   Allocate memory from the granule heap at a rotating cache line offset.
+ *   With large (for example page sized) granules every gran_alloc() result
+ *   has the same offset modulo the cache way size, so hot buffers compete
+ *   for the same cache sets.  Here the heap cycles through the
+ *   GRAN_SIZE / CONFIG_GRAN_COLOR_LINE colors and moves each allocation up
+ *   by its color, as far as the unused tail of its last granule allows.
+ *
+ *   Because the offset stays inside the granules of the allocation,
+ *   gran_free() with the same size releases exactly the same granules.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer aligned to CONFIG_GRAN_COLOR_LINE is
+ *   returned; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_colored(struct mm_gran *gran, size_t size)
+{
+    unsigned int ncolors;
+    uint32_t     color;
+    size_t       slack;
+    size_t       offset;
+    uintptr_t    alloc;
+
+    assert(gran != NULL);
+
+    alloc = (uintptr_t)gran_alloc_local(gran, size);
+    if (alloc == 0 || GRAN_SIZE(gran) <= CONFIG_GRAN_COLOR_LINE)
+    {
+        return (void *)alloc;
+    }
+
+    ncolors = GRAN_SIZE(gran) / CONFIG_GRAN_COLOR_LINE;
+    color   = __atomic_fetch_add(&gran->color, 1, __ATOMIC_RELAXED) % ncolors;
+
+    /* Stay inside the granules of the allocation */
+    slack  = (GRAN_NGRANULES(gran, size) << GRAN_LOG2GRAN(gran)) - size;
+    offset = (size_t)color * CONFIG_GRAN_COLOR_LINE;
+    if (offset > slack)
+    {
+        offset = slack & ~((size_t)CONFIG_GRAN_COLOR_LINE - 1);
+    }
+
+    return (void *)(alloc + offset);
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,421 @@
+/****************************************************************************
+ * mm/mm_gran/mm_grancompact.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_free_below
+ *
+ * Description:
+ *   Return how many granules directly below granno are free, up to max.
+ *
+ ****************************************************************************/
+
+static unsigned int gran_free_below(struct mm_gran *gran, unsigned int granno,
+                                    unsigned int max)
+{
+    unsigned int nfree = 0;
+
+    while (nfree < max && nfree < granno)
+    {
+        unsigned int prev = granno - nfree - 1;
+
+        if (gran->gat[prev >> 5] & ((uint32_t)1 << (prev & 31)))
+        {
+            break;
+        }
+
+        nfree++;
+    }
+
+    return nfree;
+}
+
+/****************************************************************************
+ * Name: gran_remap
+ *
+ * Description:
+ *   Move whole pages from one run of granules to another with mremap()
+ *   instead of copying them.  mremap() leaves a hole behind, which is
+ *   filled with new zero pages so that the heap stays mapped.  The runs
+ *   must not overlap.
+ *
+ * Returned Value:
+ *   Zero on success; a negated errno value if the pages were not moved.
+ *
+ ****************************************************************************/
+
+static int gran_remap(uintptr_t from, uintptr_t to, size_t nbytes)
+{
+    void *addr;
+
+    addr = mremap((void *)from, nbytes, nbytes, MREMAP_MAYMOVE | MREMAP_FIXED, (void *)to);
+    if (addr == MAP_FAILED)
+    {
+        return -errno;
+    }
+
+    addr = mmap((void *)from, nbytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        /* Put the pages back rather than leave a hole in the heap */
+        addr = mremap((void *)to, nbytes, nbytes, MREMAP_MAYMOVE | MREMAP_FIXED, (void *)from);
+        assert(addr != MAP_FAILED);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_movable
+ *
+ * Description:
+ *   Allocate memory that gran_compact() is allowed to move.  The owner
+ *   must only reach the memory through m->mem, or update its own pointers
+ *   from the relocate() callback.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   m        - The movable allocation to fill in
+ *   size     - The size of the memory region to allocate.
+ *   relocate - Called after the memory was moved, or NULL
+ *   arg      - Passed to relocate()
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned on failure.
+ *
+ ****************************************************************************/
+
+int gran_alloc_movable(struct mm_gran *gran, struct gran_movable *m, size_t size,
+                       void (*relocate)(struct gran_movable *m, void *oldmem, void *arg),
+                       void *arg)
+{
+    int ret;
+
+    assert(gran != NULL && m != NULL);
+
+    m->mem = gran_alloc_local(gran, size);
+    if (m->mem == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    m->size     = size;
+    m->relocate = relocate;
+    m->arg      = arg;
+    m->prev     = NULL;
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        gran_free(gran, m->mem, size);
+        return ret;
+    }
+
+    m->next = gran->movables;
+    if (m->next != NULL)
+    {
+        m->next->prev = m;
+    }
+
+    gran->movables = m;
+    gran_leave_critical(gran);
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_free_movable
+ *
+ * Description:
+ *   Free a movable allocation.  Nothing is done if the allocation was
+ *   already freed by gran_reset() or gran_epoch_release().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   m      - The movable allocation
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_movable(struct mm_gran *gran, struct gran_movable *m)
+{
+    int ret;
+
+    assert(gran != NULL && m != NULL);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    /* Already freed by gran_reset() or gran_epoch_release() */
+    if (m->mem == NULL)
+    {
+        gran_leave_critical(gran);
+        return;
+    }
+
+    if (m->prev != NULL)
+    {
+        m->prev->next = m->next;
+    }
+    else
+    {
+        gran->movables = m->next;
+    }
+
+    if (m->next != NULL)
+    {
+        m->next->prev = m->prev;
+    }
+
+    gran_clear_allocated(gran, (uintptr_t)m->mem, GRAN_NGRANULES(gran, m->size));
+    gran_leave_critical(gran);
+
+    m->mem = NULL;
+}
+
+/****************************************************************************
+ * Name: gran_movable_drop
+ *
+ * Description:
+ *   Forget the movable allocations whose granules were freed behind the
+ *   back of the movable list.  Their mem is set to NULL so that a later
+ *   gran_free_movable() does nothing.  The caller must hold the critical
+ *   section.
+ *
+ ****************************************************************************/
+
+void gran_movable_drop(struct mm_gran *gran, const uint32_t *map)
+{
+    struct gran_movable *m;
+    struct gran_movable *next;
+    unsigned int         granno;
+
+    for (m = gran->movables; m != NULL; m = next)
+    {
+        next   = m->next;
+        granno = ((uintptr_t)m->mem - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+        if (map != NULL && (map[granno >> 5] & ((uint32_t)1 << (granno & 31))) == 0)
+        {
+            continue;
+        }
+
+        if (m->prev != NULL)
+        {
+            m->prev->next = m->next;
+        }
+        else
+        {
+            gran->movables = m->next;
+        }
+
+        if (m->next != NULL)
+        {
+            m->next->prev = m->prev;
+        }
+
+        m->mem  = NULL;
+        m->prev = NULL;
+        m->next = NULL;
+    }
+}
+
+/****************************************************************************
+ * Name: gran_compact
+ *
+ * Description:
+ *   Move movable allocations down, so that free space gathers at the top
+ *   of the heap.  An allocation moves to the lowest free run below it; if
+ *   there is none, it slides down into the free granules directly below
+ *   it, which may overlap its own.  Each move claims the new granules,
+ *   moves the data, frees the granules that are no longer used and then
+ *   calls the relocate() callback of the owner.  The callbacks run with
+ *   the heap locked and must not call into the heap.
+ *
+ *   After gran_compact_remap() the pages of a move to a run that does not
+ *   overlap are moved with mremap() instead of being copied.
+ *
+ *   The number of bytes moved is bounded by budget, so a background
+ *   thread can compact the heap in small steps; a call that moves nothing
+ *   means that no movable allocation can be moved lower.  Movable
+ *   allocations always come from the first zone of a mixed granularity
+ *   heap, so the other zones are not compacted.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   budget - The maximum number of bytes to move
+ *
+ * Returned Value:
+ *   The number of bytes moved, or a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+ssize_t gran_compact(struct mm_gran *gran, size_t budget)
+{
+    struct gran_movable *m;
+    unsigned int         ngranules;
+    unsigned int         granno;
+    unsigned int         nmove;
+    uintptr_t            alloc;
+    size_t               nbytes;
+    size_t               moved = 0;
+    void                *oldmem;
+    int                  newgran;
+    int                  epoch;
+    int                  ret;
+
+    assert(gran != NULL);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    for (m = gran->movables; m != NULL; m = m->next)
+    {
+        ngranules = GRAN_NGRANULES(gran, m->size);
+        nbytes    = (size_t)ngranules << GRAN_LOG2GRAN(gran);
+        if (nbytes > budget - moved)
+        {
+            continue;
+        }
+
+        /* Prefer a run that lies entirely below the allocation, else slide
+         * down into the free granules just below it.
+         */
+        granno  = ((uintptr_t)m->mem - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+        newgran = gran_range_search(gran, ngranules, 0, granno, 0);
+        if (newgran < 0)
+        {
+            nmove = gran_free_below(gran, granno, ngranules);
+            if (nmove == 0)
+            {
+                continue;
+            }
+
+            newgran = granno - nmove;
+        }
+
+        /* Only the granules that are not shared by the old and the new run
+         * change hands.  The new ones keep the epoch tag of the allocation.
+         */
+        nmove  = granno - newgran < ngranules ? granno - newgran : ngranules;
+        alloc  = gran->heapstart + ((uintptr_t)newgran << GRAN_LOG2GRAN(gran));
+        epoch  = gran_epoch_of(gran, granno);
+        oldmem = m->mem;
+
+        gran_mark_epoch(gran, alloc, nmove, epoch);
+
+        if (!gran->remap || nmove < ngranules ||
+            gran_remap((uintptr_t)oldmem, alloc, nbytes) < 0)
+        {
+            memmove((void *)alloc, oldmem, nbytes);
+        }
+
+        gran_clear_allocated(gran, (uintptr_t)oldmem + nbytes -
+                             ((size_t)nmove << GRAN_LOG2GRAN(gran)), nmove);
+
+        m->mem = (void *)alloc;
+        moved += nbytes;
+
+        if (m->relocate != NULL)
+        {
+            m->relocate(m, oldmem, m->arg);
+        }
+    }
+
+    gran_leave_critical(gran);
+    return moved;
+}
+
+/****************************************************************************
+ * Name: gran_compact_remap
+ *
+ * Description:
+ *   Let gran_compact() move allocations with mremap() instead of copying
+ *   them.  The granules must be whole pages and the heap memory must be
+ *   private anonymous memory of the caller: the pages a move leaves
+ *   behind are replaced by new private zero pages, and any memory policy
+ *   or sharing of the old pages moves with them.  memfd and userfaultfd
+ *   heaps map their memory themselves and always copy.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL is returned if the granules
+ *   are smaller than a page or the heap maps its own memory.
+ *
+ ****************************************************************************/
+
+int gran_compact_remap(struct mm_gran *gran)
+{
+    size_t pagesize;
+
+    assert(gran != NULL);
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    if (GRAN_SIZE(gran) < pagesize || (gran->heapstart & (pagesize - 1)) != 0 ||
+        gran->memfd >= 0 || gran->uffd != NULL)
+    {
+        return -EINVAL;
+    }
+
+    gran->remap = 1;
+    return 0;
+}
+
+#endif /* CONFIG_GRAN */
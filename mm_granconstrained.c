@@ -0,0 +1,246 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granconstrained.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_range_search
+ *
+ * Description:
+ *   Find the first run of free granules inside [firstgran, endgran) that
+ *   does not cross a multiple of 'boundary'.  GAT entries are skipped using
+ *   their free run summaries; inside a candidate entry the free positions
+ *   are visited with a 64-bit window over the entry and its successor.
+ *   The caller must hold the critical section.
+ *
+ * Input Parameters:
+ *   priv      - The granule heap state structure.
+ *   ngranules - The number of granules needed (1..32)
+ *   firstgran - The first granule that may be used
+ *   endgran   - One past the last granule that may be used
+ *   boundary  - Address boundary the run may not cross (power of two, not
+ *               smaller than a granule), or zero for none
+ *
+ * Returned Value:
+ *   The granule number of the run, or -1 if there is none.
+ *
+ ****************************************************************************/
+
+int gran_range_search(struct mm_gran *gran, unsigned int ngranules,
+                      unsigned int firstgran, unsigned int endgran,
+                      size_t boundary)
+{
+    unsigned int ngat;
+    unsigned int gatidx;
+    unsigned int lastidx;
+    unsigned int granidx;
+    unsigned int bitidx;
+    unsigned int skip;
+    uintptr_t    alloc;
+    uintptr_t    allocend;
+    uint64_t     window;
+    uint64_t     avail;
+    uint64_t     blocked;
+    uint64_t     runmask;
+    uint8_t      run;
+    uint8_t      nextrun;
+
+    assert(ngranules > 0 && ngranules <= 32);
+
+    if (endgran > gran->ngranules)
+    {
+        endgran = gran->ngranules;
+    }
+
+    if (firstgran >= endgran || endgran - firstgran < ngranules)
+    {
+        return -1;
+    }
+
+    ngat    = SIZEOF_GAT(gran->ngranules);
+    lastidx = (endgran - 1) >> 5;
+    runmask = ((uint64_t)1 << ngranules) - 1;
+
+    for (gatidx = firstgran >> 5; gatidx <= lastidx; gatidx++)
+    {
+        /* Skip entries that cannot hold the start of the run */
+        run = gran->gatrun[gatidx];
+        if (GRAN_RUN_MXFREE(run) < ngranules)
+        {
+            nextrun = gatidx + 1 < ngat ? gran->gatrun[gatidx + 1] : 0;
+            if (GRAN_RUN_NMSFREE(run) + GRAN_RUN_NLSFREE(nextrun) < ngranules)
+            {
+                continue;
+            }
+        }
+
+        /* Load this entry and the next one.  Granules outside of
+         * [firstgran, endgran) are treated as allocated.
+         */
+        granidx = gatidx << 5;
+        window  = gran->gat[gatidx];
+        window |= (uint64_t)(gatidx + 1 < ngat ? gran->gat[gatidx + 1] : 0xffffffff) << 32;
+
+        if (granidx < firstgran)
+        {
+            window |= ((uint64_t)1 << (firstgran - granidx)) - 1;
+        }
+
+        if (endgran - granidx < 64)
+        {
+            window |= ~(uint64_t)0 << (endgran - granidx);
+        }
+
+        /* Visit every free granule of this entry as a possible start */
+        avail = ~window & 0xffffffff;
+        while (avail != 0)
+        {
+            bitidx  = __builtin_ctzll(avail);
+            blocked = (window >> bitidx) & runmask;
+            if (blocked != 0)
+            {
+                /* No start up to the first allocated granule can work */
+                skip   = bitidx + __builtin_ctzll(blocked) + 1;
+                avail &= skip < 64 ? ~(uint64_t)0 << skip : 0;
+                continue;
+            }
+
+            if (boundary != 0)
+            {
+                alloc    = gran->heapstart + ((uintptr_t)(granidx + bitidx) << GRAN_LOG2GRAN(gran));
+                allocend = alloc + ((uintptr_t)ngranules << GRAN_LOG2GRAN(gran)) - 1;
+                if (((alloc ^ allocend) & ~(uintptr_t)(boundary - 1)) != 0)
+                {
+                    /* Crosses the boundary.  Retry at the boundary. */
+                    alloc  = (alloc | (boundary - 1)) + 1;
+                    skip   = ((alloc - gran->heapstart) >> GRAN_LOG2GRAN(gran)) - granidx;
+                    avail &= skip < 64 ? ~(uint64_t)0 << skip : 0;
+                    continue;
+                }
+            }
+
+            return granidx + bitidx;
+        }
+    }
+
+    return -1;
+}
+
+/****************************************************************************
+ * Name: gran_alloc_constrained
+ *
+ * Description:
+ *   Allocate memory from the granule heap that lies entirely inside the
+ *   address range [lo, hi) and does not cross a multiple of 'boundary'.
+ *   This serves devices with a limited DMA reach or with buffers that may
+ *   not cross, say, a 64 KiB line from the one heap.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   size     - The size of the memory region to allocate.
+ *   lo       - Lowest acceptable address
+ *   hi       - One past the highest acceptable address
+ *   boundary - Power of two address boundary that the allocation may not
+ *              cross, or zero for none.  It may not be smaller than a
+ *              granule.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_constrained(struct mm_gran *gran, size_t size,
+                             uintptr_t lo, uintptr_t hi, size_t boundary)
+{
+    unsigned int ngranules;
+    unsigned int firstgran;
+    unsigned int endgran;
+    uintptr_t    heapend;
+    uintptr_t    alloc;
+    int          granno;
+    int          ret;
+
+    assert(gran != NULL && size <= 32 * GRAN_SIZE(gran));
+    assert(boundary == 0 || ((boundary & (boundary - 1)) == 0 && boundary >= GRAN_SIZE(gran)));
+
+    if (size == 0 || (boundary != 0 && size > boundary))
+    {
+        return NULL;
+    }
+
+    /* Convert the address range to whole granules inside the heap */
+    heapend = gran->heapstart + ((uintptr_t)gran->ngranules << GRAN_LOG2GRAN(gran));
+    if (lo < gran->heapstart)
+    {
+        lo = gran->heapstart;
+    }
+
+    if (hi > heapend)
+    {
+        hi = heapend;
+    }
+
+    if (lo >= hi)
+    {
+        return NULL;
+    }
+
+    ngranules = GRAN_NGRANULES(gran, size);
+    firstgran = GRAN_NGRANULES(gran, lo - gran->heapstart);
+    endgran   = (hi - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return NULL;
+    }
+
+    granno = gran_range_search(gran, ngranules, firstgran, endgran, boundary);
+    if (granno < 0)
+    {
+        gran_leave_critical(gran);
+        return NULL;
+    }
+
+    alloc = gran->heapstart + ((uintptr_t)granno << GRAN_LOG2GRAN(gran));
+    gran_mark_allocated(gran, alloc, ngranules);
+    gran_leave_critical(gran);
+    return (void *)alloc;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,75 @@
+/****************************************************************************
+ * mm/mm_gran/mm_grancritical.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_enter_critical and gran_leave_critical
+ *
+ * Description:
+ *   Critical section management for the granule allocator.
+ *
+ * Input Parameters:
+ *   priv - Pointer to the gran state
+ *
+ * Returned Value:
+ *   gran_enter_critical() may return any error reported by
+ *   pthread_mutex_lock()
+ *
+ ****************************************************************************/
+
+int gran_enter_critical(struct mm_gran *priv)
+{
+    return -pthread_mutex_lock(&priv->exclsem);
+}
+
+void gran_leave_critical(struct mm_gran *priv)
+{
+    struct gran_wmark_event event;
+
+    /* Watermark notifications are delivered outside of the lock */
+    if (priv->wmark != NULL && gran_wmark_check(priv, &event))
+    {
+        pthread_mutex_unlock(&priv->exclsem);
+        gran_wmark_notify(priv, &event);
+        return;
+    }
+
+    pthread_mutex_unlock(&priv->exclsem);
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,259 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granepoch.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The tag bitmap of one epoch.  Each has the layout of the GAT. */
+
+#define GRAN_EPOCHMAP(g, e) (&(g)->epochmap[(size_t)(e) * SIZEOF_GAT((g)->ngranules)])
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_epoch_initialize
+ *
+ * Description:
+ *   Enable epoch tagging on a granule heap.  From now on every allocation
+ *   is tagged with the current epoch, starting with epoch 0, and
+ *   gran_epoch_release() frees all allocations of an epoch in one sweep.
+ *   Memory owned by streams, arenas, rings, reference counted buffers and
+ *   vectors is never tagged; it is freed by its owner.  The tag bitmaps
+ *   are allocated outside of the heap and are released by gran_release().
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the bitmaps
+ *   could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_epoch_initialize(struct mm_gran *gran)
+{
+    assert(gran != NULL);
+
+    if (gran->epochmap == NULL)
+    {
+        gran->epochmap = calloc((size_t)CONFIG_GRAN_NEPOCHS * SIZEOF_GAT(gran->ngranules),
+                                sizeof(uint32_t));
+        if (gran->epochmap == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        gran->epoch = 0;
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_epoch_begin
+ *
+ * Description:
+ *   Start the next epoch.  Epoch numbers are reused round robin, so the
+ *   next epoch must have been released (or all of its allocations freed)
+ *   before it can begin again.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   The number of the new epoch (0..CONFIG_GRAN_NEPOCHS-1) on success;
+ *   -EBUSY if that epoch still holds allocations.
+ *
+ ****************************************************************************/
+
+int gran_epoch_begin(struct mm_gran *gran)
+{
+    uint32_t    *map;
+    unsigned int next;
+    unsigned int gatidx;
+    int          ret;
+
+    assert(gran != NULL && gran->epochmap != NULL);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    next = (gran->epoch + 1) % CONFIG_GRAN_NEPOCHS;
+    map  = GRAN_EPOCHMAP(gran, next);
+
+    for (gatidx = 0; gatidx < SIZEOF_GAT(gran->ngranules); gatidx++)
+    {
+        if (map[gatidx] != 0)
+        {
+            gran_leave_critical(gran);
+            return -EBUSY;
+        }
+    }
+
+    gran->epoch = next;
+    gran_leave_critical(gran);
+    return next;
+}
+
+/****************************************************************************
+ * Name: gran_epoch_release
+ *
+ * Description:
+ *   Free every allocation that is still tagged with an epoch, one GAT word
+ *   at a time.  Pointers into the epoch do not need to be tracked.
+ *   Movable allocations of the epoch are forgotten and their mem set to
+ *   NULL.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   epoch  - The epoch returned by gran_epoch_begin(), or 0 for the first
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_epoch_release(struct mm_gran *gran, int epoch)
+{
+    uint32_t    *map;
+    unsigned int gatidx;
+    int          ret;
+
+    assert(gran != NULL && gran->epochmap != NULL);
+    assert(epoch >= 0 && epoch < CONFIG_GRAN_NEPOCHS);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    map = GRAN_EPOCHMAP(gran, epoch);
+    gran_movable_drop(gran, map);
+
+    for (gatidx = 0; gatidx < SIZEOF_GAT(gran->ngranules); gatidx++)
+    {
+        if (map[gatidx] != 0)
+        {
+            assert((gran->gat[gatidx] & map[gatidx]) == map[gatidx]);
+
+            gran->gat[gatidx] &= ~map[gatidx];
+            gran_update_run(gran, gatidx);
+            if (gran->pinmap != NULL)
+            {
+                gran->pinmap[gatidx] &= ~map[gatidx];
+            }
+
+            map[gatidx] = 0;
+        }
+    }
+
+    gran_wait_wake(gran);
+    gran_leave_critical(gran);
+}
+
+/****************************************************************************
+ * Name: gran_epoch_mark
+ *
+ * Description:
+ *   Tag granules of one GAT entry with an epoch.
+ *
+ ****************************************************************************/
+
+void gran_epoch_mark(struct mm_gran *gran, int epoch, unsigned int gatidx,
+                     uint32_t gatmask)
+{
+    GRAN_EPOCHMAP(gran, epoch)[gatidx] |= gatmask;
+}
+
+/****************************************************************************
+ * Name: gran_epoch_clear
+ *
+ * Description:
+ *   Remove the epoch tag of granules of one GAT entry.  The epoch of the
+ *   granules is not known, so the bits are cleared in every epoch.
+ *
+ ****************************************************************************/
+
+void gran_epoch_clear(struct mm_gran *gran, unsigned int gatidx, uint32_t gatmask)
+{
+    unsigned int epoch;
+
+    for (epoch = 0; epoch < CONFIG_GRAN_NEPOCHS; epoch++)
+    {
+        GRAN_EPOCHMAP(gran, epoch)[gatidx] &= ~gatmask;
+    }
+}
+
+/****************************************************************************
+ * Name: gran_epoch_of
+ *
+ * Description:
+ *   Return the epoch that a granule is tagged with, or -1 if it has none.
+ *
+ ****************************************************************************/
+
+int gran_epoch_of(struct mm_gran *gran, unsigned int granno)
+{
+    uint32_t     gatmask = (uint32_t)1 << (granno & 31);
+    unsigned int epoch;
+
+    if (gran->epochmap == NULL)
+    {
+        return -1;
+    }
+
+    for (epoch = 0; epoch < CONFIG_GRAN_NEPOCHS; epoch++)
+    {
+        if (GRAN_EPOCHMAP(gran, epoch)[granno >> 5] & gatmask)
+        {
+            return epoch;
+        }
+    }
+
+    return -1;
+}
+
+#endif /* CONFIG_GRAN */
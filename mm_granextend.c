@@ -0,0 +1,178 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granextend.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_isfree
+ *
+ * Description:
+ *   Check if a range of granules is free.  The range may not cover more
+ *   than 32 granules, so it touches at most two GAT entries.
+ *
+ * Input Parameters:
+ *   gran      - The granule heap state structure.
+ *   granno    - The first granule of the range
+ *   ngranules - The number of granules in the range
+ *
+ * Returned Value:
+ *   Non-zero if every granule of the range is inside the heap and free.
+ *
+ ****************************************************************************/
+
+static int gran_isfree(struct mm_gran *gran, unsigned int granno, unsigned int ngranules)
+{
+    unsigned int gatidx;
+    unsigned int gatbit;
+    unsigned int avail;
+    uint32_t     gatmask;
+
+    if (granno + ngranules > gran->ngranules)
+    {
+        return 0;
+    }
+
+    gatidx = granno >> 5;
+    gatbit = granno & 31;
+
+    avail = 32 - gatbit;
+    if (ngranules > avail)
+    {
+        /* Check bits in the first and the second GAT entry */
+        gatmask = 0xffffffff << gatbit;
+        if ((gran->gat[gatidx] & gatmask) != 0)
+        {
+            return 0;
+        }
+
+        gatmask = 0xffffffff >> (32 - (ngranules - avail));
+        return (gran->gat[gatidx + 1] & gatmask) == 0;
+    }
+
+    /* All of the granules are in one entry */
+    gatmask   = 0xffffffff >> (32 - ngranules);
+    gatmask <<= gatbit;
+    return (gran->gat[gatidx] & gatmask) == 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_extend
+ *
+ * Description:
+ *   Resize an allocation in place.  Growing claims the granules that
+ *   immediately follow the allocation and fails if any of them is in use;
+ *   the allocation is never moved.  Shrinking returns the trailing
+ *   granules to the heap.
+ *
+ *   NOTE: The resized allocation is still limited to 32 granules.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   memory  - A pointer to memory previously allocated by gran_alloc.
+ *   oldsize - The size of the allocation as passed to gran_alloc.
+ *   newsize - The requested new size of the allocation.
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the following
+ *   granules are not free.  The allocation is unchanged on failure.
+ *
+ ****************************************************************************/
+
+int gran_extend(struct mm_gran *gran, void *memory, size_t oldsize, size_t newsize)
+{
+    unsigned int granno;
+    unsigned int oldgran;
+    unsigned int newgran;
+    uintptr_t    tail;
+    int          ret;
+
+    assert(gran != NULL && memory && oldsize > 0 && newsize > 0);
+
+    /* Memory of the other zones of a mixed granularity heap is resized in
+     * its own zone.
+     */
+    gran = gran_zone_of(gran, memory);
+
+    if (newsize > 32 * GRAN_SIZE(gran))
+    {
+        return -ENOMEM;
+    }
+
+    /* Determine the granule number of the first granule in the allocation */
+    granno  = ((uintptr_t)memory - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+
+    /* Determine the old and the new number of granules */
+    oldgran = GRAN_NGRANULES(gran, oldsize);
+    newgran = GRAN_NGRANULES(gran, newsize);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (newgran < oldgran)
+    {
+        /* Return the trailing granules to the heap */
+        tail = (uintptr_t)memory + ((uintptr_t)newgran << GRAN_LOG2GRAN(gran));
+        gran_clear_allocated(gran, tail, oldgran - newgran);
+    }
+    else if (newgran > oldgran)
+    {
+        /* Claim the granules that follow the allocation if they are free */
+        if (!gran_isfree(gran, granno + oldgran, newgran - oldgran))
+        {
+            gran_leave_critical(gran);
+            return -ENOMEM;
+        }
+
+        tail = (uintptr_t)memory + ((uintptr_t)oldgran << GRAN_LOG2GRAN(gran));
+        /* The new granules belong to the epoch of the allocation */
+        gran_mark_epoch(gran, tail, newgran - oldgran,
+                        gran_epoch_of(gran, granno));
+    }
+
+    gran_leave_critical(gran);
+    return 0;
+}
+
+#endif /* CONFIG_GRAN */
@@ -34,6 +34,30 @@
 
 #ifdef CONFIG_GRAN
 
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Drop reservation, epoch and pinned tags of granules that are being freed */
+
+static void gran_clear_tags(struct mm_gran *gran, unsigned int gatidx, uint32_t gatmask)
+{
+    if (gran->resv != NULL)
+    {
+        gran->resv[gatidx] &= ~gatmask;
+    }
+
+    if (gran->epochmap != NULL)
+    {
+        gran_epoch_clear(gran, gatidx, gatmask);
+    }
+
+    if (gran->pinmap != NULL)
+    {
+        gran->pinmap[gatidx] &= ~gatmask;
+    }
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -54,20 +78,66 @@
  ****************************************************************************/
 
 void gran_free(struct mm_gran *gran, void *memory, size_t size)
+{
+    int ret;
+
+    assert(gran != NULL && memory);
+
+    /* Memory of the other zones goes back to its zone.  Callers of
+     * gran_alloc_wait() only sleep on the first zone, so wake them too.
+     */
+    if (gran->zones != NULL && gran_zone_free(gran, memory, size))
+    {
+        if (gran->nwaiters > 0 && gran_enter_critical(gran) >= 0)
+        {
+            gran_wait_wake(gran);
+            gran_leave_critical(gran);
+        }
+
+        return;
+    }
+
+    assert(size <= 32 * GRAN_SIZE(gran));
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    gran_clear_allocated(gran, (uintptr_t)memory, GRAN_NGRANULES(gran, size));
+    gran_leave_critical(gran);
+}
+
+/****************************************************************************
+ * Name: gran_clear_allocated
+ *
+ * Description:
+ *   Mark a range of granules as free.  The caller must hold the critical
+ *   section.
+ *
+ * Input Parameters:
+ *   gran  - The granule heap state structure.
+ *   alloc - The address of the allocation.
+ *   ngranules - The number of granules to free
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_clear_allocated(struct mm_gran *gran, uintptr_t alloc, unsigned int ngranules)
 {
     unsigned int granno;
     unsigned int gatidx;
     unsigned int gatbit;
-    unsigned int granmask;
-    unsigned int ngranules;
     unsigned int avail;
     uint32_t     gatmask;
-    int          ret;
-
-    assert(gran != NULL && memory && size <= 32 * (1 << gran->log2gran));  
 
     /* Determine the granule number of the first granule in the allocation */
-    granno = ((uintptr_t)memory - gran->heapstart) >> gran->log2gran;
+    granno = (alloc - gran->heapstart) >> GRAN_LOG2GRAN(gran);
 
     /* 
      * Determine the GAT table index and bit number associated with the
@@ -76,10 +146,6 @@ void gran_free(struct mm_gran *gran, void *memory, size_t size)
     gatidx = granno >> 5;
     gatbit = granno & 31;
 
-    /* Determine the number of granules in the allocation */
-    granmask =  (1 << gran->log2gran) - 1;
-    ngranules = (size + granmask) >> gran->log2gran;
-
     /* Clear bits in the GAT entry or entries */
     avail = 32 - gatbit;
     if (ngranules > avail)
@@ -89,6 +155,8 @@ void gran_free(struct mm_gran *gran, void *memory, size_t size)
         assert((gran->gat[gatidx] & gatmask) == gatmask);
 
         gran->gat[gatidx] &= ~gatmask;
+        gran_update_run(gran, gatidx);
+        gran_clear_tags(gran, gatidx, gatmask);
         ngranules -= avail;
 
         /* Clear bits in the second GAT entry */
@@ -96,6 +164,9 @@ void gran_free(struct mm_gran *gran, void *memory, size_t size)
         assert((gran->gat[gatidx + 1] & gatmask) == gatmask);
 
         gran->gat[gatidx + 1] &= ~gatmask;
+        gran_update_run(gran, gatidx + 1);
+        gran_clear_tags(gran, gatidx + 1, gatmask);
+        gran_wait_notify(gran, gatidx, 2);
     }
     /* Handle the case where where all of the granules came from one entry */
     else
@@ -106,6 +177,9 @@ void gran_free(struct mm_gran *gran, void *memory, size_t size)
         assert((gran->gat[gatidx] & gatmask) == gatmask);
 
         gran->gat[gatidx] &= ~gatmask;
+        gran_update_run(gran, gatidx);
+        gran_clear_tags(gran, gatidx, gatmask);
+        gran_wait_notify(gran, gatidx, 1);
     }
 }
 
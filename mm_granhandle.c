@@ -0,0 +1,95 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granhandle.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_handle
+ *
+ * Description:
+ *   Allocate memory from the granule heap and return it as a 32-bit
+ *   handle, the granule number of the first granule.  Only the process
+ *   that initialized the heap may allocate and free in it, because the
+ *   heap state holds absolute addresses.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, the handle of the allocated memory is returned;
+ *   GRAN_INVALID_HANDLE is returned on failure.
+ *
+ ****************************************************************************/
+
+uint32_t gran_alloc_handle(struct mm_gran *gran, size_t size)
+{
+    void *memory;
+
+    memory = gran_alloc_local(gran, size);
+    if (memory == NULL)
+    {
+        return GRAN_INVALID_HANDLE;
+    }
+
+    return gran_ptr_to_handle((void *)gran->heapstart, GRAN_LOG2GRAN(gran), memory);
+}
+
+/****************************************************************************
+ * Name: gran_free_handle
+ *
+ * Description:
+ *   Return memory allocated with gran_alloc_handle() to the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   memh   - The allocation handle
+ *   size   - The size that was passed to gran_alloc_handle()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_handle(struct mm_gran *gran, uint32_t memh, size_t size)
+{
+    assert(gran != NULL && memh < gran->ngranules);
+
+    gran_free(gran, gran_handle_to_ptr((void *)gran->heapstart, GRAN_LOG2GRAN(gran), memh), size);
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,523 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granhint.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_search_top
+ *
+ * Description:
+ *   Find the highest run of ngranules free granules inside
+ *   [firstgran, endgran).  This is the top-down counterpart of
+ *   gran_range_search():  GAT entries are skipped using their free run
+ *   summaries and inside a candidate entry all run starts are found at
+ *   once in a 64-bit window over the entry and its successor.  The caller
+ *   must hold the critical section.
+ *
+ * Returned Value:
+ *   The granule number of the run, or -1 if there is none.
+ *
+ ****************************************************************************/
+
+static int gran_search_top(struct mm_gran *gran, unsigned int ngranules,
+                           unsigned int firstgran, unsigned int endgran)
+{
+    unsigned int ngatwords = SIZEOF_GAT(gran->ngranules);
+    unsigned int granidx;
+    unsigned int limit;
+    unsigned int k;
+    uint64_t     window;
+    uint64_t     valid;
+    uint64_t     avail;
+    uint64_t     starts;
+    uint8_t      run;
+    uint8_t      nextrun;
+    int          gatidx;
+
+    if (endgran > gran->ngranules)
+    {
+        endgran = gran->ngranules;
+    }
+
+    if (endgran <= firstgran || endgran - firstgran < ngranules)
+    {
+        return -1;
+    }
+
+    for (gatidx = (endgran - 1) >> 5; gatidx >= (int)(firstgran >> 5); gatidx--)
+    {
+        run     = gran->gatrun[gatidx];
+        nextrun = (unsigned int)gatidx + 1 < ngatwords ? gran->gatrun[gatidx + 1] : 0;
+        if (GRAN_RUN_MXFREE(run) < ngranules &&
+            (unsigned int)(GRAN_RUN_NMSFREE(run) + GRAN_RUN_NLSFREE(nextrun)) < ngranules)
+        {
+            continue;
+        }
+
+        window = gran->gat[gatidx];
+        if ((unsigned int)gatidx + 1 < ngatwords)
+        {
+            window |= (uint64_t)gran->gat[gatidx + 1] << 32;
+        }
+        else
+        {
+            window |= (uint64_t)0xffffffff << 32;
+        }
+
+        /* Only granules inside [firstgran, endgran) may be used */
+        granidx = gatidx << 5;
+        limit   = endgran - granidx;
+        valid   = limit >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << limit) - 1;
+        if (firstgran > granidx)
+        {
+            valid &= ~(((uint64_t)1 << (firstgran - granidx)) - 1);
+        }
+
+        /* Bit i of starts is set if ngranules free granules start at i */
+        avail  = ~window & valid;
+        starts = avail & 0xffffffff;
+        for (k = 1; k < ngranules && starts != 0; k++)
+        {
+            starts &= avail >> k;
+        }
+
+        if (starts != 0)
+        {
+            return granidx + 63 - __builtin_clzll(starts);
+        }
+    }
+
+    return -1;
+}
+
+/****************************************************************************
+ * Name: gran_search_best
+ *
+ * Description:
+ *   Find the smallest run of at least ngranules free granules inside
+ *   [firstgran, endgran), the highest one among runs of equal length, and
+ *   return the top ngranules granules of it.  Holes left by freed long
+ *   lived allocations are filled before the free space below them is cut
+ *   into.  The caller must hold the critical section.
+ *
+ * Returned Value:
+ *   The granule number of the allocation, or -1 if there is none.
+ *
+ ****************************************************************************/
+
+static int gran_search_best(struct mm_gran *gran, unsigned int ngranules,
+                            unsigned int firstgran, unsigned int endgran)
+{
+    unsigned int granidx;
+    unsigned int bitidx;
+    unsigned int runstart;
+    unsigned int runlen;
+    unsigned int bestlen = UINT32_MAX;
+    uint32_t     value;
+    uint32_t     rest;
+    int          best = -1;
+
+    if (endgran > gran->ngranules)
+    {
+        endgran = gran->ngranules;
+    }
+
+    runstart = firstgran & ~31;
+    for (granidx = runstart; granidx < endgran; granidx += 32)
+    {
+        /* Granules outside [firstgran, endgran) count as allocated */
+        value = gran->gat[granidx >> 5];
+        if (firstgran > granidx)
+        {
+            value |= ((uint32_t)1 << (firstgran - granidx)) - 1;
+        }
+
+        if (endgran - granidx < 32)
+        {
+            value |= 0xffffffff << (endgran - granidx);
+        }
+
+        if (value == 0)
+        {
+            continue;
+        }
+
+        /* Visit each run of free and allocated bits of this entry */
+        bitidx = 0;
+        while (bitidx < 32)
+        {
+            rest = value >> bitidx;
+            if ((rest & 1) == 0)
+            {
+                bitidx += rest == 0 ? 32 - bitidx : __builtin_ctz(rest);
+                continue;
+            }
+
+            /* Allocated granules end the current run */
+            runlen = granidx + bitidx - runstart;
+            if (runlen >= ngranules && runlen <= bestlen)
+            {
+                bestlen = runlen;
+                best    = granidx + bitidx - ngranules;
+            }
+
+            bitidx   += ~rest == 0 ? 32 - bitidx : __builtin_ctz(~rest);
+            runstart  = granidx + bitidx;
+        }
+    }
+
+    if (endgran > runstart)
+    {
+        runlen = endgran - runstart;
+        if (runlen >= ngranules && runlen <= bestlen)
+        {
+            best = endgran - ngranules;
+        }
+    }
+
+    return best;
+}
+
+/****************************************************************************
+ * Name: gran_hint_region
+ *
+ * Description:
+ *   Move the region of a class with its demand, the granules its live
+ *   allocations hold plus the ones being allocated.
+ *
+ *   The short lived region starts at the bottom of the heap and is kept at
+ *   twice the demand of its class, so first fit has room to work with.  It
+ *   grows as soon as the demand does and shrinks only once the demand has
+ *   fallen to a quarter of it, so it does not follow every allocation and
+ *   free.
+ *
+ *   The long lived region ends at the lowest pinned allocation and is as
+ *   large as the demand of its class.  Best fit in it reuses the holes
+ *   that freed long lived allocations leave, and the class only grows
+ *   downwards once none of them fits.  The caller must hold the critical
+ *   section.
+ *
+ ****************************************************************************/
+
+static void gran_hint_region(struct mm_gran *gran, int hint, unsigned int ngranules)
+{
+    uint32_t demand;
+
+    demand  = __atomic_load_n(&gran->hintinfo[hint].nlive, __ATOMIC_RELAXED);
+    demand += ngranules;
+
+    if (hint == GRAN_HINT_SHORT)
+    {
+        if (2 * demand > gran->shortend || 4 * demand < gran->shortend)
+        {
+            gran->shortend = 2 * demand < gran->ngranules ? 2 * demand : gran->ngranules;
+        }
+    }
+    else
+    {
+        gran->longstart = demand < gran->pinlow ? gran->pinlow - demand : 0;
+    }
+}
+
+/****************************************************************************
+ * Name: gran_pin_mark
+ *
+ * Description:
+ *   Record the granules of a pinned allocation in the pinned bitmap.  The
+ *   bits are cleared again when the granules are freed, reset or released
+ *   with their epoch.  The caller must hold the critical section.
+ *
+ ****************************************************************************/
+
+static void gran_pin_mark(struct mm_gran *gran, unsigned int granno, unsigned int ngranules)
+{
+    unsigned int gatbit = granno & 31;
+    unsigned int avail  = 32 - gatbit;
+
+    if (ngranules > avail)
+    {
+        gran->pinmap[granno >> 5]       |= 0xffffffff << gatbit;
+        gran->pinmap[(granno >> 5) + 1] |= 0xffffffff >> (32 - (ngranules - avail));
+    }
+    else
+    {
+        gran->pinmap[granno >> 5] |= (0xffffffff >> (32 - ngranules)) << gatbit;
+    }
+}
+
+/****************************************************************************
+ * Name: gran_pin_update
+ *
+ * Description:
+ *   Raise pinlow to the lowest pinned granule that is still allocated.
+ *   pinlow only goes down when pinned memory is allocated, so once the
+ *   lowest pinned allocation is freed it is recomputed from the pinned
+ *   bitmap.  The caller must hold the critical section.
+ *
+ ****************************************************************************/
+
+static void gran_pin_update(struct mm_gran *gran)
+{
+    unsigned int ngatwords = SIZEOF_GAT(gran->ngranules);
+    unsigned int granno    = gran->pinlow;
+    unsigned int gatidx;
+    uint32_t     word;
+
+    if (gran->pinmap == NULL || granno >= gran->ngranules ||
+        (gran->pinmap[granno >> 5] & ((uint32_t)1 << (granno & 31))) != 0)
+    {
+        return;
+    }
+
+    gran->pinlow = gran->ngranules;
+    for (gatidx = granno >> 5; gatidx < ngatwords; gatidx++)
+    {
+        word = gran->pinmap[gatidx];
+        if (gatidx == granno >> 5)
+        {
+            word &= 0xffffffff << (granno & 31);
+        }
+
+        if (word != 0)
+        {
+            gran->pinlow = (gatidx << 5) + __builtin_ctz(word);
+            break;
+        }
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_hint
+ *
+ * Description:
+ *   Allocate memory from the granule heap with a lifetime hint.
+ *
+ *   Each class has its own region of the heap, sized by the demand of the
+ *   class (see gran_hint_region()).  GRAN_HINT_SHORT allocations are
+ *   placed first fit in a region at the bottom of the heap.
+ *   GRAN_HINT_PINNED allocations are placed as high as possible.
+ *   GRAN_HINT_LONG allocations are placed best fit in a region right below
+ *   the lowest pinned allocation, at the top of the chosen free run, so
+ *   they pack downwards and the free space between the classes stays in
+ *   one piece.  The pinned region shrinks again when its lowest
+ *   allocations are freed.
+ *
+ *   An allocation that does not fit in its region spills into the rest
+ *   of the heap, next to the region first, and is counted in nfallback
+ *   of its class.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the memory region to allocate.
+ *   hint   - GRAN_HINT_SHORT, GRAN_HINT_LONG or GRAN_HINT_PINNED
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_hint(struct mm_gran *gran, size_t size, int hint)
+{
+    struct gran_hintinfo *info;
+    unsigned int          ngranules;
+    void                 *memory = NULL;
+    int                   granno;
+
+    assert(gran != NULL && hint >= 0 && hint < GRAN_HINT_NCLASSES);
+    assert(size <= 32 * GRAN_SIZE(gran));
+
+    info = &gran->hintinfo[hint];
+
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    ngranules = GRAN_NGRANULES(gran, size);
+
+    if (gran_enter_critical(gran) == 0)
+    {
+        gran_pin_update(gran);
+
+        if (hint == GRAN_HINT_SHORT)
+        {
+            gran_hint_region(gran, hint, ngranules);
+
+            granno = gran_range_search(gran, ngranules, 0, gran->shortend, 0);
+            if (granno < 0)
+            {
+                /* Spill just above the region, where it grows into */
+                granno = gran_range_search(gran, ngranules, gran->shortend, gran->ngranules, 0);
+                if (granno >= 0)
+                {
+                    __atomic_fetch_add(&info->nfallback, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+        else if (hint == GRAN_HINT_PINNED)
+        {
+            granno = -1;
+            if (gran->pinmap == NULL)
+            {
+                gran->pinmap = calloc(SIZEOF_GAT(gran->ngranules), sizeof(uint32_t));
+            }
+
+            if (gran->pinmap != NULL)
+            {
+                granno = gran_search_top(gran, ngranules, 0, gran->ngranules);
+            }
+
+            if (granno >= 0)
+            {
+                gran_pin_mark(gran, granno, ngranules);
+                if ((uint32_t)granno < gran->pinlow)
+                {
+                    gran->pinlow = granno;
+                }
+            }
+        }
+        else
+        {
+            gran_hint_region(gran, hint, ngranules);
+
+            granno = gran_search_best(gran, ngranules, gran->longstart, gran->pinlow);
+            if (granno < 0)
+            {
+                /* Spill just below the region, where it grows into, then
+                 * into the pinned region and last into the short one.
+                 */
+                granno = gran_search_top(gran, ngranules, gran->shortend, gran->longstart + ngranules - 1);
+                if (granno < 0)
+                {
+                    granno = gran_search_best(gran, ngranules, gran->longstart, gran->ngranules);
+                }
+
+                if (granno < 0)
+                {
+                    granno = gran_search_top(gran, ngranules, 0, gran->ngranules);
+                }
+
+                if (granno >= 0)
+                {
+                    __atomic_fetch_add(&info->nfallback, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+
+        if (granno >= 0)
+        {
+            memory = (void *)(gran->heapstart + ((uintptr_t)granno << GRAN_LOG2GRAN(gran)));
+            gran_mark_allocated(gran, (uintptr_t)memory, ngranules);
+        }
+
+        gran_leave_critical(gran);
+    }
+
+    if (memory == NULL)
+    {
+        __atomic_fetch_add(&info->nfail, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    __atomic_fetch_add(&info->nalloc, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&info->nlive, ngranules, __ATOMIC_RELAXED);
+    return memory;
+}
+
+/****************************************************************************
+ * Name: gran_free_hint
+ *
+ * Description:
+ *   Free memory allocated by gran_alloc_hint() and update the statistics
+ *   of its class.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   memory - Memory returned by gran_alloc_hint()
+ *   size   - The size passed to gran_alloc_hint()
+ *   hint   - The hint passed to gran_alloc_hint()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_hint(struct mm_gran *gran, void *memory, size_t size, int hint)
+{
+    assert(gran != NULL && hint >= 0 && hint < GRAN_HINT_NCLASSES);
+
+    gran_free(gran, memory, size);
+    __atomic_fetch_sub(&gran->hintinfo[hint].nlive, GRAN_NGRANULES(gran, size), __ATOMIC_RELAXED);
+}
+
+/****************************************************************************
+ * Name: gran_hint_info
+ *
+ * Description:
+ *   Return the statistics of one lifetime hint class.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   hint   - The hint class
+ *   info   - Returns the statistics
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_hint_info(struct mm_gran *gran, int hint, struct gran_hintinfo *info)
+{
+    struct gran_hintinfo *src;
+
+    assert(gran != NULL && hint >= 0 && hint < GRAN_HINT_NCLASSES && info != NULL);
+
+    src = &gran->hintinfo[hint];
+
+    info->nalloc    = __atomic_load_n(&src->nalloc, __ATOMIC_RELAXED);
+    info->nfail     = __atomic_load_n(&src->nfail, __ATOMIC_RELAXED);
+    info->nfallback = __atomic_load_n(&src->nfallback, __ATOMIC_RELAXED);
+    info->nlive     = __atomic_load_n(&src->nlive, __ATOMIC_RELAXED);
+}
+
+#endif /* CONFIG_GRAN */
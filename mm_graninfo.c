@@ -465,6 +465,114 @@ static void gran_hword_info(uint16_t value, struct valinfo_s *info,
  * Public Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: gran_update_run
+ *
+ * Description:
+ *   Recompute the free run summary of one GAT entry.  This must be called
+ *   whenever the GAT entry is modified.
+ *
+ * Input Parameters:
+ *   gran   - The granule heap state structure.
+ *   gatidx - The index of the modified GAT entry
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_update_run(struct mm_gran *gran, unsigned int gatidx)
+{
+  struct valinfo_s info;
+  uint32_t value;
+  uint32_t mask;
+  unsigned int nbits;
+  unsigned int mxfree;
+  uint8_t run;
+
+  /* The final entry may be partial.  Granules beyond the end of the heap
+   * are treated as allocated.
+   */
+
+  nbits = gran->ngranules - (gatidx << 5);
+  if (nbits >= 32)
+    {
+      nbits = 32;
+      mask  = 0xffffffff;
+    }
+  else
+    {
+      mask  = ((1ul << nbits) - 1);
+    }
+
+  value = gran->gat[gatidx] & mask;
+
+  /* Handle the 32-bit cases */
+
+  if (value == 0x00000000)
+    {
+      /* All free */
+
+      run = nbits | GRAN_RUN_LSFREE;
+      if (nbits == 32)
+        {
+          run |= GRAN_RUN_MSFREE;
+        }
+    }
+  else if (value == mask)
+    {
+      /* All allocated */
+
+      run = 0;
+    }
+  else
+    {
+      /* Some allocated */
+
+      gran_hword_info((uint16_t)(value & 0xffff), &info,
+                      nbits > 16 ? 16 : nbits);
+      if (nbits > 16)
+        {
+          struct valinfo_s msinfo;
+          unsigned int msbits = nbits - 16;
+
+          gran_hword_info((uint16_t)(value >> 16), &msinfo, msbits);
+          gran_info_combine(&msinfo, msbits, &info, 16);
+        }
+
+      /* The longest run may be internal or at either end */
+
+      mxfree = info.mxfree;
+      if (info.nlsfree > mxfree)
+        {
+          mxfree = info.nlsfree;
+        }
+
+      if (info.nmsfree > mxfree)
+        {
+          mxfree = info.nmsfree;
+        }
+
+      run = mxfree;
+      if (info.nlsfree > 0)
+        {
+          run |= GRAN_RUN_LSFREE;
+        }
+
+      if (info.nmsfree > 0 && nbits == 32)
+        {
+          run |= GRAN_RUN_MSFREE;
+        }
+    }
+
+  gran->gatrun[gatidx] = run;
+
+  if (gran->wmark != NULL)
+    {
+      gran_wmark_update(gran, gatidx);
+    }
+}
+
 /****************************************************************************
  * Name: gran_info
  *
@@ -499,6 +607,12 @@ void gran_info(struct mm_gran *gran, struct graninfo *info)
   info->mxfree     = 0;
   mxfree           = 0;
 
+  ret = gran_enter_critical(gran);
+  if (ret < 0)
+    {
+      return;
+    }
+
   /* Traverse the granule allocation  */
 
   for (granidx = 0; granidx < gran->ngranules; granidx += 32)
@@ -611,6 +725,15 @@ void gran_info(struct mm_gran *gran, struct graninfo *info)
     {
       info->mxfree = mxfree;
     }
+
+  gran_leave_critical(gran);
+
+  /* Add the other zones of a mixed granularity heap */
+
+  if (gran->zones != NULL)
+    {
+      gran_zone_info(gran, info);
+    }
 }
 
 #endif /* CONFIG_GRAN */
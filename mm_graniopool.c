@@ -0,0 +1,248 @@
+/****************************************************************************
+ * mm/mm_gran/mm_graniopool.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The heap is registered as one fixed buffer per naturally aligned region
+ * of 2**CONFIG_GRAN_IOPOOL_REGION_SHIFT bytes.  The kernel limits a single
+ * fixed buffer to 1 GiB.
+ */
+
+#ifndef CONFIG_GRAN_IOPOOL_REGION_SHIFT
+#  define CONFIG_GRAN_IOPOOL_REGION_SHIFT 30
+#endif
+
+#define IOPOOL_REGION_SIZE   ((uintptr_t)1 << CONFIG_GRAN_IOPOOL_REGION_SHIFT)
+#define IOPOOL_REGION(a)     ((uintptr_t)(a) >> CONFIG_GRAN_IOPOOL_REGION_SHIFT)
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_iopool_register
+ *
+ * Description:
+ *   Register the whole granule heap with an io_uring instance as fixed
+ *   buffers, so that IORING_OP_READ_FIXED/WRITE_FIXED can be used on
+ *   memory from gran_iopool_alloc() without pinning pages for each I/O.
+ *   The ring must not have any other buffers registered.  If ringfd is
+ *   negative, registration is skipped: buffers still never span two
+ *   regions, so the pool can be used with plain reads and writes where
+ *   io_uring is not available.
+ *
+ * Input Parameters:
+ *   pool   - The pool state to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *   ringfd - The io_uring file descriptor, or -1
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_iopool_register(struct gran_iopool *pool, struct mm_gran *gran, int ringfd)
+{
+    struct iovec *iov;
+    uintptr_t     heapend;
+    uintptr_t     region;
+    unsigned int  nbufs;
+    unsigned int  i;
+    int           ret;
+
+    assert(pool != NULL && gran != NULL && gran->ngranules > 0);
+
+    heapend = gran->heapstart + ((uintptr_t)gran->ngranules << GRAN_LOG2GRAN(gran));
+    nbufs   = IOPOOL_REGION(heapend - 1) - IOPOOL_REGION(gran->heapstart) + 1;
+
+    /* Without a ring the pool only keeps buffers inside one region */
+    if (ringfd >= 0)
+    {
+        iov = malloc(nbufs * sizeof(struct iovec));
+        if (iov == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        /* One iovec per region, clipped to the heap */
+        for (i = 0; i < nbufs; i++)
+        {
+            region = (IOPOOL_REGION(gran->heapstart) + i) << CONFIG_GRAN_IOPOOL_REGION_SHIFT;
+
+            iov[i].iov_base = (void *)(region > gran->heapstart ? region : gran->heapstart);
+            iov[i].iov_len  = (region + IOPOOL_REGION_SIZE < heapend ? region + IOPOOL_REGION_SIZE : heapend) -
+                              (uintptr_t)iov[i].iov_base;
+        }
+
+        ret = syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_BUFFERS, iov, nbufs);
+        free(iov);
+
+        if (ret < 0)
+        {
+            return -errno;
+        }
+    }
+
+    pool->gran   = gran;
+    pool->ringfd = ringfd;
+    pool->nbufs  = nbufs;
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_iopool_unregister
+ *
+ * Description:
+ *   Unregister the fixed buffers of the pool.  All I/O using them must
+ *   have completed.  Nothing is done if registration was skipped.
+ *
+ * Input Parameters:
+ *   pool - The pool state
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_iopool_unregister(struct gran_iopool *pool)
+{
+    assert(pool != NULL);
+
+    if (pool->ringfd >= 0 &&
+        syscall(__NR_io_uring_register, pool->ringfd, IORING_UNREGISTER_BUFFERS, NULL, 0) < 0)
+    {
+        return -errno;
+    }
+
+    pool->nbufs = 0;
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_iopool_alloc
+ *
+ * Description:
+ *   Allocate an I/O buffer from the pool.  The buffer never spans two
+ *   registered regions, so it can be used with the fixed buffer index
+ *   that is returned.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   size   - The size of the buffer
+ *   bufidx - Returns the index to place in the buf_index field of the SQE
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the buffer is returned; NULL is
+ *   returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_iopool_alloc(struct gran_iopool *pool, size_t size, unsigned int *bufidx)
+{
+    void *mem;
+
+    assert(pool != NULL && bufidx != NULL && pool->nbufs > 0);
+
+    if (pool->nbufs == 1)
+    {
+        mem = gran_alloc_local(pool->gran, size);
+    }
+    else
+    {
+        mem = gran_alloc_constrained(pool->gran, size, 0, UINTPTR_MAX, IOPOOL_REGION_SIZE);
+    }
+
+    if (mem != NULL)
+    {
+        *bufidx = gran_iopool_bufindex(pool, mem);
+    }
+
+    return mem;
+}
+
+/****************************************************************************
+ * Name: gran_iopool_bufindex
+ *
+ * Description:
+ *   Return the fixed buffer index that covers an address in the pool.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   memory - An address inside the heap
+ *
+ * Returned Value:
+ *   The fixed buffer index.
+ *
+ ****************************************************************************/
+
+unsigned int gran_iopool_bufindex(struct gran_iopool *pool, const void *memory)
+{
+    return IOPOOL_REGION(memory) - IOPOOL_REGION(pool->gran->heapstart);
+}
+
+/****************************************************************************
+ * Name: gran_iopool_free
+ *
+ * Description:
+ *   Return an I/O buffer to the pool.
+ *
+ * Input Parameters:
+ *   pool   - The pool state
+ *   memory - A buffer previously returned by gran_iopool_alloc()
+ *   size   - The size that was passed to gran_iopool_alloc()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_iopool_free(struct gran_iopool *pool, void *memory, size_t size)
+{
+    assert(pool != NULL);
+
+    gran_free(pool->gran, memory, size);
+}
+
+#endif /* CONFIG_GRAN */
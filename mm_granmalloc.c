@@ -0,0 +1,584 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granmalloc.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/* malloc() interposer built on one page granule heap.  Build it as a shared
+ * library from this file and all other mm_gran*.c files and load it with
+ * LD_PRELOAD:
+ *
+ *   ./granmalloc_compare.sh --build
+ *   LD_PRELOAD=./libgranmalloc.so <command>
+ *
+ * -fno-builtin keeps the compiler from turning the malloc()+memset() in
+ * calloc() back into a call to calloc().
+ *
+ * Requests up to GRANMALLOC_MAXSLAB bytes are served from per size class
+ * slabs of one granule each; a slab granule stays with its class once it
+ * has been carved.  Larger requests up to the 32 granule limit are served
+ * by gran_alloc() directly and anything larger (or anything that does not
+ * fit once the heap is exhausted) is mapped with mmap().
+ *
+ * The size of the reserved heap can be set in MiB with the environment
+ * variable GRAN_MALLOC_HEAP_MB.
+ */
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define GRANMALLOC_LOG2GRAN   12
+#define GRANMALLOC_GRANSIZE   (1 << GRANMALLOC_LOG2GRAN)
+#define GRANMALLOC_MAXRUN     (32 * GRANMALLOC_GRANSIZE)
+#define GRANMALLOC_HEAP_MB    1024
+#define GRANMALLOC_MAXSLAB    2048
+#define GRANMALLOC_NCLASSES   14
+#define GRANMALLOC_ALIGN      16
+
+/* Granule tags.  A tag of 1..32 marks the first granule of a run of that
+ * many granules; a slab granule has GRANMALLOC_SLAB set plus its class.
+ */
+
+#define GRANMALLOC_SLAB       0x80
+#define GRANMALLOC_CLASS(t)   ((t) & 0x7f)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Header in front of allocations that are mapped directly */
+
+struct granmalloc_map_s
+{
+    uintptr_t base;     /* Start of the mapping */
+    size_t    maplen;   /* Length of the mapping */
+    size_t    reserved[2];
+};
+
+/* Free slab objects are linked through their first word */
+
+struct granmalloc_free_s
+{
+    struct granmalloc_free_s *flink;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static const uint16_t g_slabsize[GRANMALLOC_NCLASSES] =
+{
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+static pthread_mutex_t g_granmalloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct granmalloc_free_s *g_slabfree[GRANMALLOC_NCLASSES];
+static struct mm_gran *g_granmalloc_heap;
+static uint8_t *g_granmalloc_tags;
+static uintptr_t g_heapstart;
+static uintptr_t g_heapend;
+static int g_initialized;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void granmalloc_initialize(void)
+{
+    const char *env;
+    size_t      heapsize;
+    void       *heap;
+    void       *tags;
+
+    heapsize = (size_t)GRANMALLOC_HEAP_MB << 20;
+    env = getenv("GRAN_MALLOC_HEAP_MB");
+    if (env != NULL && atol(env) > 0)
+    {
+        heapsize = (size_t)atol(env) << 20;
+    }
+
+    /* Reserve the heap; pages are only populated when touched */
+    heap = mmap(NULL, heapsize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED)
+    {
+        return;
+    }
+
+    g_granmalloc_heap = gran_initialize(heap, heapsize, GRANMALLOC_LOG2GRAN, GRANMALLOC_LOG2GRAN);
+
+    tags = mmap(NULL, g_granmalloc_heap->ngranules, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (tags == MAP_FAILED)
+    {
+        munmap(heap, heapsize);
+        g_granmalloc_heap = NULL;
+        return;
+    }
+
+    g_granmalloc_tags = tags;
+    g_heapstart = g_granmalloc_heap->heapstart;
+    g_heapend   = g_heapstart + ((uintptr_t)g_granmalloc_heap->ngranules << GRANMALLOC_LOG2GRAN);
+}
+
+/* Fork handlers.  The child must not inherit the interposer lock or the
+ * heap lock in the locked state from another thread, so both are taken
+ * around fork() and released again on both sides.
+ */
+
+static void granmalloc_prepare(void)
+{
+    pthread_mutex_lock(&g_granmalloc_lock);
+    if (g_granmalloc_heap != NULL)
+    {
+        gran_enter_critical(g_granmalloc_heap);
+    }
+}
+
+static void granmalloc_release(void)
+{
+    if (g_granmalloc_heap != NULL)
+    {
+        gran_leave_critical(g_granmalloc_heap);
+    }
+
+    pthread_mutex_unlock(&g_granmalloc_lock);
+}
+
+/* pthread_atfork() may itself allocate, so it is called from a library
+ * constructor rather than with the lock held.
+ */
+
+static void __attribute__((constructor)) granmalloc_atfork(void)
+{
+    pthread_atfork(granmalloc_prepare, granmalloc_release, granmalloc_release);
+}
+
+/* Take the lock and set up the heap on first use.  Returns false if there
+ * is no granule heap, in which case everything is mapped directly.
+ */
+
+static int granmalloc_lock(void)
+{
+    pthread_mutex_lock(&g_granmalloc_lock);
+    if (!g_initialized)
+    {
+        g_initialized = 1;
+        granmalloc_initialize();
+    }
+
+    return g_granmalloc_heap != NULL;
+}
+
+static void granmalloc_unlock(void)
+{
+    pthread_mutex_unlock(&g_granmalloc_lock);
+}
+
+static int granmalloc_inheap(const void *mem)
+{
+    return (uintptr_t)mem >= g_heapstart && (uintptr_t)mem < g_heapend;
+}
+
+static unsigned int granmalloc_granno(const void *mem)
+{
+    return ((uintptr_t)mem - g_heapstart) >> GRANMALLOC_LOG2GRAN;
+}
+
+static int granmalloc_class(size_t size)
+{
+    int cls;
+
+    for (cls = 0; g_slabsize[cls] < size; cls++);
+    return cls;
+}
+
+static void *granmalloc_slab(int cls)
+{
+    struct granmalloc_free_s *obj;
+    uint8_t *page;
+    size_t   objsize;
+    size_t   offset;
+
+    if (!granmalloc_lock())
+    {
+        granmalloc_unlock();
+        return NULL;
+    }
+
+    /* Carve a new granule into objects if the class is empty */
+    if (g_slabfree[cls] == NULL)
+    {
+        page = gran_alloc(g_granmalloc_heap, GRANMALLOC_GRANSIZE);
+        if (page == NULL)
+        {
+            granmalloc_unlock();
+            return NULL;
+        }
+
+        g_granmalloc_tags[granmalloc_granno(page)] = GRANMALLOC_SLAB | cls;
+
+        objsize = g_slabsize[cls];
+        for (offset = 0; offset + objsize <= GRANMALLOC_GRANSIZE; offset += objsize)
+        {
+            obj = (struct granmalloc_free_s *)(page + offset);
+            obj->flink = g_slabfree[cls];
+            g_slabfree[cls] = obj;
+        }
+    }
+
+    obj = g_slabfree[cls];
+    g_slabfree[cls] = obj->flink;
+    granmalloc_unlock();
+    return obj;
+}
+
+static void *granmalloc_run(size_t size)
+{
+    void *mem;
+
+    if (!granmalloc_lock())
+    {
+        granmalloc_unlock();
+        return NULL;
+    }
+
+    mem = gran_alloc(g_granmalloc_heap, size);
+    if (mem != NULL)
+    {
+        g_granmalloc_tags[granmalloc_granno(mem)] = (size + GRANMALLOC_GRANSIZE - 1) >> GRANMALLOC_LOG2GRAN;
+    }
+
+    granmalloc_unlock();
+    return mem;
+}
+
+static void *granmalloc_map(size_t size, size_t align)
+{
+    struct granmalloc_map_s *hdr;
+    uintptr_t base;
+    uintptr_t mem;
+    size_t    maplen;
+
+    if (align < GRANMALLOC_ALIGN)
+    {
+        align = GRANMALLOC_ALIGN;
+    }
+
+    if (size > SIZE_MAX - sizeof(struct granmalloc_map_s) - align - GRANMALLOC_GRANSIZE)
+    {
+        return NULL;
+    }
+
+    maplen = (size + sizeof(struct granmalloc_map_s) + align - 1 + GRANMALLOC_GRANSIZE - 1) &
+             ~((size_t)GRANMALLOC_GRANSIZE - 1);
+    base = (uintptr_t)mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    mem = (base + sizeof(struct granmalloc_map_s) + align - 1) & ~(align - 1);
+    hdr = (struct granmalloc_map_s *)mem - 1;
+    hdr->base   = base;
+    hdr->maplen = maplen;
+    return (void *)mem;
+}
+
+static size_t granmalloc_usable(void *mem)
+{
+    struct granmalloc_map_s *hdr;
+    uint8_t tag;
+
+    if (granmalloc_inheap(mem))
+    {
+        tag = g_granmalloc_tags[granmalloc_granno(mem)];
+        if (tag & GRANMALLOC_SLAB)
+        {
+            return g_slabsize[GRANMALLOC_CLASS(tag)];
+        }
+
+        return (size_t)tag << GRANMALLOC_LOG2GRAN;
+    }
+
+    hdr = (struct granmalloc_map_s *)mem - 1;
+    return hdr->base + hdr->maplen - (uintptr_t)mem;
+}
+
+static void *granmalloc_alloc(size_t size, size_t align)
+{
+    void *mem = NULL;
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    if (align <= GRANMALLOC_ALIGN && size <= GRANMALLOC_MAXSLAB)
+    {
+        mem = granmalloc_slab(granmalloc_class(size));
+    }
+    else if (align <= GRANMALLOC_GRANSIZE && size <= GRANMALLOC_MAXRUN)
+    {
+        mem = granmalloc_run(size);
+    }
+
+    if (mem == NULL)
+    {
+        mem = granmalloc_map(size, align);
+    }
+
+    return mem;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+void *malloc(size_t size)
+{
+    void *mem = granmalloc_alloc(size, GRANMALLOC_ALIGN);
+
+    if (mem == NULL)
+    {
+        errno = ENOMEM;
+    }
+
+    return mem;
+}
+
+void free(void *mem)
+{
+    struct granmalloc_map_s *hdr;
+    struct granmalloc_free_s *obj;
+    unsigned int granno;
+    uint8_t tag;
+
+    if (mem == NULL)
+    {
+        return;
+    }
+
+    if (!granmalloc_inheap(mem))
+    {
+        hdr = (struct granmalloc_map_s *)mem - 1;
+        munmap((void *)hdr->base, hdr->maplen);
+        return;
+    }
+
+    granmalloc_lock();
+    granno = granmalloc_granno(mem);
+    tag    = g_granmalloc_tags[granno];
+    if (tag & GRANMALLOC_SLAB)
+    {
+        obj = mem;
+        obj->flink = g_slabfree[GRANMALLOC_CLASS(tag)];
+        g_slabfree[GRANMALLOC_CLASS(tag)] = obj;
+    }
+    else
+    {
+        g_granmalloc_tags[granno] = 0;
+        gran_free(g_granmalloc_heap, mem, (size_t)tag << GRANMALLOC_LOG2GRAN);
+    }
+
+    granmalloc_unlock();
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t total;
+    void  *mem;
+
+    if (__builtin_mul_overflow(nmemb, size, &total))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mem = malloc(total);
+
+    /* Fresh mappings are already zero */
+    if (mem != NULL && granmalloc_inheap(mem))
+    {
+        memset(mem, 0, total);
+    }
+
+    return mem;
+}
+
+void *realloc(void *mem, size_t size)
+{
+    unsigned int granno;
+    size_t usable;
+    void  *newmem;
+    uint8_t tag;
+
+    if (mem == NULL)
+    {
+        return malloc(size);
+    }
+
+    if (size == 0)
+    {
+        free(mem);
+        return NULL;
+    }
+
+    usable = granmalloc_usable(mem);
+    if (size <= usable && size >= usable / 2)
+    {
+        return mem;
+    }
+
+    /* Granule runs can often grow or shrink in place */
+    if (granmalloc_inheap(mem) && size > GRANMALLOC_MAXSLAB && size <= GRANMALLOC_MAXRUN)
+    {
+        granmalloc_lock();
+        granno = granmalloc_granno(mem);
+        tag    = g_granmalloc_tags[granno];
+        if (!(tag & GRANMALLOC_SLAB) &&
+            gran_extend(g_granmalloc_heap, mem, (size_t)tag << GRANMALLOC_LOG2GRAN, size) == 0)
+        {
+            g_granmalloc_tags[granno] = (size + GRANMALLOC_GRANSIZE - 1) >> GRANMALLOC_LOG2GRAN;
+            granmalloc_unlock();
+            return mem;
+        }
+
+        granmalloc_unlock();
+    }
+
+    newmem = malloc(size);
+    if (newmem != NULL)
+    {
+        memcpy(newmem, mem, usable < size ? usable : size);
+        free(mem);
+    }
+
+    return newmem;
+}
+
+void *reallocarray(void *mem, size_t nmemb, size_t size)
+{
+    size_t total;
+
+    if (__builtin_mul_overflow(nmemb, size, &total))
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return realloc(mem, total);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+        alignment % sizeof(void *) != 0)
+    {
+        return EINVAL;
+    }
+
+    mem = granmalloc_alloc(size, alignment);
+    if (mem == NULL)
+    {
+        return ENOMEM;
+    }
+
+    *memptr = mem;
+    return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    mem = granmalloc_alloc(size, alignment);
+    if (mem == NULL)
+    {
+        errno = ENOMEM;
+    }
+
+    return mem;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    return aligned_alloc(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned_alloc(GRANMALLOC_GRANSIZE, size);
+}
+
+void *pvalloc(size_t size)
+{
+    return aligned_alloc(GRANMALLOC_GRANSIZE,
+                         (size + GRANMALLOC_GRANSIZE - 1) & ~((size_t)GRANMALLOC_GRANSIZE - 1));
+}
+
+size_t malloc_usable_size(void *mem)
+{
+    size_t usable;
+
+    if (mem == NULL)
+    {
+        return 0;
+    }
+
+    if (!granmalloc_inheap(mem))
+    {
+        return granmalloc_usable(mem);
+    }
+
+    granmalloc_lock();
+    usable = granmalloc_usable(mem);
+    granmalloc_unlock();
+    return usable;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,414 @@
+/****************************************************************************
+ * mm/mm_gran/mm_grannuma.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Node masks are a single unsigned long */
+
+#define GRAN_NUMA_MAXNODES  (8 * sizeof(unsigned long))
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Return the number of NUMA nodes of the system */
+
+static unsigned int gran_numa_nnodes(void)
+{
+    char         buf[64];
+    char        *last;
+    unsigned int nnodes = 1;
+    FILE        *stream;
+
+    /* The file holds a list of ranges such as "0" or "0-1" */
+    stream = fopen("/sys/devices/system/node/online", "r");
+    if (stream != NULL)
+    {
+        if (fgets(buf, sizeof(buf), stream) != NULL)
+        {
+            last = buf + strcspn(buf, "\n");
+            while (last > buf && last[-1] >= '0' && last[-1] <= '9')
+            {
+                last--;
+            }
+
+            nnodes = atoi(last) + 1;
+        }
+
+        fclose(stream);
+    }
+
+    return nnodes;
+}
+
+/* Return the node of the calling CPU */
+
+static unsigned int gran_numa_curnode(struct gran_numa *numa)
+{
+    unsigned int cpu  = 0;
+    unsigned int node = 0;
+
+    syscall(SYS_getcpu, &cpu, &node, NULL);
+
+    /* A simulated topology spreads the CPUs over the nodes */
+    if (numa->flags & GRAN_NUMA_SIMULATE)
+    {
+        node = cpu % numa->nnodes;
+    }
+
+    return node < numa->nnodes ? node : 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_numa_initialize
+ *
+ * Description:
+ *   Create one granule heap per NUMA node.  One address range is reserved
+ *   for all sub-heaps and each slice of nodesize bytes is bound to its
+ *   node with mbind(MPOL_BIND) before it is touched.  With
+ *   GRAN_NUMA_INTERLEAVE one more slice is added with MPOL_INTERLEAVE over
+ *   all nodes, for tables shared by every node.
+ *
+ *   With GRAN_NUMA_SIMULATE no memory policy is applied and the CPUs are
+ *   assigned to the nnodes nodes round robin, so the node selection and
+ *   fallback logic can be exercised on a single node machine.
+ *
+ * Input Parameters:
+ *   nodesize - Size of each sub-heap in bytes
+ *   log2gran - Log base 2 of the size of one granule
+ *   nnodes   - Number of nodes, or 0 to use the nodes of the system
+ *   flags    - GRAN_NUMA_INTERLEAVE and/or GRAN_NUMA_SIMULATE
+ *
+ * Returned Value:
+ *   A handle for the other gran_numa interfaces, or NULL on failure.
+ *
+ ****************************************************************************/
+
+struct gran_numa *gran_numa_initialize(size_t nodesize, uint8_t log2gran,
+                                       unsigned int nnodes, unsigned int flags)
+{
+    struct gran_numa *numa;
+    unsigned long     nodemask;
+    unsigned int      nslices;
+    unsigned int      i;
+    size_t            pagesize;
+    void             *base;
+    void             *slice;
+
+    assert(nodesize > 0);
+
+    if (nnodes == 0)
+    {
+        nnodes = gran_numa_nnodes();
+    }
+
+    if (nnodes == 0 || nnodes > GRAN_NUMA_MAXNODES)
+    {
+        return NULL;
+    }
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    nodesize = (nodesize + pagesize - 1) & ~(pagesize - 1);
+    nslices  = nnodes + ((flags & GRAN_NUMA_INTERLEAVE) ? 1 : 0);
+
+    numa = calloc(1, sizeof(struct gran_numa) + (nnodes - 1) * sizeof(struct gran_numa_node));
+    if (numa == NULL)
+    {
+        return NULL;
+    }
+
+    base = mmap(NULL, nslices * nodesize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        free(numa);
+        return NULL;
+    }
+
+    numa->base     = (uintptr_t)base;
+    numa->nodesize = nodesize;
+    numa->mapsize  = nslices * nodesize;
+    numa->nnodes   = nnodes;
+    numa->flags    = flags;
+
+    for (i = 0; i < nslices; i++)
+    {
+        slice = (void *)(numa->base + i * nodesize);
+
+        /* Set the policy before gran_initialize() faults the pages in */
+        if (!(flags & GRAN_NUMA_SIMULATE))
+        {
+            if (i < nnodes)
+            {
+                nodemask = 1ul << i;
+                if (syscall(SYS_mbind, slice, nodesize, MPOL_BIND, &nodemask,
+                            GRAN_NUMA_MAXNODES, 0) < 0)
+                {
+                    goto errout;
+                }
+            }
+            else
+            {
+                nodemask = nnodes == GRAN_NUMA_MAXNODES ? ~0ul : (1ul << nnodes) - 1;
+                if (syscall(SYS_mbind, slice, nodesize, MPOL_INTERLEAVE, &nodemask,
+                            GRAN_NUMA_MAXNODES, 0) < 0)
+                {
+                    goto errout;
+                }
+            }
+        }
+
+        if (i < nnodes)
+        {
+            numa->node[i].gran = gran_initialize(slice, nodesize, log2gran, log2gran);
+            if (numa->node[i].gran == NULL)
+            {
+                goto errout;
+            }
+        }
+        else
+        {
+            numa->interleave = gran_initialize(slice, nodesize, log2gran, log2gran);
+            if (numa->interleave == NULL)
+            {
+                goto errout;
+            }
+        }
+    }
+
+    return numa;
+
+errout:
+    gran_numa_release(numa);
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_numa_release
+ *
+ * Description:
+ *   Release all sub-heaps of a NUMA heap set and unmap them.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_numa_release(struct gran_numa *numa)
+{
+    unsigned int i;
+
+    assert(numa != NULL);
+
+    for (i = 0; i < numa->nnodes; i++)
+    {
+        if (numa->node[i].gran != NULL)
+        {
+            gran_release(numa->node[i].gran);
+        }
+    }
+
+    if (numa->interleave != NULL)
+    {
+        gran_release(numa->interleave);
+    }
+
+    munmap((void *)numa->base, numa->mapsize);
+    free(numa);
+}
+
+/****************************************************************************
+ * Name: gran_numa_alloc
+ *
+ * Description:
+ *   Allocate from the sub-heap of the calling CPU's node.  If it is full,
+ *   the other nodes are tried in order and the allocation is counted as a
+ *   remote hit of the caller's node.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+void *gran_numa_alloc(struct gran_numa *numa, size_t size)
+{
+    unsigned int node;
+    unsigned int i;
+    void        *memory;
+
+    assert(numa != NULL);
+
+    node   = gran_numa_curnode(numa);
+    memory = gran_alloc(numa->node[node].gran, size);
+    if (memory != NULL)
+    {
+        __atomic_fetch_add(&numa->node[node].nlocal, 1, __ATOMIC_RELAXED);
+        return memory;
+    }
+
+    for (i = 1; i < numa->nnodes; i++)
+    {
+        memory = gran_alloc(numa->node[(node + i) % numa->nnodes].gran, size);
+        if (memory != NULL)
+        {
+            __atomic_fetch_add(&numa->node[node].nremote, 1, __ATOMIC_RELAXED);
+            return memory;
+        }
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_numa_alloc_interleaved
+ *
+ * Description:
+ *   Allocate from the interleaved sub-heap, for data shared by all nodes.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   size - The size of the memory region to allocate.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned on failure or without GRAN_NUMA_INTERLEAVE.
+ *
+ ****************************************************************************/
+
+void *gran_numa_alloc_interleaved(struct gran_numa *numa, size_t size)
+{
+    assert(numa != NULL);
+
+    if (numa->interleave == NULL)
+    {
+        return NULL;
+    }
+
+    return gran_alloc(numa->interleave, size);
+}
+
+/****************************************************************************
+ * Name: gran_numa_free
+ *
+ * Description:
+ *   Return memory to the sub-heap that contains it.  The sub-heap is found
+ *   from the address alone.
+ *
+ * Input Parameters:
+ *   numa   - The handle returned by gran_numa_initialize
+ *   memory - Memory returned by gran_numa_alloc*()
+ *   size   - The size passed when it was allocated
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_numa_free(struct gran_numa *numa, void *memory, size_t size)
+{
+    unsigned int slice;
+
+    assert(numa != NULL && (uintptr_t)memory - numa->base < numa->mapsize);
+
+    slice = ((uintptr_t)memory - numa->base) / numa->nodesize;
+    if (slice < numa->nnodes)
+    {
+        gran_free(numa->node[slice].gran, memory, size);
+    }
+    else
+    {
+        gran_free(numa->interleave, memory, size);
+    }
+}
+
+/****************************************************************************
+ * Name: gran_numa_info
+ *
+ * Description:
+ *   Return the allocation statistics and free space of one node.
+ *
+ * Input Parameters:
+ *   numa - The handle returned by gran_numa_initialize
+ *   node - The node
+ *   info - Returns the statistics
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if there is no such node.
+ *
+ ****************************************************************************/
+
+int gran_numa_info(struct gran_numa *numa, unsigned int node, struct gran_numa_info *info)
+{
+    struct graninfo graninfo;
+
+    assert(numa != NULL && info != NULL);
+
+    if (node >= numa->nnodes)
+    {
+        return -EINVAL;
+    }
+
+    gran_info(numa->node[node].gran, &graninfo);
+
+    info->nlocal  = __atomic_load_n(&numa->node[node].nlocal, __ATOMIC_RELAXED);
+    info->nremote = __atomic_load_n(&numa->node[node].nremote, __ATOMIC_RELAXED);
+    info->nfree   = graninfo.nfree;
+    info->mxfree  = graninfo.mxfree;
+    return 0;
+}
+
+#endif /* CONFIG_GRAN */
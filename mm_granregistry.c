@@ -0,0 +1,338 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granregistry.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The address space is split into chunks of 2**CONFIG_GRAN_REGISTRY_SHIFT
+ * bytes.  A two level radix table maps each chunk to the heap that covers
+ * it.  The second level tables are allocated when a heap is registered.
+ */
+
+#ifndef CONFIG_GRAN_REGISTRY_SHIFT
+#  define CONFIG_GRAN_REGISTRY_SHIFT 20
+#endif
+
+#ifndef CONFIG_GRAN_REGISTRY_NHEAPS
+#  define CONFIG_GRAN_REGISTRY_NHEAPS 8
+#endif
+
+#if UINTPTR_MAX > 0xffffffff
+#  define REGISTRY_ADDRBITS  48
+#else
+#  define REGISTRY_ADDRBITS  32
+#endif
+
+#define REGISTRY_CHUNKBITS   (REGISTRY_ADDRBITS - CONFIG_GRAN_REGISTRY_SHIFT)
+#define REGISTRY_L2BITS      (REGISTRY_CHUNKBITS / 2)
+#define REGISTRY_L1BITS      (REGISTRY_CHUNKBITS - REGISTRY_L2BITS)
+#define REGISTRY_L1SIZE      (1 << REGISTRY_L1BITS)
+#define REGISTRY_L2SIZE      (1 << REGISTRY_L2BITS)
+
+#define REGISTRY_CHUNK(a)    ((uintptr_t)(a) >> CONFIG_GRAN_REGISTRY_SHIFT)
+#define REGISTRY_L1IDX(c)    (((c) >> REGISTRY_L2BITS) & (REGISTRY_L1SIZE - 1))
+#define REGISTRY_L2IDX(c)    ((c) & (REGISTRY_L2SIZE - 1))
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Readers only use atomic loads.  Writers are serialized by g_reglock. */
+
+static struct mm_gran **g_registry[REGISTRY_L1SIZE];
+static struct mm_gran *g_regheaps[CONFIG_GRAN_REGISTRY_NHEAPS];
+static pthread_mutex_t g_reglock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* A mixed granularity heap is registered with all of its zones, so that
+ * gran_free() of the heap handle routes the memory to its zone.
+ */
+
+static uintptr_t gran_heapend(struct mm_gran *gran)
+{
+    return gran_zone_end(gran);
+}
+
+static int gran_contains(struct mm_gran *gran, uintptr_t addr)
+{
+    return gran != NULL && addr >= gran->heapstart && addr < gran_heapend(gran);
+}
+
+/* Point every chunk covered by the heap that is not yet claimed at the
+ * heap.  Chunks shared with another heap keep their first owner; lookups
+ * of the other heap in such a chunk fall back to a scan of g_regheaps.
+ */
+
+static int gran_registry_fill(struct mm_gran *gran)
+{
+    struct mm_gran **l2;
+    uintptr_t chunk;
+    uintptr_t last;
+
+    last = REGISTRY_CHUNK(gran_heapend(gran) - 1);
+    for (chunk = REGISTRY_CHUNK(gran->heapstart); chunk <= last; chunk++)
+    {
+        l2 = g_registry[REGISTRY_L1IDX(chunk)];
+        if (l2 == NULL)
+        {
+            l2 = calloc(REGISTRY_L2SIZE, sizeof(struct mm_gran *));
+            if (l2 == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            __atomic_store_n(&g_registry[REGISTRY_L1IDX(chunk)], l2, __ATOMIC_RELEASE);
+        }
+
+        if (l2[REGISTRY_L2IDX(chunk)] == NULL)
+        {
+            __atomic_store_n(&l2[REGISTRY_L2IDX(chunk)], gran, __ATOMIC_RELEASE);
+        }
+    }
+
+    return 0;
+}
+
+static void gran_registry_clear(struct mm_gran *gran)
+{
+    struct mm_gran **l2;
+    uintptr_t chunk;
+    uintptr_t last;
+
+    last = REGISTRY_CHUNK(gran_heapend(gran) - 1);
+    for (chunk = REGISTRY_CHUNK(gran->heapstart); chunk <= last; chunk++)
+    {
+        l2 = g_registry[REGISTRY_L1IDX(chunk)];
+        if (l2 != NULL && l2[REGISTRY_L2IDX(chunk)] == gran)
+        {
+            __atomic_store_n(&l2[REGISTRY_L2IDX(chunk)], NULL, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_register
+ *
+ * Description:
+ *   Add a heap to the registry used by gran_lookup() and gran_free_any().
+ *   Registration is expected to be rare; it takes a lock and may allocate
+ *   radix table pages.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EEXIST is returned if the heap is
+ *   already registered and -ENOMEM if the registry is full or a table
+ *   could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_register(struct mm_gran *gran)
+{
+    int ret = -ENOMEM;
+    int i;
+
+    assert(gran != NULL && gran->ngranules > 0);
+
+    pthread_mutex_lock(&g_reglock);
+
+    for (i = 0; i < CONFIG_GRAN_REGISTRY_NHEAPS; i++)
+    {
+        if (g_regheaps[i] == gran)
+        {
+            pthread_mutex_unlock(&g_reglock);
+            return -EEXIST;
+        }
+    }
+
+    for (i = 0; i < CONFIG_GRAN_REGISTRY_NHEAPS; i++)
+    {
+        if (g_regheaps[i] == NULL)
+        {
+            ret = gran_registry_fill(gran);
+            if (ret < 0)
+            {
+                gran_registry_clear(gran);
+                break;
+            }
+
+            __atomic_store_n(&g_regheaps[i], gran, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&g_reglock);
+    return ret;
+}
+
+/****************************************************************************
+ * Name: gran_unregister
+ *
+ * Description:
+ *   Remove a heap from the registry.  The caller must make sure that no
+ *   other thread is still looking up addresses in the heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_unregister(struct mm_gran *gran)
+{
+    int i;
+
+    assert(gran != NULL);
+
+    pthread_mutex_lock(&g_reglock);
+
+    for (i = 0; i < CONFIG_GRAN_REGISTRY_NHEAPS; i++)
+    {
+        if (g_regheaps[i] == gran)
+        {
+            __atomic_store_n(&g_regheaps[i], NULL, __ATOMIC_RELEASE);
+        }
+    }
+
+    gran_registry_clear(gran);
+
+    /* Hand chunks that were shared with this heap to their other owner.
+     * The tables already exist, so this cannot fail.
+     */
+    for (i = 0; i < CONFIG_GRAN_REGISTRY_NHEAPS; i++)
+    {
+        if (g_regheaps[i] != NULL)
+        {
+            gran_registry_fill(g_regheaps[i]);
+        }
+    }
+
+    pthread_mutex_unlock(&g_reglock);
+}
+
+/****************************************************************************
+ * Name: gran_lookup
+ *
+ * Description:
+ *   Find the registered heap that contains an address.  This takes no lock:
+ *   normally it is two table loads and a range check.
+ *
+ * Input Parameters:
+ *   memory - Any address
+ *
+ * Returned Value:
+ *   The heap that contains the address, or NULL if there is none.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_lookup(const void *memory)
+{
+    struct mm_gran **l2;
+    struct mm_gran *gran;
+    uintptr_t addr = (uintptr_t)memory;
+    uintptr_t chunk = REGISTRY_CHUNK(addr);
+    int i;
+
+    if ((chunk >> REGISTRY_CHUNKBITS) == 0)
+    {
+        l2 = __atomic_load_n(&g_registry[REGISTRY_L1IDX(chunk)], __ATOMIC_ACQUIRE);
+        if (l2 != NULL)
+        {
+            gran = __atomic_load_n(&l2[REGISTRY_L2IDX(chunk)], __ATOMIC_ACQUIRE);
+            if (gran_contains(gran, addr))
+            {
+                return gran;
+            }
+        }
+    }
+
+    /* A chunk shared by two heaps, an address beyond the table, or a chunk
+     * that gran_unregister() is handing over to its other owner.
+     */
+    for (i = 0; i < CONFIG_GRAN_REGISTRY_NHEAPS; i++)
+    {
+        gran = __atomic_load_n(&g_regheaps[i], __ATOMIC_ACQUIRE);
+        if (gran_contains(gran, addr))
+        {
+            return gran;
+        }
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_free_any
+ *
+ * Description:
+ *   Return memory to whichever registered heap it was allocated from.
+ *
+ * Input Parameters:
+ *   memory - A pointer to memory previously allocated by gran_alloc.
+ *   size   - The size that was passed to gran_alloc.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_any(void *memory, size_t size)
+{
+    struct mm_gran *gran;
+
+    gran = gran_lookup(memory);
+    assert(gran != NULL);
+
+    if (gran != NULL)
+    {
+        gran_free(gran, memory, size);
+    }
+}
+
+#endif /* CONFIG_GRAN */
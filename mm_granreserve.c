@@ -0,0 +1,126 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granreserve.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_reserve
+ *
+ * Description:
+ *   Reserve memory in the granule heap.  This will reserve the granules
+ *   that contain the start and end addresses plus all of the granules
+ *   in between.  This should be done early in the initialization sequence
+ *   before any other allocations are made.
+ *
+ *   Reserved memory can never be allocated (it can be freed however which
+ *   essentially unreserves the memory).  Reserved granules are remembered
+ *   in a side bitmap so that gran_reset() leaves them allocated.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   start  - The address of the beginning of the region to be reserved.
+ *   size   - The size of the region to be reserved
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the side
+ *   bitmap could not be allocated, in which case nothing is reserved.
+ *
+ ****************************************************************************/
+
+int gran_reserve(struct mm_gran *gran, uintptr_t start, size_t size)
+{
+    unsigned int granno;
+    unsigned int endgran;
+    unsigned int gatidx;
+    unsigned int gatbit;
+    unsigned int nbits;
+    uint32_t     gatmask;
+    int          ret;
+
+    assert(gran != NULL && start >= gran->heapstart);
+
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    /* Determine the granules that contain the first and last bytes */
+    granno  = (start - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+    endgran = ((start + size - 1 - gran->heapstart) >> GRAN_LOG2GRAN(gran)) + 1;
+    assert(endgran <= gran->ngranules);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    if (gran->resv == NULL)
+    {
+        gran->resv = calloc(SIZEOF_GAT(gran->ngranules), sizeof(uint32_t));
+        if (gran->resv == NULL)
+        {
+            gran_leave_critical(gran);
+            return -ENOMEM;
+        }
+    }
+
+    /* Set the bits one GAT entry at a time.  Reserved granules are not
+     * tagged with an epoch.
+     */
+    while (granno < endgran)
+    {
+        gatidx  = granno >> 5;
+        gatbit  = granno & 31;
+        nbits   = endgran - granno < 32 - gatbit ? endgran - granno : 32 - gatbit;
+        gatmask = (0xffffffff >> (32 - nbits)) << gatbit;
+        assert((gran->gat[gatidx] & gatmask) == 0);
+
+        gran->gat[gatidx] |= gatmask;
+        gran->resv[gatidx] |= gatmask;
+        gran_update_run(gran, gatidx);
+
+        granno += nbits;
+    }
+
+    gran_leave_critical(gran);
+    return 0;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,124 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granreset.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_reset
+ *
+ * Description:
+ *   Free every allocation in the heap at once.  The GAT is overwritten a
+ *   word at a time with the reserved granules, so ranges passed to
+ *   gran_reserve() stay allocated.  Memory from streams and arenas on the
+ *   heap becomes invalid as well, and all epoch tags are dropped.
+ *   Movable allocations are forgotten and their mem set to NULL, and the
+ *   regions and live counts of hinted allocations start over.  All
+ *   zones of a mixed granularity heap are reset.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_reset(struct mm_gran *gran)
+{
+    unsigned int ngatwords;
+    unsigned int gatidx;
+    int          hint;
+    int          ret;
+
+    assert(gran != NULL);
+
+    if (gran->zones != NULL)
+    {
+        gran_zone_reset(gran);
+    }
+
+    ngatwords = SIZEOF_GAT(gran->ngranules);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    if (gran->resv != NULL)
+    {
+        memcpy(gran->gat, gran->resv, ngatwords * sizeof(uint32_t));
+    }
+    else
+    {
+        memset(gran->gat, 0, ngatwords * sizeof(uint32_t));
+    }
+
+    if (gran->epochmap != NULL)
+    {
+        memset(gran->epochmap, 0, CONFIG_GRAN_NEPOCHS * ngatwords * sizeof(uint32_t));
+    }
+
+    gran_movable_drop(gran, NULL);
+
+    /* No hinted allocation is left */
+    if (gran->pinmap != NULL)
+    {
+        memset(gran->pinmap, 0, ngatwords * sizeof(uint32_t));
+    }
+
+    gran->shortend  = 0;
+    gran->longstart = gran->ngranules;
+    gran->pinlow    = gran->ngranules;
+    for (hint = 0; hint < GRAN_HINT_NCLASSES; hint++)
+    {
+        __atomic_store_n(&gran->hintinfo[hint].nlive, 0, __ATOMIC_RELAXED);
+    }
+
+    for (gatidx = 0; gatidx < ngatwords; gatidx++)
+    {
+        gran_update_run(gran, gatidx);
+    }
+
+    gran_wait_wake(gran);
+    gran_leave_critical(gran);
+}
+
+#endif /* CONFIG_GRAN */
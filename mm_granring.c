@@ -0,0 +1,212 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granring.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_initialize_memfd
+ *
+ * Description:
+ *   Set up a granule allocator instance on a heap that is backed by an
+ *   anonymous memory file (memfd) instead of caller memory.  Only such a
+ *   heap supports gran_alloc_ring(), because the same pages have to be
+ *   mapped a second time.  The granule size must be at least one page.
+ *   gran_release() unmaps the heap and closes the file.
+ *
+ * Input Parameters:
+ *   heapsize  - Size of heap in bytes
+ *   log2gran  - Log base 2 of the size of one granule
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned that may be used with other
+ *   granule allocator interfaces; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_memfd(size_t heapsize, uint8_t log2gran)
+{
+    struct mm_gran *gran;
+    size_t          pagesize;
+    void           *heap;
+    int             fd;
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    assert(heapsize > 0 && ((size_t)1 << log2gran) >= pagesize);
+
+    heapsize = (heapsize + pagesize - 1) & ~(pagesize - 1);
+
+    fd = memfd_create("gran", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (ftruncate(fd, heapsize) < 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    heap = mmap(NULL, heapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (heap == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    /* The state structure is at the start of the mapping, so file offsets
+     * are relative to the handle.
+     */
+    gran = gran_initialize(heap, heapsize, log2gran, log2gran);
+    gran->memfd   = fd;
+    gran->mapsize = heapsize;
+    return gran;
+}
+
+/****************************************************************************
+ * Name: gran_alloc_ring
+ *
+ * Description:
+ *   Allocate a run of granules and map it twice, back to back, in virtual
+ *   address space.  Accesses up to size bytes past the end of the first
+ *   view land at the start of the run again, so a ring buffer can be read
+ *   and written contiguously across the wrap point.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_memfd
+ *   size   - The size of the ring; rounded up to whole granules
+ *   ring   - Returns the ring
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; a negated errno value is returned on
+ *   any failure.
+ *
+ ****************************************************************************/
+
+int gran_alloc_ring(struct mm_gran *gran, size_t size, struct gran_ring *ring)
+{
+    uintptr_t base;
+    size_t    len;
+    off_t     offset;
+    void     *alloc;
+    void     *view;
+    int       ret;
+
+    assert(gran != NULL && ring != NULL);
+
+    if (gran->memfd < 0)
+    {
+        return -EINVAL;
+    }
+
+    len   = GRAN_NGRANULES(gran, size) << GRAN_LOG2GRAN(gran);
+    alloc = gran_alloc_owned(gran, len);
+    if (alloc == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    offset = (uintptr_t)alloc - (uintptr_t)gran;
+
+    /* Reserve twice the length, then map the run into both halves */
+    base = (uintptr_t)mmap(NULL, 2 * len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)base == MAP_FAILED)
+    {
+        ret = -errno;
+        goto errout_with_alloc;
+    }
+
+    view = mmap((void *)base, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, gran->memfd, offset);
+    if (view == MAP_FAILED)
+    {
+        ret = -errno;
+        goto errout_with_map;
+    }
+
+    view = mmap((void *)(base + len), len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, gran->memfd, offset);
+    if (view == MAP_FAILED)
+    {
+        ret = -errno;
+        goto errout_with_map;
+    }
+
+    ring->base  = (void *)base;
+    ring->size  = len;
+    ring->alloc = alloc;
+    return 0;
+
+errout_with_map:
+    munmap((void *)base, 2 * len);
+
+errout_with_alloc:
+    gran_free(gran, alloc, len);
+    return ret;
+}
+
+/****************************************************************************
+ * Name: gran_free_ring
+ *
+ * Description:
+ *   Unmap both views of a ring and return its granules to the heap.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_memfd
+ *   ring   - The ring returned by gran_alloc_ring
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_ring(struct mm_gran *gran, struct gran_ring *ring)
+{
+    assert(gran != NULL && ring != NULL && ring->base != NULL);
+
+    munmap(ring->base, 2 * ring->size);
+    gran_free(gran, ring->alloc, ring->size);
+
+    ring->base  = NULL;
+    ring->alloc = NULL;
+    ring->size  = 0;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,290 @@
+/****************************************************************************
+ * mm/mm_gran/mm_gransg.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_sg_offer
+ *
+ * Description:
+ *   Offer one free run to the list of the largest runs found so far.  The
+ *   list is kept in iov[] sorted by decreasing length, with the granule
+ *   number in iov_base and the number of granules in iov_len.
+ *
+ ****************************************************************************/
+
+static void gran_sg_offer(struct iovec *iov, int maxsegs, int *nsegs,
+                          unsigned int granno, unsigned int ngranules)
+{
+    int i;
+
+    if (*nsegs == maxsegs && iov[maxsegs - 1].iov_len >= ngranules)
+    {
+        return;
+    }
+
+    i = *nsegs < maxsegs ? (*nsegs)++ : maxsegs - 1;
+    for (; i > 0 && iov[i - 1].iov_len < ngranules; i--)
+    {
+        iov[i] = iov[i - 1];
+    }
+
+    iov[i].iov_base = (void *)(uintptr_t)granno;
+    iov[i].iov_len  = ngranules;
+}
+
+/****************************************************************************
+ * Name: gran_sg_mark
+ *
+ * Description:
+ *   Mark or clear one segment.  The GAT helpers handle at most 32
+ *   granules at a time, so longer segments are done in pieces.
+ *
+ ****************************************************************************/
+
+static void gran_sg_mark(struct mm_gran *gran, uintptr_t alloc,
+                         unsigned int ngranules, int allocated)
+{
+    unsigned int n;
+
+    while (ngranules > 0)
+    {
+        n = ngranules > 32 ? 32 : ngranules;
+
+        if (allocated)
+        {
+            gran_mark_allocated(gran, alloc, n);
+        }
+        else
+        {
+            gran_clear_allocated(gran, alloc, n);
+        }
+
+        alloc     += (uintptr_t)n << GRAN_LOG2GRAN(gran);
+        ngranules -= n;
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_sg
+ *
+ * Description:
+ *   Allocate memory from the granule heap as up to maxsegs separate runs.
+ *   One pass over the GAT collects the largest free runs and the request
+ *   is served from them, largest first.  This succeeds on a fragmented
+ *   heap as long as enough memory is free in few enough pieces.  Neither
+ *   the total size nor the size of a segment is limited to 32 granules;
+ *   each free run is used as one segment.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   size    - The total size of the memory to allocate.
+ *   maxsegs - The number of entries in iov[]
+ *   iov     - Returns the segments.  The iov_len of every segment but the
+ *             last is a whole number of granules.
+ *
+ * Returned Value:
+ *   The number of segments used on success; -ENOMEM if the request cannot
+ *   be served in maxsegs segments, in which case nothing is allocated.
+ *
+ ****************************************************************************/
+
+int gran_alloc_sg(struct mm_gran *gran, size_t size, int maxsegs, struct iovec *iov)
+{
+    unsigned int ngranules;
+    unsigned int granidx;
+    unsigned int runstart;
+    unsigned int nbits;
+    unsigned int bitidx;
+    unsigned int len;
+    uint32_t     value;
+    size_t       remaining;
+    int          nsegs;
+    int          i;
+    int          ret;
+
+    assert(gran != NULL && iov != NULL && maxsegs > 0);
+
+    if (size == 0)
+    {
+        return -EINVAL;
+    }
+
+    ngranules = GRAN_NGRANULES(gran, size);
+    nsegs     = 0;
+    runstart  = 0;
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    /* Collect the largest free runs in a single pass over the GAT */
+    for (granidx = 0; granidx < gran->ngranules; granidx += 32)
+    {
+        value = gran->gat[granidx >> 5];
+        nbits = gran->ngranules - granidx < 32 ? gran->ngranules - granidx : 32;
+
+        if (nbits < 32)
+        {
+            /* Granules past the end of the heap are not free */
+            value |= 0xffffffff << nbits;
+        }
+
+        if (value == 0)
+        {
+            continue;
+        }
+
+        /* Visit each run of free and allocated bits of this entry */
+        bitidx = 0;
+        while (bitidx < 32)
+        {
+            uint32_t rest = value >> bitidx;
+
+            if ((rest & 1) == 0)
+            {
+                /* A free run continues to the next allocated granule */
+                len = rest == 0 ? 32 - bitidx : __builtin_ctz(rest);
+                bitidx += len;
+                continue;
+            }
+
+            /* Allocated granules end the current run */
+            if (granidx + bitidx > runstart)
+            {
+                gran_sg_offer(iov, maxsegs, &nsegs, runstart, granidx + bitidx - runstart);
+            }
+
+            len       = ~rest == 0 ? 32 - bitidx : __builtin_ctz(~rest);
+            bitidx   += len;
+            runstart  = granidx + bitidx;
+        }
+    }
+
+    if (gran->ngranules > runstart)
+    {
+        gran_sg_offer(iov, maxsegs, &nsegs, runstart, gran->ngranules - runstart);
+    }
+
+    /* Take the largest runs until the request is covered */
+    remaining = ngranules;
+    for (i = 0; i < nsegs && remaining > 0; i++)
+    {
+        if (iov[i].iov_len > remaining)
+        {
+            iov[i].iov_len = remaining;
+        }
+
+        remaining -= iov[i].iov_len;
+    }
+
+    if (remaining > 0)
+    {
+        gran_leave_critical(gran);
+        return -ENOMEM;
+    }
+
+    nsegs     = i;
+    remaining = size;
+    for (i = 0; i < nsegs; i++)
+    {
+        uintptr_t alloc = gran->heapstart + ((uintptr_t)iov[i].iov_base << GRAN_LOG2GRAN(gran));
+
+        gran_sg_mark(gran, alloc, iov[i].iov_len, 1);
+
+        iov[i].iov_base = (void *)alloc;
+        iov[i].iov_len  = (size_t)iov[i].iov_len << GRAN_LOG2GRAN(gran);
+        if (iov[i].iov_len > remaining)
+        {
+            iov[i].iov_len = remaining;
+        }
+
+        remaining -= iov[i].iov_len;
+    }
+
+    gran_leave_critical(gran);
+    return nsegs;
+}
+
+/****************************************************************************
+ * Name: gran_free_sg
+ *
+ * Description:
+ *   Return memory allocated with gran_alloc_sg() to the granule heap.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   iov    - The segments returned by gran_alloc_sg()
+ *   nsegs  - The number of segments returned by gran_alloc_sg()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_free_sg(struct mm_gran *gran, const struct iovec *iov, int nsegs)
+{
+    int ret;
+    int i;
+
+    assert(gran != NULL && (iov != NULL || nsegs == 0));
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        /* REVISIT: No error return.  This is not a good thing. */
+        assert(ret >= 0);
+        return;
+    }
+
+    for (i = 0; i < nsegs; i++)
+    {
+        gran_sg_mark(gran, (uintptr_t)iov[i].iov_base, GRAN_NGRANULES(gran, iov[i].iov_len), 0);
+    }
+
+    gran_leave_critical(gran);
+}
+
+#endif /* CONFIG_GRAN */
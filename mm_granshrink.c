@@ -0,0 +1,248 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granshrink.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* One shrink pass running on this thread.  The passes of a thread form a
+ * stack, so an allocation made by a shrinker from the heap that is being
+ * shrunk fails normally instead of starting another pass, while other
+ * heaps can still be shrunk.
+ */
+
+struct gran_shrinkpass
+{
+    struct mm_gran         *gran;
+    struct gran_shrinkpass *next;
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static __thread struct gran_shrinkpass *g_shrinkpass;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Return non-zero if this thread is running the shrinkers of a heap */
+
+static int gran_shrinking(struct mm_gran *gran)
+{
+    struct gran_shrinkpass *pass;
+
+    for (pass = g_shrinkpass; pass != NULL; pass = pass->next)
+    {
+        if (pass->gran == gran)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_shrinker_register
+ *
+ * Description:
+ *   Add a shrinker to a granule heap.  When gran_alloc() cannot find
+ *   enough free granules, the shrinkers of the heap are called in order of
+ *   increasing priority value until the allocation succeeds.  The
+ *   shrinker structure is owned by the caller and must stay valid until
+ *   it is unregistered.  A shrinker may register other shrinkers; they
+ *   are first called by the next shrink pass.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   shrinker - The shrinker with its shrink, arg and priority fields set
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_shrinker_register(struct mm_gran *gran, struct gran_shrinker *shrinker)
+{
+    struct gran_shrinker **link;
+
+    assert(gran != NULL && shrinker != NULL && shrinker->shrink != NULL);
+
+    pthread_mutex_lock(&gran->shrinklock);
+
+    /* Keep the list sorted; equal priorities are called in order of
+     * registration.  The new shrinker counts as already called by a pass
+     * that is running now.
+     */
+    for (link = &gran->shrinkers; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->priority > shrinker->priority)
+        {
+            break;
+        }
+    }
+
+    shrinker->pass = gran->shrinkseq;
+    shrinker->next = *link;
+    *link          = shrinker;
+
+    pthread_mutex_unlock(&gran->shrinklock);
+}
+
+/****************************************************************************
+ * Name: gran_shrinker_unregister
+ *
+ * Description:
+ *   Remove a shrinker from a granule heap.  When this returns the shrinker
+ *   is not running and will not be called again.  Called from a shrinker
+ *   of the same heap, it does not wait for the running pass, which is the
+ *   caller itself; the shrinker is just not called again.
+ *
+ * Input Parameters:
+ *   handle   - The handle previously returned by gran_initialize
+ *   shrinker - A shrinker passed to gran_shrinker_register()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_shrinker_unregister(struct mm_gran *gran, struct gran_shrinker *shrinker)
+{
+    struct gran_shrinker **link;
+
+    assert(gran != NULL && shrinker != NULL);
+
+    pthread_mutex_lock(&gran->shrinklock);
+
+    for (link = &gran->shrinkers; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == shrinker)
+        {
+            *link = shrinker->next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&gran->shrinklock);
+
+    /* Wait until a pass of another thread that may be calling it is done */
+    if (!gran_shrinking(gran))
+    {
+        pthread_mutex_lock(&gran->shrinkrun);
+        pthread_mutex_unlock(&gran->shrinkrun);
+    }
+}
+
+/****************************************************************************
+ * Name: gran_shrink_alloc
+ *
+ * Description:
+ *   Called by gran_alloc() when the search failed.  The shrinkers are
+ *   called in order of priority without the heap lock held, so they can
+ *   free memory with gran_free().  The allocation is retried after each
+ *   shrinker that reports freed granules.
+ *
+ *   One pass runs at a time per heap.  The shrinker list is only locked
+ *   while the next shrinker is picked, not during the call, so shrinkers
+ *   can register and unregister shrinkers.  Each shrinker records the
+ *   pass that last called it, so the list is walked again from the head
+ *   after every call and the pass still calls each shrinker once.
+ *
+ ****************************************************************************/
+
+void *gran_shrink_alloc(struct mm_gran *gran, size_t size,
+                        void *(*alloc)(struct mm_gran *gran, size_t size))
+{
+    struct gran_shrinkpass  pass;
+    struct gran_shrinker   *shrinker;
+    void                   *memory = NULL;
+    uint32_t                seq;
+
+    if (gran_shrinking(gran))
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&gran->shrinkrun);
+    pass.gran    = gran;
+    pass.next    = g_shrinkpass;
+    g_shrinkpass = &pass;
+
+    pthread_mutex_lock(&gran->shrinklock);
+    seq = ++gran->shrinkseq;
+    pthread_mutex_unlock(&gran->shrinklock);
+
+    /* Another thread may have shrunk the heap while we waited */
+    memory = alloc(gran, size);
+
+    while (memory == NULL)
+    {
+        pthread_mutex_lock(&gran->shrinklock);
+        for (shrinker = gran->shrinkers; shrinker != NULL; shrinker = shrinker->next)
+        {
+            if (shrinker->pass != seq)
+            {
+                shrinker->pass = seq;
+                break;
+            }
+        }
+
+        pthread_mutex_unlock(&gran->shrinklock);
+
+        if (shrinker == NULL)
+        {
+            break;
+        }
+
+        if (shrinker->shrink(gran, GRAN_NGRANULES(gran, size), shrinker->arg) > 0)
+        {
+            memory = alloc(gran, size);
+        }
+    }
+
+    g_shrinkpass = pass.next;
+    pthread_mutex_unlock(&gran->shrinkrun);
+    return memory;
+}
+
+#endif /* CONFIG_GRAN */
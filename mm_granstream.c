@@ -0,0 +1,408 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granstream.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* The stream keeps its own map of the window, one bit per granule that is
+ * in use, and the length in granules of each allocation in tags[] at its
+ * first granule.  Both are indexed from the first granule of the window.
+ */
+
+#define GRAN_STREAM_MAXGRAN   127
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Mark or clear a long range of granules, 32 at a time */
+
+static void gran_stream_mark(struct mm_gran *gran, unsigned int granno,
+                             unsigned int ngranules, int allocated)
+{
+    unsigned int n;
+    uintptr_t    alloc;
+
+    while (ngranules > 0)
+    {
+        n     = ngranules > 32 ? 32 : ngranules;
+        alloc = gran->heapstart + ((uintptr_t)granno << GRAN_LOG2GRAN(gran));
+
+        if (allocated)
+        {
+            gran_mark_epoch(gran, alloc, n, -1);
+        }
+        else
+        {
+            gran_clear_allocated(gran, alloc, n);
+        }
+
+        granno    += n;
+        ngranules -= n;
+    }
+}
+
+/* Return non-zero if bits [bit, bit + n) of the window map are all clear */
+
+static int gran_stream_isfree(const uint32_t *map, unsigned int bit, unsigned int n)
+{
+    unsigned int len;
+    uint32_t     mask;
+
+    for (; n > 0; bit += len, n -= len)
+    {
+        len  = 32 - (bit & 31) < n ? 32 - (bit & 31) : n;
+        mask = (0xffffffff >> (32 - len)) << (bit & 31);
+        if (map[bit >> 5] & mask)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Set or clear bits [bit, bit + n) of the window map */
+
+static void gran_stream_setmap(uint32_t *map, unsigned int bit, unsigned int n, int inuse)
+{
+    unsigned int len;
+    uint32_t     mask;
+
+    for (; n > 0; bit += len, n -= len)
+    {
+        len  = 32 - (bit & 31) < n ? 32 - (bit & 31) : n;
+        mask = (0xffffffff >> (32 - len)) << (bit & 31);
+        if (inuse)
+        {
+            assert((map[bit >> 5] & mask) == 0);
+            map[bit >> 5] |= mask;
+        }
+        else
+        {
+            assert((map[bit >> 5] & mask) == mask);
+            map[bit >> 5] &= ~mask;
+        }
+    }
+}
+
+/* Find the first run of n clear bits of the window map in [start, end).
+ * Only needed when the head is blocked by memory that is still in use, so
+ * whole words are skipped but the rest is visited bit by bit.
+ */
+
+static int gran_stream_search(const uint32_t *map, unsigned int start,
+                              unsigned int end, unsigned int n)
+{
+    unsigned int bit = start;
+    unsigned int run = 0;
+    uint32_t     word;
+
+    while (bit < end)
+    {
+        word = map[bit >> 5];
+        if ((bit & 31) == 0 && end - bit >= 32 && (word == 0 || word == 0xffffffff))
+        {
+            run  = word == 0 ? run + 32 : 0;
+            bit += 32;
+        }
+        else
+        {
+            run  = word & ((uint32_t)1 << (bit & 31)) ? 0 : run + 1;
+            bit += 1;
+        }
+
+        if (run >= n)
+        {
+            return bit - run;
+        }
+    }
+
+    return -1;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_stream_initialize
+ *
+ * Description:
+ *   Reserve a window of contiguous granules in the heap for mostly ordered
+ *   (FIFO) traffic.  gran_stream_alloc() hands out memory from a moving
+ *   head and gran_stream_free() returns it to the window map, so in order
+ *   traffic never searches for free memory.  The window is marked
+ *   allocated in the GAT, so gran_alloc() can be used on the rest of the
+ *   heap at the same time.
+ *
+ * Input Parameters:
+ *   stream - The stream state to initialize
+ *   handle - The handle previously returned by gran_initialize
+ *   size   - The size of the window in bytes
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if there is no
+ *   free run of that size or the window state could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_stream_initialize(struct gran_stream *stream, struct mm_gran *gran, size_t size)
+{
+    unsigned int ngranules;
+    unsigned int granno;
+    unsigned int run;
+    int          ret;
+
+    assert(stream != NULL && gran != NULL && size > 0);
+
+    ngranules = GRAN_NGRANULES(gran, size);
+
+    stream->tags = malloc(ngranules);
+    stream->map  = calloc(SIZEOF_GAT(ngranules), sizeof(uint32_t));
+    if (stream->tags == NULL || stream->map == NULL)
+    {
+        ret = -ENOMEM;
+        goto errout;
+    }
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        goto errout;
+    }
+
+    /* This is done once per stream, so a plain first fit scan will do */
+    for (granno = 0, run = 0; granno < gran->ngranules && run < ngranules; granno++)
+    {
+        if (gran->gat[granno >> 5] & ((uint32_t)1 << (granno & 31)))
+        {
+            run = 0;
+        }
+        else
+        {
+            run++;
+        }
+    }
+
+    if (run < ngranules)
+    {
+        gran_leave_critical(gran);
+        ret = -ENOMEM;
+        goto errout;
+    }
+
+    stream->gran  = gran;
+    stream->first = granno - ngranules;
+    stream->end   = granno;
+    stream->head  = stream->first;
+    stream->used  = 0;
+
+    gran_stream_mark(gran, stream->first, ngranules, 1);
+    gran_leave_critical(gran);
+    return 0;
+
+errout:
+    free(stream->tags);
+    free(stream->map);
+    stream->tags = NULL;
+    stream->map  = NULL;
+    return ret;
+}
+
+/****************************************************************************
+ * Name: gran_stream_alloc
+ *
+ * Description:
+ *   Allocate memory at the head of the stream.  If the space before the
+ *   end of the window is too small, the head wraps to the start of the
+ *   window.  If the granules at the head are still in use, because they
+ *   were freed out of order, the head skips over them to the next run of
+ *   freed granules that is large enough.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *   size   - The size of the memory to allocate (at most 127 granules)
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned if there is no room in the window.
+ *
+ ****************************************************************************/
+
+void *gran_stream_alloc(struct gran_stream *stream, size_t size)
+{
+    struct mm_gran *gran = stream->gran;
+    unsigned int    ngranules;
+    unsigned int    nwindow;
+    int             granidx;
+
+    if (size == 0 || size > ((size_t)GRAN_STREAM_MAXGRAN << GRAN_LOG2GRAN(gran)))
+    {
+        return NULL;
+    }
+
+    ngranules = GRAN_NGRANULES(gran, size);
+    nwindow   = stream->end - stream->first;
+
+    if (gran_enter_critical(gran) < 0)
+    {
+        return NULL;
+    }
+
+    if (stream->used == 0)
+    {
+        /* Empty.  Restart at the beginning of the window. */
+        stream->head = stream->first;
+    }
+
+    /* Give up the end of the window and wrap if it is too small */
+    granidx = stream->head - stream->first;
+    if (granidx + ngranules > nwindow)
+    {
+        granidx = 0;
+    }
+
+    if (ngranules > nwindow - stream->used)
+    {
+        goto errout;
+    }
+
+    if (!gran_stream_isfree(stream->map, granidx, ngranules))
+    {
+        /* Skip what is still in use to the next run of freed granules */
+        granidx = gran_stream_search(stream->map, granidx, nwindow, ngranules);
+        if (granidx < 0)
+        {
+            granidx = gran_stream_search(stream->map, 0, nwindow, ngranules);
+        }
+
+        if (granidx < 0)
+        {
+            goto errout;
+        }
+    }
+
+    gran_stream_setmap(stream->map, granidx, ngranules, 1);
+    stream->tags[granidx] = ngranules;
+    stream->head  = stream->first + granidx + ngranules;
+    stream->used += ngranules;
+
+    gran_leave_critical(gran);
+    return (void *)(gran->heapstart + ((uintptr_t)(stream->first + granidx) << GRAN_LOG2GRAN(gran)));
+
+errout:
+    gran_leave_critical(gran);
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_stream_free
+ *
+ * Description:
+ *   Free memory allocated with gran_stream_alloc().  Its granules are
+ *   cleared in the window map, so they can be allocated again at once,
+ *   whether or not the allocations in front of them have been freed.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *   memory - Memory returned by gran_stream_alloc()
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_stream_free(struct gran_stream *stream, void *memory)
+{
+    struct mm_gran *gran = stream->gran;
+    unsigned int    granidx;
+    unsigned int    ngranules;
+
+    granidx = (((uintptr_t)memory - gran->heapstart) >> GRAN_LOG2GRAN(gran)) - stream->first;
+    assert(granidx < stream->end - stream->first && stream->used > 0);
+
+    if (gran_enter_critical(gran) < 0)
+    {
+        return;
+    }
+
+    ngranules = stream->tags[granidx];
+    assert(ngranules > 0);
+
+    gran_stream_setmap(stream->map, granidx, ngranules, 0);
+    stream->tags[granidx] = 0;
+    stream->used -= ngranules;
+
+    gran_leave_critical(gran);
+}
+
+/****************************************************************************
+ * Name: gran_stream_release
+ *
+ * Description:
+ *   Return the window of a stream to the heap.  Any memory still
+ *   allocated from the stream becomes invalid.
+ *
+ * Input Parameters:
+ *   stream - The stream
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_stream_release(struct gran_stream *stream)
+{
+    struct mm_gran *gran = stream->gran;
+
+    if (gran_enter_critical(gran) < 0)
+    {
+        return;
+    }
+
+    gran_stream_mark(gran, stream->first, stream->end - stream->first, 0);
+    gran_leave_critical(gran);
+
+    free(stream->tags);
+    free(stream->map);
+    stream->tags = NULL;
+    stream->map  = NULL;
+}
+
+#endif /* CONFIG_GRAN */
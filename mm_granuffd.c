@@ -0,0 +1,493 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granuffd.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Only handle faults from user space.  This does not need privileges when
+ * vm.unprivileged_userfaultfd is 0 (Linux 5.11 and later).
+ */
+
+#ifndef UFFD_USER_MODE_ONLY
+#  define UFFD_USER_MODE_ONLY 1
+#endif
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+struct gran_uffd
+{
+    int          uffd;      /* The userfaultfd */
+    int          wakefd;    /* eventfd that stops the handler */
+    pthread_t    thread;    /* The fault handler */
+    uintptr_t    base;      /* Start of the reserved range */
+    size_t       mapsize;   /* Size of the reserved range */
+    size_t       pagesize;  /* System page size */
+    unsigned int flags;     /* GRAN_UFFD_* flags */
+    void        *zeropage;  /* Zero filled source page for UFFDIO_COPY */
+    struct gran_uffd_stats stats; /* Fault statistics */
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_uffd_resolve
+ *
+ * Description:
+ *   Populate one faulting page and record how long it took.  By default a
+ *   private zero filled page is copied in, so that a write after a read
+ *   does not fault again; with GRAN_UFFD_ZEROPAGE the shared zero page is
+ *   mapped instead and the kernel copies it on the first write.
+ *
+ ****************************************************************************/
+
+static void gran_uffd_resolve(struct gran_uffd *uffd, uintptr_t addr)
+{
+    struct uffdio_zeropage zeropage;
+    struct uffdio_copy     copy;
+    struct uffdio_range    range;
+    struct timespec        start;
+    struct timespec        end;
+    uint64_t               ns;
+    unsigned int           bucket;
+    int                    ret;
+
+    addr &= ~(uintptr_t)(uffd->pagesize - 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* EAGAIN: the address space is changing (fork, mremap), try again */
+    do
+    {
+        if (uffd->flags & GRAN_UFFD_ZEROPAGE)
+        {
+            zeropage.range.start = addr;
+            zeropage.range.len   = uffd->pagesize;
+            zeropage.mode        = UFFDIO_ZEROPAGE_MODE_DONTWAKE;
+            ret = ioctl(uffd->uffd, UFFDIO_ZEROPAGE, &zeropage);
+        }
+        else
+        {
+            copy.dst  = addr;
+            copy.src  = (uintptr_t)uffd->zeropage;
+            copy.len  = uffd->pagesize;
+            copy.mode = UFFDIO_COPY_MODE_DONTWAKE;
+            ret = ioctl(uffd->uffd, UFFDIO_COPY, &copy);
+        }
+    }
+    while (ret < 0 && errno == EAGAIN);
+
+    /* EEXIST: another fault populated the page first.  Any other error
+     * means the page cannot be populated; the thread is still woken so
+     * that it retries the access instead of blocking forever.
+     */
+    if (ret == 0 || errno == EEXIST)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        ns     = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec - start.tv_nsec;
+        bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+        if (bucket >= GRAN_UFFD_NBUCKETS)
+        {
+            bucket = GRAN_UFFD_NBUCKETS - 1;
+        }
+
+        __atomic_fetch_add(&uffd->stats.nfaults, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&uffd->stats.hist[bucket], 1, __ATOMIC_RELAXED);
+    }
+
+    /* The page was populated without waking the thread so that the fault
+     * is counted before the thread can look at the statistics.
+     */
+    range.start = addr;
+    range.len   = uffd->pagesize;
+    ioctl(uffd->uffd, UFFDIO_WAKE, &range);
+}
+
+/* Return the pages in [start, end) to the kernel */
+
+static ssize_t gran_uffd_discard(struct gran_uffd *uffd, uintptr_t start, uintptr_t end)
+{
+    if (end <= start || madvise((void *)start, end - start, MADV_DONTNEED) < 0)
+    {
+        return 0;
+    }
+
+    return (end - start) / uffd->pagesize;
+}
+
+/* The fault handler thread */
+
+static void *gran_uffd_thread(void *arg)
+{
+    struct gran_uffd *uffd = arg;
+    struct uffd_msg   msg;
+    struct pollfd     fds[2];
+
+    fds[0].fd     = uffd->uffd;
+    fds[0].events = POLLIN;
+    fds[1].fd     = uffd->wakefd;
+    fds[1].events = POLLIN;
+
+    for (; ; )
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            break;
+        }
+
+        if (read(uffd->uffd, &msg, sizeof(msg)) != sizeof(msg))
+        {
+            continue;
+        }
+
+        if (msg.event == UFFD_EVENT_PAGEFAULT)
+        {
+            gran_uffd_resolve(uffd, msg.arg.pagefault.address);
+        }
+    }
+
+    return NULL;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_initialize_uffd
+ *
+ * Description:
+ *   Set up a granule allocator instance on a reserved virtual range whose
+ *   pages are only populated when they are first touched.  The range is
+ *   registered with a userfaultfd and a handler thread populates each
+ *   page on its first access, so a very large, sparsely used heap only
+ *   costs the memory that is actually touched.  Pages that hold no
+ *   allocation can be handed back with gran_uffd_reclaim().
+ *
+ *   This is experimental.  It needs a kernel that permits userfaultfd for
+ *   the caller (UFFD_USER_MODE_ONLY is tried first, so no privileges are
+ *   needed on Linux 5.11 and later).  gran_release() stops the handler
+ *   and unmaps the heap.
+ *
+ *   Every fault is served from one zero filled source page (or from the
+ *   kernel's zero page).  Keeping a pool of recycled zeroed pages would
+ *   not save the copy that UFFDIO_COPY makes anyway, so there is none.
+ *
+ * Input Parameters:
+ *   heapsize  - Size of heap in bytes
+ *   log2gran  - Log base 2 of the size of one granule
+ *   flags     - GRAN_UFFD_ZEROPAGE or 0
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned that may be used with other
+ *   granule allocator interfaces; NULL is returned on failure.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_uffd(size_t heapsize, uint8_t log2gran, unsigned int flags)
+{
+    struct uffdio_api      api;
+    struct uffdio_register reg;
+    struct gran_uffd      *uffd;
+    struct mm_gran        *gran;
+    uint64_t               one = 1;
+    ssize_t                nwritten;
+    void                  *heap;
+
+    uffd = calloc(1, sizeof(struct gran_uffd));
+    if (uffd == NULL)
+    {
+        return NULL;
+    }
+
+    uffd->flags    = flags;
+    uffd->pagesize = sysconf(_SC_PAGESIZE);
+    uffd->mapsize  = (heapsize + uffd->pagesize - 1) & ~(uffd->pagesize - 1);
+    uffd->wakefd   = -1;
+
+    uffd->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (uffd->uffd < 0)
+    {
+        uffd->uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+        if (uffd->uffd < 0)
+        {
+            goto errout;
+        }
+    }
+
+    api.api      = UFFD_API;
+    api.features = 0;
+    if (ioctl(uffd->uffd, UFFDIO_API, &api) < 0)
+    {
+        goto errout_with_uffd;
+    }
+
+    uffd->zeropage = mmap(NULL, uffd->pagesize, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uffd->zeropage == MAP_FAILED)
+    {
+        goto errout_with_uffd;
+    }
+
+    heap = mmap(NULL, uffd->mapsize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED)
+    {
+        goto errout_with_zeropage;
+    }
+
+    uffd->base = (uintptr_t)heap;
+
+    reg.range.start = uffd->base;
+    reg.range.len   = uffd->mapsize;
+    reg.mode        = UFFDIO_REGISTER_MODE_MISSING;
+    if (ioctl(uffd->uffd, UFFDIO_REGISTER, &reg) < 0)
+    {
+        goto errout_with_heap;
+    }
+
+    uffd->wakefd = eventfd(0, EFD_CLOEXEC);
+    if (uffd->wakefd < 0)
+    {
+        goto errout_with_heap;
+    }
+
+    /* The handler must run before gran_initialize() touches the heap */
+    if (pthread_create(&uffd->thread, NULL, gran_uffd_thread, uffd) != 0)
+    {
+        goto errout_with_wakefd;
+    }
+
+    gran = gran_initialize(heap, uffd->mapsize, log2gran, log2gran);
+    if (gran == NULL)
+    {
+        goto errout_with_thread;
+    }
+
+    gran->uffd = uffd;
+    return gran;
+
+errout_with_thread:
+    nwritten = write(uffd->wakefd, &one, sizeof(one));
+    (void)nwritten;
+    pthread_join(uffd->thread, NULL);
+
+errout_with_wakefd:
+    close(uffd->wakefd);
+
+errout_with_heap:
+    munmap(heap, uffd->mapsize);
+
+errout_with_zeropage:
+    munmap(uffd->zeropage, uffd->pagesize);
+
+errout_with_uffd:
+    close(uffd->uffd);
+
+errout:
+    free(uffd);
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_uffd_reclaim
+ *
+ * Description:
+ *   Return the pages of a userfaultfd backed heap that hold no allocated
+ *   granule to the kernel with MADV_DONTNEED.  The next touch of such a
+ *   page faults again and is populated by the handler, so the resident
+ *   size follows the live allocations rather than the high-water mark.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_uffd
+ *
+ * Returned Value:
+ *   The number of pages returned, or a negated errno value on failure.
+ *
+ ****************************************************************************/
+
+ssize_t gran_uffd_reclaim(struct mm_gran *gran)
+{
+    struct gran_uffd *uffd;
+    uintptr_t         page;
+    uintptr_t         start;
+    uintptr_t         heapend;
+    unsigned int      granno;
+    unsigned int      lastgran;
+    ssize_t           npages = 0;
+    int               ret;
+
+    assert(gran != NULL);
+
+    uffd = gran->uffd;
+    if (uffd == NULL)
+    {
+        return -EINVAL;
+    }
+
+    heapend = gran->heapstart + ((uintptr_t)gran->ngranules << GRAN_LOG2GRAN(gran));
+    page    = (gran->heapstart + uffd->pagesize - 1) & ~(uintptr_t)(uffd->pagesize - 1);
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    /* Visit the pages that lie entirely inside the granule area and return
+     * each run of free pages with a single madvise() call.
+     */
+    for (start = page; page + uffd->pagesize <= heapend; page += uffd->pagesize)
+    {
+        granno   = (page - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+        lastgran = (page + uffd->pagesize - 1 - gran->heapstart) >> GRAN_LOG2GRAN(gran);
+
+        for (; granno <= lastgran; granno++)
+        {
+            if (gran->gat[granno >> 5] & ((uint32_t)1 << (granno & 31)))
+            {
+                break;
+            }
+        }
+
+        if (granno <= lastgran)
+        {
+            npages += gran_uffd_discard(uffd, start, page);
+            start   = page + uffd->pagesize;
+        }
+    }
+
+    npages += gran_uffd_discard(uffd, start, page);
+    gran_leave_critical(gran);
+
+    __atomic_fetch_add(&uffd->stats.nreclaimed, npages, __ATOMIC_RELAXED);
+    return npages;
+}
+
+/****************************************************************************
+ * Name: gran_uffd_stats
+ *
+ * Description:
+ *   Return the fault statistics of a userfaultfd backed heap.  The
+ *   histogram measures the time the handler needs to populate a page.
+ *
+ * Input Parameters:
+ *   handle - A handle returned by gran_initialize_uffd
+ *   stats  - Returns the statistics
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if the heap is not backed by
+ *   userfaultfd.
+ *
+ ****************************************************************************/
+
+int gran_uffd_stats(struct mm_gran *gran, struct gran_uffd_stats *stats)
+{
+    struct gran_uffd *uffd;
+    unsigned int      i;
+
+    assert(gran != NULL && stats != NULL);
+
+    uffd = gran->uffd;
+    if (uffd == NULL)
+    {
+        return -EINVAL;
+    }
+
+    stats->nfaults    = __atomic_load_n(&uffd->stats.nfaults, __ATOMIC_RELAXED);
+    stats->nreclaimed = __atomic_load_n(&uffd->stats.nreclaimed, __ATOMIC_RELAXED);
+    for (i = 0; i < GRAN_UFFD_NBUCKETS; i++)
+    {
+        stats->hist[i] = __atomic_load_n(&uffd->stats.hist[i], __ATOMIC_RELAXED);
+    }
+
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_uffd_release
+ *
+ * Description:
+ *   Stop the fault handler of a userfaultfd backed heap and unmap the
+ *   heap.  The heap state lives in the mapping, so nothing may touch it
+ *   afterwards.
+ *
+ ****************************************************************************/
+
+void gran_uffd_release(struct mm_gran *gran)
+{
+    struct gran_uffd *uffd = gran->uffd;
+    uint64_t          one  = 1;
+    ssize_t           nwritten;
+
+    nwritten = write(uffd->wakefd, &one, sizeof(one));
+    (void)nwritten;
+    pthread_join(uffd->thread, NULL);
+
+    munmap((void *)uffd->base, uffd->mapsize);
+    munmap(uffd->zeropage, uffd->pagesize);
+    close(uffd->wakefd);
+    close(uffd->uffd);
+    free(uffd);
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,222 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granvector.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_vector_init
+ *
+ * Description:
+ *   Initialize an empty vector.  No memory is allocated until the first
+ *   element is added.
+ *
+ * Input Parameters:
+ *   vec      - The vector to initialize
+ *   handle   - The handle previously returned by gran_initialize
+ *   elemsize - The size of one element in bytes
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_vector_init(struct gran_vector *vec, struct mm_gran *gran, size_t elemsize)
+{
+    assert(vec != NULL && gran != NULL && elemsize > 0);
+
+    vec->gran     = gran;
+    vec->data     = NULL;
+    vec->elemsize = elemsize;
+    vec->nelem    = 0;
+    vec->capacity = 0;
+}
+
+/****************************************************************************
+ * Name: gran_vector_reserve
+ *
+ * Description:
+ *   Make room for at least nelem elements.  The vector first tries to claim
+ *   the granules that immediately follow its storage with gran_extend() and
+ *   only relocates (doubling its capacity) when they are in use.
+ *
+ * Input Parameters:
+ *   vec   - The vector
+ *   nelem - The number of elements that must fit
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -ENOMEM is returned if the storage
+ *   could not be grown.  The vector is unchanged on failure.
+ *
+ ****************************************************************************/
+
+int gran_vector_reserve(struct gran_vector *vec, size_t nelem)
+{
+    struct mm_gran *gran;
+    size_t          maxsize;
+    size_t          newsize;
+    void           *data;
+
+    assert(vec != NULL);
+
+    gran    = vec->gran;
+    maxsize = 32 * GRAN_SIZE(gran);
+
+    if (nelem > maxsize / vec->elemsize)
+    {
+        return -ENOMEM;
+    }
+
+    newsize = nelem * vec->elemsize;
+    if (newsize <= vec->capacity)
+    {
+        return 0;
+    }
+
+    /* Round up to whole granules; the tail of the last granule is usable */
+    newsize = GRAN_NGRANULES(gran, newsize) << GRAN_LOG2GRAN(gran);
+
+    /* Try to grow in place first */
+    if (vec->data != NULL && gran_extend(gran, vec->data, vec->capacity, newsize) == 0)
+    {
+        vec->capacity = newsize;
+        return 0;
+    }
+
+    /* Relocate.  Double the capacity so that relocations stay rare, but
+     * settle for the exact size if the doubled one cannot be found.
+     */
+    data = NULL;
+    if (vec->capacity * 2 > newsize)
+    {
+        size_t dblsize = vec->capacity * 2 < maxsize ? vec->capacity * 2 : maxsize;
+
+        data = gran_alloc_owned(gran, dblsize);
+        if (data != NULL)
+        {
+            newsize = dblsize;
+        }
+    }
+
+    if (data == NULL)
+    {
+        data = gran_alloc_owned(gran, newsize);
+        if (data == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    if (vec->data != NULL)
+    {
+        memcpy(data, vec->data, vec->nelem * vec->elemsize);
+        gran_free(gran, vec->data, vec->capacity);
+    }
+
+    vec->data     = data;
+    vec->capacity = newsize;
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_vector_append
+ *
+ * Description:
+ *   Append elements to the end of the vector, growing it as needed.
+ *
+ * Input Parameters:
+ *   vec   - The vector
+ *   elem  - The elements to copy in, or NULL to leave them uninitialized
+ *   nelem - The number of elements to append
+ *
+ * Returned Value:
+ *   A pointer to the first appended element; NULL is returned if the
+ *   vector could not be grown.
+ *
+ ****************************************************************************/
+
+void *gran_vector_append(struct gran_vector *vec, const void *elem, size_t nelem)
+{
+    uint8_t *dest;
+
+    assert(vec != NULL);
+
+    if (nelem > SIZE_MAX - vec->nelem || gran_vector_reserve(vec, vec->nelem + nelem) < 0)
+    {
+        return NULL;
+    }
+
+    dest = (uint8_t *)vec->data + vec->nelem * vec->elemsize;
+    if (elem != NULL)
+    {
+        memcpy(dest, elem, nelem * vec->elemsize);
+    }
+
+    vec->nelem += nelem;
+    return dest;
+}
+
+/****************************************************************************
+ * Name: gran_vector_release
+ *
+ * Description:
+ *   Return the storage of the vector to the heap and make it empty.
+ *
+ * Input Parameters:
+ *   vec - The vector
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gran_vector_release(struct gran_vector *vec)
+{
+    assert(vec != NULL);
+
+    if (vec->data != NULL)
+    {
+        gran_free(vec->gran, vec->data, vec->capacity);
+    }
+
+    vec->data     = NULL;
+    vec->nelem    = 0;
+    vec->capacity = 0;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,253 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granwait.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static int gran_futex(uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+/* The largest request that the heap can ever satisfy.  A mixed granularity
+ * heap can hold up to 32 granules of its last zone.
+ */
+
+static size_t gran_wait_maxsize(struct mm_gran *gran)
+{
+    struct mm_gran *last = gran;
+
+    if (gran->zones != NULL)
+    {
+        last = gran->zones->zone[gran->zones->nzones - 1];
+    }
+
+    return 32 * GRAN_SIZE(last);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_alloc_wait
+ *
+ * Description:
+ *   Allocate memory from the granule heap, blocking until it is available.
+ *   The caller sleeps on a futex of the heap and is woken only by frees
+ *   that leave a free run at least as long as the smallest waiting
+ *   request.  On a mixed granularity heap the waiters are also woken by
+ *   every free in the other zones.
+ *
+ * Input Parameters:
+ *   handle  - The handle previously returned by gran_initialize
+ *   size    - The size of the memory region to allocate.
+ *   timeout - The maximum time to wait in milliseconds.  A negative value
+ *             waits forever; zero does not wait at all.
+ *
+ * Returned Value:
+ *   On success, a non-NULL pointer to the allocated memory is returned;
+ *   NULL is returned if the request timed out or can never be satisfied.
+ *
+ ****************************************************************************/
+
+void *gran_alloc_wait(struct mm_gran *gran, size_t size, int timeout)
+{
+    struct timespec deadline;
+    unsigned int    ngranules;
+    uint32_t        seq;
+    void           *memory;
+
+    assert(gran != NULL);
+
+    memory = gran_alloc(gran, size);
+    if (memory != NULL || timeout == 0 || size == 0 || size > gran_wait_maxsize(gran))
+    {
+        return memory;
+    }
+
+    ngranules = GRAN_NGRANULES(gran, size);
+
+    if (timeout > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += timeout / 1000;
+        deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    for (; ; )
+    {
+        /* Register as a waiter before the retry, so that a free that
+         * happens after the retry fails is guaranteed to change the
+         * sequence number.
+         */
+        if (gran_enter_critical(gran) < 0)
+        {
+            return NULL;
+        }
+
+        gran->nwaiters++;
+        if (ngranules < gran->minwait)
+        {
+            gran->minwait = ngranules;
+        }
+
+        seq = __atomic_load_n(&gran->waitseq, __ATOMIC_RELAXED);
+        gran_leave_critical(gran);
+
+        memory = gran_alloc(gran, size);
+        if (memory == NULL &&
+            gran_futex(&gran->waitseq, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+                       seq, timeout > 0 ? &deadline : NULL) < 0 &&
+            errno == ETIMEDOUT)
+        {
+            timeout = 0;
+        }
+
+        if (gran_enter_critical(gran) < 0)
+        {
+            return memory;
+        }
+
+        /* The smallest waiting size is not tracked per waiter; it is only
+         * reset when the last waiter leaves.
+         */
+        if (--gran->nwaiters == 0)
+        {
+            gran->minwait = UINT32_MAX;
+        }
+
+        gran_leave_critical(gran);
+
+        if (memory != NULL)
+        {
+            return memory;
+        }
+
+        if (timeout == 0)
+        {
+            return gran_alloc(gran, size);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: gran_wait_notify
+ *
+ * Description:
+ *   Called after granules were freed in one or two GAT entries.  The
+ *   waiters are woken if the free run around the entries, estimated from
+ *   the run summaries of the entries and their neighbours, may now hold
+ *   the smallest waiting request.  The caller must hold the critical
+ *   section.
+ *
+ ****************************************************************************/
+
+void gran_wait_notify(struct mm_gran *gran, unsigned int gatidx, unsigned int nentries)
+{
+    unsigned int ngatwords = SIZEOF_GAT(gran->ngranules);
+    unsigned int lastidx   = gatidx + nentries - 1;
+    unsigned int run;
+    unsigned int i;
+
+    if (gran->nwaiters == 0)
+    {
+        return;
+    }
+
+    run = 0;
+    for (i = gatidx; i <= lastidx; i++)
+    {
+        if (GRAN_RUN_MXFREE(gran->gatrun[i]) > run)
+        {
+            run = GRAN_RUN_MXFREE(gran->gatrun[i]);
+        }
+    }
+
+    /* A free that spans two entries leaves a run across their boundary */
+    if (nentries == 2 &&
+        GRAN_RUN_NMSFREE(gran->gatrun[gatidx]) + GRAN_RUN_NLSFREE(gran->gatrun[lastidx]) > run)
+    {
+        run = GRAN_RUN_NMSFREE(gran->gatrun[gatidx]) + GRAN_RUN_NLSFREE(gran->gatrun[lastidx]);
+    }
+
+    /* A run may continue into the neighbouring entries */
+    if (gatidx > 0)
+    {
+        run += GRAN_RUN_NMSFREE(gran->gatrun[gatidx - 1]);
+    }
+
+    if (lastidx + 1 < ngatwords)
+    {
+        run += GRAN_RUN_NLSFREE(gran->gatrun[lastidx + 1]);
+    }
+
+    if (run >= gran->minwait)
+    {
+        gran_wait_wake(gran);
+    }
+}
+
+/****************************************************************************
+ * Name: gran_wait_wake
+ *
+ * Description:
+ *   Wake every waiter of the heap unconditionally.  The caller must hold
+ *   the critical section.
+ *
+ ****************************************************************************/
+
+void gran_wait_wake(struct mm_gran *gran)
+{
+    if (gran->nwaiters > 0)
+    {
+        __atomic_fetch_add(&gran->waitseq, 1, __ATOMIC_RELEASE);
+        gran_futex(&gran->waitseq, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, NULL);
+    }
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,328 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granwmark.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Return a GAT entry with the granules past the end of the heap set, so
+ * that they never count as free.
+ */
+
+static uint32_t gran_wmark_value(struct mm_gran *gran, unsigned int gatidx)
+{
+    unsigned int nbits = gran->ngranules - (gatidx << 5);
+
+    if (nbits >= 32)
+    {
+        return gran->gat[gatidx];
+    }
+
+    return gran->gat[gatidx] | (0xffffffff << nbits);
+}
+
+/* Recompute the span value of one GAT entry and update the histogram */
+
+static void gran_wmark_span(struct mm_gran *gran, struct gran_wmark *wmark,
+                            unsigned int gatidx)
+{
+    unsigned int ngatwords = SIZEOF_GAT(gran->ngranules);
+    unsigned int span;
+    unsigned int edge;
+    uint32_t     value;
+
+    span  = GRAN_RUN_MXFREE(gran->gatrun[gatidx]);
+    value = gran_wmark_value(gran, gatidx);
+
+    /* A run of free MS granules continues into the LS granules of the
+     * next entry.
+     */
+    if (span < 32 && gatidx + 1 < ngatwords)
+    {
+        edge   = value == 0 ? 32 : __builtin_clz(value);
+        value  = gran_wmark_value(gran, gatidx + 1);
+        edge  += value == 0 ? 32 : __builtin_ctz(value);
+
+        if (edge > span)
+        {
+            span = edge > 32 ? 32 : edge;
+        }
+    }
+
+    if (span != wmark->span[gatidx])
+    {
+        if (--wmark->runcnt[wmark->span[gatidx]] == 0)
+        {
+            wmark->runmask &= ~((uint64_t)1 << wmark->span[gatidx]);
+        }
+
+        if (wmark->runcnt[span]++ == 0)
+        {
+            wmark->runmask |= (uint64_t)1 << span;
+        }
+
+        wmark->span[gatidx] = span;
+    }
+}
+
+/* Evaluate the watermarks against the counters */
+
+static unsigned int gran_wmark_eval(struct gran_wmark *wmark)
+{
+    unsigned int state  = wmark->state;
+    unsigned int mxfree = 63 - __builtin_clzll(wmark->runmask);
+
+    if (wmark->nfree < wmark->cfg.nfree_low)
+    {
+        state |= GRAN_WMARK_NFREE;
+    }
+    else if (wmark->nfree >= wmark->cfg.nfree_high)
+    {
+        state &= ~GRAN_WMARK_NFREE;
+    }
+
+    if (mxfree < wmark->cfg.mxfree_low)
+    {
+        state |= GRAN_WMARK_MXFREE;
+    }
+    else if (mxfree >= wmark->cfg.mxfree_high)
+    {
+        state &= ~GRAN_WMARK_MXFREE;
+    }
+
+    return state;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_watermark_set
+ *
+ * Description:
+ *   Set the memory pressure watermarks of a heap, or disable them.  The
+ *   counters are built with one pass over the GAT here and are maintained
+ *   incrementally afterwards by gran_update_run().  The initial state is
+ *   taken from the current counters without a notification.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *   wm     - The watermarks, or NULL to disable
+ *
+ * Returned Value:
+ *   Zero (OK) is returned on success; -EINVAL if a low watermark is above
+ *   its high watermark; -ENOMEM if the counters could not be allocated.
+ *
+ ****************************************************************************/
+
+int gran_watermark_set(struct mm_gran *gran, const struct gran_watermarks *wm)
+{
+    struct gran_wmark *wmark = NULL;
+    struct gran_wmark *old;
+    unsigned int       ngatwords;
+    unsigned int       gatidx;
+    int                ret;
+
+    assert(gran != NULL);
+
+    ngatwords = SIZEOF_GAT(gran->ngranules);
+
+    if (wm != NULL)
+    {
+        if (wm->nfree_low > wm->nfree_high || wm->mxfree_low > wm->mxfree_high)
+        {
+            return -EINVAL;
+        }
+
+        wmark = calloc(1, sizeof(struct gran_wmark) + 2 * ngatwords);
+        if (wmark == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        wmark->cfg    = *wm;
+        wmark->nfreew = (uint8_t *)(wmark + 1);
+        wmark->span   = wmark->nfreew + ngatwords;
+    }
+
+    ret = gran_enter_critical(gran);
+    if (ret < 0)
+    {
+        free(wmark);
+        return ret;
+    }
+
+    if (wmark != NULL)
+    {
+        /* Every entry starts in the zero bucket of the histogram */
+        wmark->runcnt[0] = ngatwords;
+        wmark->runmask   = 1;
+
+        for (gatidx = 0; gatidx < ngatwords; gatidx++)
+        {
+            wmark->nfreew[gatidx] = 32 - __builtin_popcount(gran_wmark_value(gran, gatidx));
+            wmark->nfree         += wmark->nfreew[gatidx];
+            gran_wmark_span(gran, wmark, gatidx);
+        }
+
+        wmark->state = gran_wmark_eval(wmark);
+    }
+
+    old         = gran->wmark;
+    gran->wmark = wmark;
+    gran_leave_critical(gran);
+
+    free(old);
+    return 0;
+}
+
+/****************************************************************************
+ * Name: gran_watermark_state
+ *
+ * Description:
+ *   Return the watermark conditions that are currently asserted.
+ *
+ * Input Parameters:
+ *   handle - The handle previously returned by gran_initialize
+ *
+ * Returned Value:
+ *   A combination of GRAN_WMARK_NFREE and GRAN_WMARK_MXFREE, or zero if
+ *   watermarks are not enabled.
+ *
+ ****************************************************************************/
+
+unsigned int gran_watermark_state(struct mm_gran *gran)
+{
+    unsigned int state = 0;
+
+    assert(gran != NULL);
+
+    if (gran_enter_critical(gran) == 0)
+    {
+        if (gran->wmark != NULL)
+        {
+            state = gran->wmark->state;
+        }
+
+        gran_leave_critical(gran);
+    }
+
+    return state;
+}
+
+/****************************************************************************
+ * Name: gran_wmark_update
+ *
+ * Description:
+ *   Update the free count and the span values after a GAT entry changed.
+ *   The span of the previous entry depends on the LS granules of this one.
+ *
+ ****************************************************************************/
+
+void gran_wmark_update(struct mm_gran *gran, unsigned int gatidx)
+{
+    struct gran_wmark *wmark = gran->wmark;
+    unsigned int       nfree;
+
+    nfree         = 32 - __builtin_popcount(gran_wmark_value(gran, gatidx));
+    wmark->nfree += nfree - wmark->nfreew[gatidx];
+    wmark->nfreew[gatidx] = nfree;
+
+    gran_wmark_span(gran, wmark, gatidx);
+    if (gatidx > 0)
+    {
+        gran_wmark_span(gran, wmark, gatidx - 1);
+    }
+}
+
+/****************************************************************************
+ * Name: gran_wmark_check
+ *
+ * Description:
+ *   Compare the counters with the watermarks before the critical section
+ *   is left.  Intermediate states inside one operation are never seen.
+ *
+ ****************************************************************************/
+
+int gran_wmark_check(struct mm_gran *gran, struct gran_wmark_event *event)
+{
+    struct gran_wmark *wmark = gran->wmark;
+    unsigned int       state;
+
+    state = gran_wmark_eval(wmark);
+    if (state == wmark->state)
+    {
+        return 0;
+    }
+
+    wmark->state   = state;
+    event->notify  = wmark->cfg.notify;
+    event->arg     = wmark->cfg.arg;
+    event->eventfd = wmark->cfg.eventfd;
+    event->state   = state;
+    return 1;
+}
+
+/****************************************************************************
+ * Name: gran_wmark_notify
+ *
+ * Description:
+ *   Deliver a watermark crossing.  Called without the critical section.
+ *
+ ****************************************************************************/
+
+void gran_wmark_notify(struct mm_gran *gran, const struct gran_wmark_event *event)
+{
+    uint64_t one = 1;
+    ssize_t  nwritten;
+
+    if (event->eventfd >= 0)
+    {
+        /* Nothing can be done if the counter is saturated */
+        nwritten = write(event->eventfd, &one, sizeof(one));
+        (void)nwritten;
+    }
+
+    if (event->notify != NULL)
+    {
+        event->notify(gran, event->state, event->arg);
+    }
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,351 @@
+/****************************************************************************
+ * mm/mm_gran/mm_granzone.c
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include "config.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+#include "mm_gran.h"
+
+#ifdef CONFIG_GRAN
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Add a granule count of a zone to a total kept in granules of the first
+ * zone, saturating at UINT32_MAX.
+ */
+
+static uint32_t gran_zone_add(uint32_t total, uint32_t count, uint8_t log2gran, uint8_t base)
+{
+    uint64_t sum = total + ((uint64_t)count << (log2gran - base));
+
+    return sum > UINT32_MAX ? UINT32_MAX : (uint32_t)sum;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: gran_initialize_zoned
+ *
+ * Description:
+ *   Set up one heap that is split into zones with different granule
+ *   sizes, each with its own GAT.  The zones are laid out one after the
+ *   other in the order given and each one is an ordinary granule heap.
+ *   The first zone, which has the smallest granules, is the returned
+ *   handle; it keeps a table of the other zones that gran_alloc(),
+ *   gran_free(), gran_extend(), gran_info(), gran_reset(),
+ *   gran_alloc_wait(), gran_lookup() and gran_release() consult.  The
+ *   interfaces that keep per granule state (arenas, buffers, handles,
+ *   movables, hints, colors, rings, vectors and I/O pools) allocate from
+ *   the first zone only.
+ *
+ * Input Parameters:
+ *   heapstart - Start of the heap
+ *   heapsize  - Size of heap in bytes
+ *   zones     - The zones, by increasing log2gran
+ *   nzones    - Number of zones
+ *
+ * Returned Value:
+ *   On success, a non-NULL handle is returned; NULL is returned if the
+ *   zones do not fit in the heap or a zone could not be set up.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_initialize_zoned(void *heapstart, size_t heapsize,
+                                      const struct gran_zone *zones, unsigned int nzones)
+{
+    struct gran_zones *table = NULL;
+    struct mm_gran    *gran;
+    uintptr_t          start;
+    size_t             remain;
+    size_t             size;
+    unsigned int       i;
+
+    assert(heapstart != NULL && zones != NULL && nzones > 0);
+
+    /* Check the whole layout before anything is initialized */
+    for (i = 0, remain = heapsize; i < nzones; i++)
+    {
+        size = zones[i].size == 0 && i == nzones - 1 ? remain : zones[i].size;
+        if ((i > 0 && zones[i].log2gran <= zones[i - 1].log2gran) || size > remain ||
+            size < SIZEOF_MM_GRAN(32) + ((size_t)2 << zones[i].log2gran))
+        {
+            return NULL;
+        }
+
+        remain -= size;
+    }
+
+    if (nzones > 1)
+    {
+        table = malloc(sizeof(struct gran_zones) + (nzones - 2) * sizeof(struct mm_gran *));
+        if (table == NULL)
+        {
+            return NULL;
+        }
+
+        table->nzones = nzones - 1;
+    }
+
+    start  = (uintptr_t)heapstart;
+    remain = heapsize;
+    gran   = NULL;
+
+    for (i = 0; i < nzones; i++)
+    {
+        struct mm_gran *zone;
+
+        size = zones[i].size == 0 && i == nzones - 1 ? remain : zones[i].size;
+        zone = gran_initialize((void *)start, size, zones[i].log2gran, zones[i].log2gran);
+        if (zone == NULL)
+        {
+            goto errout;
+        }
+
+        if (i == 0)
+        {
+            gran = zone;
+        }
+        else
+        {
+            table->zone[i - 1] = zone;
+        }
+
+        start  += size;
+        remain -= size;
+    }
+
+    gran->zones = table;
+    return gran;
+
+errout:
+    while (i-- > 1)
+    {
+        gran_release(table->zone[i - 1]);
+    }
+
+    if (gran != NULL)
+    {
+        gran_release(gran);
+    }
+
+    free(table);
+    return NULL;
+}
+
+/****************************************************************************
+ * Name: gran_zone_at
+ *
+ * Description:
+ *   Return zone k of a mixed granularity heap; zone 0 is the heap itself.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_zone_at(struct mm_gran *gran, unsigned int k)
+{
+    return k == 0 ? gran : gran->zones->zone[k - 1];
+}
+
+/****************************************************************************
+ * Name: gran_zone_class
+ *
+ * Description:
+ *   Return the zone that a request belongs to: the zone with the smallest
+ *   granules in which it needs at most CONFIG_GRAN_ZONE_NGRANULES
+ *   granules, or the last zone if there is none.
+ *
+ ****************************************************************************/
+
+unsigned int gran_zone_class(struct mm_gran *gran, size_t size)
+{
+    unsigned int k;
+
+    for (k = 0; k < gran->zones->nzones; k++)
+    {
+        if (GRAN_NGRANULES(gran_zone_at(gran, k), size) <= CONFIG_GRAN_ZONE_NGRANULES)
+        {
+            break;
+        }
+    }
+
+    return k;
+}
+
+/****************************************************************************
+ * Name: gran_zone_free
+ *
+ * Description:
+ *   Return memory to the other zone that contains it.  Returns false if
+ *   the memory belongs to the first zone.
+ *
+ ****************************************************************************/
+
+int gran_zone_free(struct mm_gran *gran, void *memory, size_t size)
+{
+    struct mm_gran *zone = gran_zone_of(gran, memory);
+
+    if (zone == gran)
+    {
+        return 0;
+    }
+
+    gran_free(zone, memory, size);
+    return 1;
+}
+
+/****************************************************************************
+ * Name: gran_zone_of
+ *
+ * Description:
+ *   Return the zone that contains an address, or the heap itself if the
+ *   address is not in any of its other zones.
+ *
+ ****************************************************************************/
+
+struct mm_gran *gran_zone_of(struct mm_gran *gran, const void *memory)
+{
+    struct mm_gran *zone;
+    unsigned int    i;
+
+    if (gran->zones != NULL)
+    {
+        for (i = 0; i < gran->zones->nzones; i++)
+        {
+            zone = gran->zones->zone[i];
+            if ((uintptr_t)memory - zone->heapstart <
+                ((uintptr_t)zone->ngranules << GRAN_LOG2GRAN(zone)))
+            {
+                return zone;
+            }
+        }
+    }
+
+    return gran;
+}
+
+/****************************************************************************
+ * Name: gran_zone_end
+ *
+ * Description:
+ *   Return the end of the granules of the last zone of a heap.  The zones
+ *   lie one after the other, so a mixed granularity heap covers the range
+ *   from the start of its first zone to this address.
+ *
+ ****************************************************************************/
+
+uintptr_t gran_zone_end(struct mm_gran *gran)
+{
+    struct mm_gran *last = gran;
+
+    if (gran->zones != NULL)
+    {
+        last = gran->zones->zone[gran->zones->nzones - 1];
+    }
+
+    return last->heapstart + ((uintptr_t)last->ngranules << GRAN_LOG2GRAN(last));
+}
+
+/****************************************************************************
+ * Name: gran_zone_info
+ *
+ * Description:
+ *   Add the other zones to the statistics of the first zone.  Counts are
+ *   given in granules of the first zone and saturate at UINT32_MAX.
+ *
+ ****************************************************************************/
+
+void gran_zone_info(struct mm_gran *gran, struct graninfo *info)
+{
+    struct graninfo zoneinfo;
+    struct mm_gran *zone;
+    uint32_t        mxfree;
+    unsigned int    i;
+
+    for (i = 0; i < gran->zones->nzones; i++)
+    {
+        zone = gran->zones->zone[i];
+        gran_info(zone, &zoneinfo);
+
+        info->ngranules = gran_zone_add(info->ngranules, zoneinfo.ngranules, zoneinfo.log2gran, info->log2gran);
+        info->nfree     = gran_zone_add(info->nfree, zoneinfo.nfree, zoneinfo.log2gran, info->log2gran);
+
+        mxfree = gran_zone_add(0, zoneinfo.mxfree, zoneinfo.log2gran, info->log2gran);
+        if (mxfree > info->mxfree)
+        {
+            info->mxfree = mxfree;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: gran_zone_reset
+ *
+ * Description:
+ *   Reset the other zones.  gran_reset() of the first zone wakes the
+ *   waiters of the whole heap.
+ *
+ ****************************************************************************/
+
+void gran_zone_reset(struct mm_gran *gran)
+{
+    unsigned int i;
+
+    for (i = 0; i < gran->zones->nzones; i++)
+    {
+        gran_reset(gran->zones->zone[i]);
+    }
+}
+
+/****************************************************************************
+ * Name: gran_zone_release
+ *
+ * Description:
+ *   Release the other zones and the zone table.  The zones live in the
+ *   caller's heap, like the first one.
+ *
+ ****************************************************************************/
+
+void gran_zone_release(struct mm_gran *gran)
+{
+    unsigned int i;
+
+    for (i = 0; i < gran->zones->nzones; i++)
+    {
+        gran_release(gran->zones->zone[i]);
+    }
+
+    free(gran->zones);
+    gran->zones = NULL;
+}
+
+#endif /* CONFIG_GRAN */
@@ -0,0 +1,93 @@
+/****************************************************************************
+ * tests/gran_test.h
+ * Helpers shared by the granule allocator tests.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#ifndef __TESTS_GRAN_TEST_H
+#define __TESTS_GRAN_TEST_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gran.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Fail the test with the location and the failed condition.  Unlike
+ * assert() this is not compiled out by NDEBUG.
+ */
+
+#define TEST_ASSERT(cond) \
+  do \
+    { \
+      if (!(cond)) \
+        { \
+          fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+          exit(1); \
+        } \
+    } \
+  while (0)
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/* Create a heap on 'size' bytes of page aligned memory from the C heap.
+ * The memory is returned by test_heap_free().
+ */
+
+static inline struct mm_gran *test_heap(size_t size, uint8_t log2gran,
+                                        void **mem)
+{
+  *mem = aligned_alloc(4096, (size + 4095) & ~(size_t)4095);
+  TEST_ASSERT(*mem != NULL);
+  return gran_initialize(*mem, size, log2gran, log2gran);
+}
+
+static inline void test_heap_free(struct mm_gran *gran, void *mem)
+{
+  gran_release(gran);
+  free(mem);
+}
+
+/* Number of free granules and longest free run of a heap */
+
+static inline uint32_t test_nfree(struct mm_gran *gran)
+{
+  struct graninfo info;
+
+  gran_info(gran, &info);
+  return info.nfree;
+}
+
+static inline uint32_t test_mxfree(struct mm_gran *gran)
+{
+  struct graninfo info;
+
+  gran_info(gran, &info);
+  return info.mxfree;
+}
+
+#endif /* __TESTS_GRAN_TEST_H */
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Build and run the granule allocator tests.
+#
+# Usage: tests/run_tests.sh [test_name ...]
+#
+# Every tests/test_*.c and tests/test_*.cxx is linked against the allocator
+# sources (every mm_gran*.c except the malloc interposer) and run, with
+# GRAN_MALLOC_LIB set to a freshly built libgranmalloc.so.  With
+# arguments only the named tests are run.  CFLAGS adds compiler flags, for
+# example CFLAGS=-fsanitize=address,undefined.
+#
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+FLAGS="-g -O1 -Wall -pthread -I. $CFLAGS"
+
+for src in mm_gran*.c; do
+  [ "$src" = mm_granmalloc.c ] && continue
+  gcc $FLAGS -c "$src" -o "$OUT/${src%.c}.o"
+done
+
+LIB="$OUT/libgranmalloc.so" sh granmalloc_compare.sh --build
+export GRAN_MALLOC_LIB="$OUT/libgranmalloc.so"
+
+if [ $# -eq 0 ]; then
+  set -- $(ls tests/test_*.c tests/test_*.cxx 2>/dev/null | sed 's|tests/||; s|\.c.*$||')
+fi
+
+pass=0
+fail=0
+
+for name in "$@"; do
+  if [ -f "tests/$name.cxx" ]; then
+    g++ -std=c++17 $FLAGS "tests/$name.cxx" "$OUT"/*.o -o "$OUT/$name"
+  else
+    gcc $FLAGS "tests/$name.c" "$OUT"/*.o -o "$OUT/$name"
+  fi
+
+  if "$OUT/$name"; then
+    echo "PASS $name"
+    pass=$((pass + 1))
+  else
+    echo "FAIL $name"
+    fail=$((fail + 1))
+  fi
+done
+
+echo "$pass passed, $fail failed"
+[ "$fail" -eq 0 ]
@@ -0,0 +1,135 @@
+/****************************************************************************
+ * tests/test_alloc.c
+ * gran_alloc() must stay first fit and gran_info() must match a shadow
+ * bitmap while the free run summaries prune the search.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define NGRANULES  1000
+#define LOG2GRAN   6
+#define NSLOTS     300
+
+static uint8_t g_shadow[NGRANULES + 64];
+
+/* Lowest granule that starts a free run of n granules, or -1 */
+
+static int model_fit(uint32_t ngranules, unsigned int n)
+{
+  unsigned int run = 0;
+  unsigned int i;
+
+  for (i = 0; i < ngranules; i++)
+    {
+      run = g_shadow[i] ? 0 : run + 1;
+      if (run == n)
+        {
+          return i + 1 - n;
+        }
+    }
+
+  return -1;
+}
+
+int main(void)
+{
+  struct graninfo info;
+  struct mm_gran *gran;
+  uintptr_t       base;
+  void           *mem;
+  void           *p[NSLOTS];
+  size_t          size[NSLOTS];
+  uint32_t        nfree;
+  uint32_t        mxfree;
+  uint32_t        run;
+  unsigned int    n;
+  int             expect;
+  int             round;
+  int             i;
+  int             j;
+
+  gran = test_heap(4096 + (NGRANULES << LOG2GRAN), LOG2GRAN, &mem);
+  gran_info(gran, &info);
+  TEST_ASSERT(info.ngranules <= NGRANULES + 64 && info.nfree == info.ngranules);
+  base = (uintptr_t)gran_heapstart(gran);
+  memset(p, 0, sizeof(p));
+
+  srand(2);
+  for (round = 0; round < 100000; round++)
+    {
+      i = rand() % NSLOTS;
+      if (p[i] != NULL)
+        {
+          n = (size[i] + (1 << LOG2GRAN) - 1) >> LOG2GRAN;
+          gran_free(gran, p[i], size[i]);
+          memset(&g_shadow[((uintptr_t)p[i] - base) >> LOG2GRAN], 0, n);
+          p[i] = NULL;
+          continue;
+        }
+
+      /* Mostly small requests, sometimes the 32 granule maximum */
+
+      size[i] = rand() % 8 == 0 ? 32 << LOG2GRAN : 1 + rand() % (12 << LOG2GRAN);
+      n       = (size[i] + (1 << LOG2GRAN) - 1) >> LOG2GRAN;
+      expect  = model_fit(info.ngranules, n);
+      p[i]    = gran_alloc(gran, size[i]);
+
+      if (expect < 0)
+        {
+          TEST_ASSERT(p[i] == NULL);
+          continue;
+        }
+
+      TEST_ASSERT(p[i] != NULL);
+      TEST_ASSERT((uintptr_t)p[i] == base + ((uintptr_t)expect << LOG2GRAN));
+      for (j = 0; j < (int)n; j++)
+        {
+          TEST_ASSERT(!g_shadow[expect + j]);
+          g_shadow[expect + j] = 1;
+        }
+
+      if (round % 101 == 0)
+        {
+          for (j = 0, nfree = 0, mxfree = 0, run = 0; j < (int)info.ngranules; j++)
+            {
+              run    = g_shadow[j] ? 0 : run + 1;
+              nfree += !g_shadow[j];
+              mxfree = run > mxfree ? run : mxfree;
+            }
+
+          TEST_ASSERT(test_nfree(gran) == nfree);
+          TEST_ASSERT(test_mxfree(gran) == mxfree);
+        }
+    }
+
+  for (i = 0; i < NSLOTS; i++)
+    {
+      if (p[i] != NULL)
+        {
+          gran_free(gran, p[i], size[i]);
+        }
+    }
+
+  TEST_ASSERT(test_nfree(gran) == info.ngranules);
+  TEST_ASSERT(test_mxfree(gran) == info.ngranules);
+  test_heap_free(gran, mem);
+  return 0;
+}
@@ -0,0 +1,146 @@
+/****************************************************************************
+ * tests/test_arena.c
+ * A scratch arena must reject zero sized requests, claim a new extent
+ * when the current one is used up, settle for a smaller extent on a
+ * fragmented heap and give every extent back at gran_arena_end().  The
+ * memory must be aligned to max_align_t even when the granules are not.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+#define EXTENT    (32 * GRANSIZE)
+#define ALIGN     sizeof(max_align_t)   /* Also the extent header size */
+
+int main(void)
+{
+  struct gran_arena arena;
+  struct mm_gran   *gran;
+  uintptr_t         base;
+  uintptr_t         first;
+  uint32_t          nfree;
+  uint8_t          *p;
+  uint8_t          *q;
+  void             *mem;
+  unsigned int      off;
+  unsigned int      i;
+
+  gran  = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  base  = (uintptr_t)gran_heapstart(gran);
+  nfree = test_nfree(gran);
+
+  /* Nothing is claimed for a zero sized or oversized request */
+
+  gran_arena_begin(&arena, gran);
+  TEST_ASSERT(gran_arena_alloc(&arena, 0) == NULL);
+  TEST_ASSERT(gran_arena_alloc(&arena, EXTENT + 1) == NULL);
+  TEST_ASSERT(gran_arena_alloc(&arena, SIZE_MAX) == NULL);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* The first allocation claims a full extent; later ones share it */
+
+  p = gran_arena_alloc(&arena, 1);
+  TEST_ASSERT(p != NULL && (uintptr_t)p % ALIGN == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 32);
+  first = (uintptr_t)p;
+
+  q = gran_arena_alloc(&arena, 1);
+  TEST_ASSERT(q == p + ALIGN);
+  TEST_ASSERT(gran_arena_alloc(&arena, 0) == NULL);
+
+  /* Use up the extent: the next allocation claims a second one */
+
+  for (i = 0; i < (EXTENT - 3 * ALIGN) / 64; i++)
+    {
+      q = gran_arena_alloc(&arena, 64);
+      TEST_ASSERT(q != NULL && (uintptr_t)q + 64 <= first - ALIGN + EXTENT);
+      memset(q, 0xa5, 64);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree - 32);
+  q = gran_arena_alloc(&arena, 128);
+  TEST_ASSERT(q != NULL && ((uintptr_t)q < first || (uintptr_t)q >= first + EXTENT));
+  TEST_ASSERT(test_nfree(gran) == nfree - 64);
+
+  /* The largest request that fits an extent next to its header */
+
+  TEST_ASSERT(gran_arena_alloc(&arena, EXTENT - ALIGN) != NULL);
+  TEST_ASSERT(gran_arena_alloc(&arena, EXTENT - ALIGN + 1) == NULL);
+  TEST_ASSERT(test_nfree(gran) == nfree - 96);
+
+  /* Ending returns all extents at once and leaves the arena reusable */
+
+  gran_arena_end(&arena);
+  TEST_ASSERT(test_nfree(gran) == nfree && test_mxfree(gran) == nfree);
+  gran_arena_end(&arena);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* With only a 3 granule hole left the arena takes just what it needs */
+
+  for (i = 0; i < nfree; i++)
+    {
+      if (i < 40 || i >= 43)
+        {
+          TEST_ASSERT(gran_reserve(gran, base + ((uintptr_t)i << LOG2GRAN), GRANSIZE) == 0);
+        }
+    }
+
+  p = gran_arena_alloc(&arena, 2 * GRANSIZE - ALIGN);
+  TEST_ASSERT((uintptr_t)p == base + (40 << LOG2GRAN) + ALIGN);
+  TEST_ASSERT(test_nfree(gran) == 1);
+  TEST_ASSERT(gran_arena_alloc(&arena, 2 * GRANSIZE) == NULL);
+  gran_arena_end(&arena);
+  TEST_ASSERT(test_nfree(gran) == 3);
+
+  test_heap_free(gran, mem);
+
+  /* 16 byte granules on a heap start that is only 16 byte aligned in one
+   * of the two layouts: every allocation is still aligned to ALIGN.
+   */
+
+  mem = aligned_alloc(4096, 8192);
+  TEST_ASSERT(mem != NULL);
+
+  for (off = 0; off <= 16; off += 16)
+    {
+      gran = gran_initialize((uint8_t *)mem + off, 8192 - off, 4, 4);
+      TEST_ASSERT(gran != NULL);
+      nfree = test_nfree(gran);
+
+      gran_arena_begin(&arena, gran);
+      for (i = 1; i < 200; i += 7)
+        {
+          p = gran_arena_alloc(&arena, i);
+          TEST_ASSERT(p != NULL && (uintptr_t)p % ALIGN == 0);
+          memset(p, 0x5a, i);
+        }
+
+      TEST_ASSERT(gran_arena_alloc(&arena, 32 * 16 - 2 * ALIGN) != NULL);
+      gran_arena_end(&arena);
+      TEST_ASSERT(test_nfree(gran) == nfree);
+      gran_release(gran);
+    }
+
+  free(mem);
+  return 0;
+}
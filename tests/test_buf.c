@@ -0,0 +1,116 @@
+/****************************************************************************
+ * tests/test_buf.c
+ * Buffers and their slices must share one reference count, slices must
+ * stay inside their parent, and only the last reference, whichever view
+ * it is dropped through, may free the allocation.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+
+int main(void)
+{
+  struct gran_buf buf;
+  struct gran_buf ref;
+  struct gran_buf other;
+  struct gran_buf s1;
+  struct gran_buf s2;
+  struct gran_buf s3;
+  struct mm_gran *gran;
+  uintptr_t       base;
+  uint32_t        nfree;
+  uint8_t        *data;
+  void           *mem;
+
+  gran  = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  base  = (uintptr_t)gran_heapstart(gran);
+  nfree = test_nfree(gran);
+
+  TEST_ASSERT(gran_buf_initialize(gran) == 0);
+  TEST_ASSERT(gran_buf_initialize(gran) == 0);
+
+  /* A buffer covers whole granules and starts with one reference */
+
+  TEST_ASSERT(gran_buf_alloc(gran, 3 * GRANSIZE - 5, &buf) == 0);
+  TEST_ASSERT((uintptr_t)buf.data == base && buf.len == 3 * GRANSIZE - 5);
+  TEST_ASSERT(buf.head == 0 && test_nfree(gran) == nfree - 3);
+  data = buf.data;
+  memset(data, 0xa5, buf.len);
+
+  TEST_ASSERT(gran_buf_alloc(gran, GRANSIZE, &other) == 0);
+  TEST_ASSERT((uintptr_t)other.data == base + 3 * GRANSIZE && other.head == 3);
+
+  /* Slices must be inside their parent; a failed slice takes no
+   * reference.
+   */
+
+  TEST_ASSERT(gran_buf_slice(gran, &buf, buf.len + 1, 0, &s1) == -EINVAL);
+  TEST_ASSERT(gran_buf_slice(gran, &buf, 10, buf.len - 9, &s1) == -EINVAL);
+  TEST_ASSERT(gran_buf_slice(gran, &buf, 1, SIZE_MAX, &s1) == -EINVAL);
+
+  TEST_ASSERT(gran_buf_slice(gran, &buf, 10, 100, &s1) == 0);
+  TEST_ASSERT(s1.data == data + 10 && s1.len == 100 && s1.head == 0);
+
+  /* A slice of a slice is relative to the slice */
+
+  TEST_ASSERT(gran_buf_slice(gran, &s1, 5, 96, &s2) == -EINVAL);
+  TEST_ASSERT(gran_buf_slice(gran, &s1, 5, 95, &s2) == 0);
+  TEST_ASSERT(s2.data == data + 15 && s2.len == 95 && s2.head == 0);
+  TEST_ASSERT(gran_buf_slice(gran, &s2, s2.len, 0, &s3) == 0);
+  TEST_ASSERT(s3.data == data + 110 && s3.len == 0);
+
+  /* buf, ref, s1, s2 and s3 hold five references; the allocation goes
+   * with the last one, dropped through a slice.
+   */
+
+  ref = buf;
+  gran_buf_ref(gran, &ref);
+
+  gran_buf_unref(gran, &buf);
+  TEST_ASSERT(buf.data == NULL && buf.len == 0);
+  gran_buf_unref(gran, &s3);
+  gran_buf_unref(gran, &ref);
+  gran_buf_unref(gran, &s1);
+  TEST_ASSERT(test_nfree(gran) == nfree - 4);
+  TEST_ASSERT(data[0] == 0xa5 && data[3 * GRANSIZE - 6] == 0xa5);
+
+  gran_buf_unref(gran, &s2);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+
+  /* The other buffer was not touched; the freed granules are reused with
+   * a fresh count.
+   */
+
+  TEST_ASSERT(gran_buf_alloc(gran, 2 * GRANSIZE, &buf) == 0);
+  TEST_ASSERT(buf.data == data && buf.head == 0);
+  gran_buf_unref(gran, &buf);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+
+  gran_buf_unref(gran, &other);
+  TEST_ASSERT(test_nfree(gran) == nfree && test_mxfree(gran) == nfree);
+
+  test_heap_free(gran, mem);
+  return 0;
+}
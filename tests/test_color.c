@@ -0,0 +1,139 @@
+/****************************************************************************
+ * tests/test_color.c
+ * Colored allocations must move up by one cache line per allocation, stay
+ * inside the unused tail of their granules and be freed by gran_free()
+ * with the same size, granule for granule.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  12
+#define GRANSIZE  ((size_t)1 << LOG2GRAN)
+#define LINE      64
+#define NCOLORS   (GRANSIZE / LINE)
+#define NBUFS     (2 * NCOLORS)
+
+/* Offset of an allocation inside its first granule */
+
+static size_t test_offset(void *p)
+{
+  return (uintptr_t)p & (GRANSIZE - 1);
+}
+
+int main(void)
+{
+  struct mm_gran *gran;
+  uint8_t        *buf[NBUFS];
+  uint8_t        *p;
+  uint32_t        nfree;
+  size_t          expect;
+  size_t          slack;
+  size_t          size;
+  void           *mem;
+  int             i;
+
+  gran = test_heap(256 * GRANSIZE, LOG2GRAN, &mem);
+  TEST_ASSERT(gran != NULL);
+  nfree = test_nfree(gran);
+
+  /* One granule with 1000 bytes in use: the color rotates by a line per
+   * allocation and is clipped to the last line that still fits.
+   */
+
+  size  = 1000;
+  slack = GRANSIZE - size;
+  for (i = 0; i < NBUFS; i++)
+    {
+      buf[i] = gran_alloc_colored(gran, size);
+      TEST_ASSERT(buf[i] != NULL);
+
+      expect = (i % NCOLORS) * LINE;
+      if (expect > slack)
+        {
+          expect = slack & ~(LINE - 1);
+        }
+
+      TEST_ASSERT(test_offset(buf[i]) == expect);
+      TEST_ASSERT(test_offset(buf[i]) + size <= GRANSIZE);
+      memset(buf[i], i, size);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree - NBUFS);
+
+  /* Freeing with the same size returns exactly the granule underneath */
+
+  for (i = 0; i < NBUFS; i += 2)
+    {
+      gran_free(gran, buf[i], size);
+      TEST_ASSERT(test_nfree(gran) == nfree - NBUFS + i / 2 + 1);
+    }
+
+  for (i = 1; i < NBUFS; i += 2)
+    {
+      TEST_ASSERT(buf[i][0] == i && buf[i][size - 1] == i);
+    }
+
+  for (i = 0; i < NBUFS; i += 2)
+    {
+      p = gran_alloc(gran, GRANSIZE);
+      TEST_ASSERT(p == buf[i] - test_offset(buf[i]));
+    }
+
+  for (i = 0; i < NBUFS; i += 2)
+    {
+      gran_free(gran, buf[i] - test_offset(buf[i]), GRANSIZE);
+      gran_free(gran, buf[i + 1], size);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* Over several granules the offset is limited by the tail of the last
+   * one, and the whole run is released again.
+   */
+
+  size  = 2 * GRANSIZE + 100;
+  slack = GRANSIZE - 100;
+  for (i = 0; i < NCOLORS; i++)
+    {
+      p = gran_alloc_colored(gran, size);
+      TEST_ASSERT(p != NULL);
+      TEST_ASSERT(test_offset(p) % LINE == 0);
+      TEST_ASSERT(test_offset(p) <= slack);
+      memset(p, 0x5a, size);
+
+      gran_free(gran, p, size);
+      TEST_ASSERT(test_nfree(gran) == nfree);
+      TEST_ASSERT(test_mxfree(gran) == nfree);
+    }
+
+  /* Without slack there is nothing to rotate */
+
+  for (i = 0; i < 4; i++)
+    {
+      p = gran_alloc_colored(gran, GRANSIZE);
+      TEST_ASSERT(p != NULL && test_offset(p) == 0);
+      gran_free(gran, p, GRANSIZE);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  test_heap_free(gran, mem);
+  return 0;
+}
@@ -0,0 +1,217 @@
+/****************************************************************************
+ * tests/test_compact.c
+ * gran_compact() must move movable allocations down with their contents,
+ * report every move through relocate(), respect the byte budget and must
+ * not touch movables that gran_reset() or gran_epoch_release() freed.  An
+ * allocation slides into an overlapping run when nothing lower is free,
+ * and page sized granules are moved with mremap() after
+ * gran_compact_remap().
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define NMOVABLE  8
+#define MSIZE     (2 << LOG2GRAN)
+
+static int g_nrelocated;
+
+static void relocate(struct gran_movable *m, void *oldmem, void *arg)
+{
+  TEST_ASSERT(oldmem != m->mem && (uintptr_t)m->mem < (uintptr_t)oldmem);
+  TEST_ASSERT(memcmp(m->mem, arg, MSIZE) == 0);
+  g_nrelocated++;
+}
+
+int main(void)
+{
+  struct gran_movable m[NMOVABLE];
+  struct gran_movable x;
+  struct mm_gran     *gran;
+  uint8_t             data[NMOVABLE][MSIZE];
+  void               *filler[NMOVABLE];
+  void               *mem;
+  void               *y;
+  uint32_t            nfree;
+  ssize_t             moved;
+  ssize_t             total;
+  size_t              pagesize;
+  uint8_t            *p;
+  int                 log2page;
+  int                 i;
+
+  gran  = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  nfree = test_nfree(gran);
+
+  /* Movables above a hole of free granules */
+
+  for (i = 0; i < NMOVABLE; i++)
+    {
+      filler[i] = gran_alloc(gran, 1 << LOG2GRAN);
+    }
+
+  for (i = 0; i < NMOVABLE; i++)
+    {
+      memset(data[i], 'a' + i, MSIZE);
+      TEST_ASSERT(gran_alloc_movable(gran, &m[i], MSIZE, relocate, data[i]) == 0);
+      memcpy(m[i].mem, data[i], MSIZE);
+    }
+
+  for (i = 0; i < NMOVABLE; i++)
+    {
+      gran_free(gran, filler[i], 1 << LOG2GRAN);
+    }
+
+  TEST_ASSERT(test_mxfree(gran) < test_nfree(gran));
+
+  /* The budget bounds the bytes copied per call */
+
+  TEST_ASSERT(gran_compact(gran, MSIZE - 1) == 0);
+  TEST_ASSERT(g_nrelocated == 0);
+  TEST_ASSERT(gran_compact(gran, MSIZE) == MSIZE);
+  TEST_ASSERT(g_nrelocated == 1);
+
+  /* Compact until nothing moves: the free space is then one run */
+
+  total = MSIZE;
+  while ((moved = gran_compact(gran, 3 * MSIZE)) > 0)
+    {
+      TEST_ASSERT(moved <= 3 * MSIZE && moved % MSIZE == 0);
+      total += moved;
+    }
+
+  TEST_ASSERT(moved == 0);
+  TEST_ASSERT(total == g_nrelocated * MSIZE);
+  TEST_ASSERT(test_mxfree(gran) == test_nfree(gran));
+
+  for (i = 0; i < NMOVABLE; i++)
+    {
+      TEST_ASSERT(memcmp(m[i].mem, data[i], MSIZE) == 0);
+      gran_free_movable(gran, &m[i]);
+      TEST_ASSERT(m[i].mem == NULL);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* gran_reset() frees movables: a later compaction must not move them
+   * out of the memory that was allocated again.
+   */
+
+  filler[0] = gran_alloc(gran, 2 * MSIZE);
+  TEST_ASSERT(gran_alloc_movable(gran, &x, MSIZE, NULL, NULL) == 0);
+  gran_reset(gran);
+  TEST_ASSERT(x.mem == NULL);
+
+  filler[0] = gran_alloc(gran, 2 * MSIZE);
+  y         = gran_alloc(gran, MSIZE);
+  gran_free(gran, filler[0], 2 * MSIZE);
+  TEST_ASSERT(gran_compact(gran, 1 << 20) == 0);
+  gran_free_movable(gran, &x);
+
+  filler[0] = gran_alloc(gran, 3 * MSIZE);
+  TEST_ASSERT(filler[0] != NULL && filler[0] != y);
+  gran_free(gran, filler[0], 3 * MSIZE);
+  gran_free(gran, y, MSIZE);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* The same for gran_epoch_release() */
+
+  TEST_ASSERT(gran_epoch_initialize(gran) == 0);
+  TEST_ASSERT(gran_alloc_movable(gran, &x, MSIZE, NULL, NULL) == 0);
+  TEST_ASSERT(gran_alloc_movable(gran, &m[0], MSIZE, NULL, NULL) == 0);
+  TEST_ASSERT(gran_epoch_begin(gran) == 1);
+  TEST_ASSERT(gran_alloc_movable(gran, &m[1], MSIZE, NULL, NULL) == 0);
+  gran_free_movable(gran, &m[0]);
+  gran_epoch_release(gran, 0);
+  TEST_ASSERT(x.mem == NULL && m[1].mem != NULL);
+
+  /* Only m[1] moves, into the granules of m[0] */
+
+  y = gran_alloc(gran, MSIZE);
+  memset(y, 'y', MSIZE);
+  TEST_ASSERT(gran_compact(gran, 1 << 20) == MSIZE);
+  TEST_ASSERT(((uint8_t *)y)[0] == 'y' && ((uint8_t *)y)[MSIZE - 1] == 'y');
+  gran_free_movable(gran, &x);
+  gran_free_movable(gran, &m[1]);
+  gran_free(gran, y, MSIZE);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* Nothing free below but one granule: slide into the overlapping run,
+   * which keeps the epoch of the allocation.
+   */
+
+  filler[0] = gran_alloc(gran, 1 << LOG2GRAN);
+  TEST_ASSERT(filler[0] == gran_heapstart(gran));
+  TEST_ASSERT(gran_alloc_movable(gran, &x, 4 << LOG2GRAN, NULL, NULL) == 0);
+  for (i = 0; i < (4 << LOG2GRAN); i++)
+    {
+      ((uint8_t *)x.mem)[i] = (uint8_t)i;
+    }
+
+  gran_free(gran, filler[0], 1 << LOG2GRAN);
+  TEST_ASSERT(gran_compact(gran, 1 << 20) == 4 << LOG2GRAN);
+  TEST_ASSERT(x.mem == gran_heapstart(gran));
+  for (i = 0; i < (4 << LOG2GRAN); i++)
+    {
+      TEST_ASSERT(((uint8_t *)x.mem)[i] == (uint8_t)i);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree - 4 && test_mxfree(gran) == nfree - 4);
+  TEST_ASSERT(gran_compact(gran, 1 << 20) == 0);
+  gran_epoch_release(gran, 1);
+  TEST_ASSERT(x.mem == NULL && test_nfree(gran) == nfree);
+
+  TEST_ASSERT(gran_compact_remap(gran) == -EINVAL);
+  test_heap_free(gran, mem);
+
+  /* Page sized granules: the pages move, new zero pages are left behind */
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  for (log2page = 0; ((size_t)1 << log2page) < pagesize; log2page++)
+    {
+    }
+
+  mem = mmap(NULL, 64 * pagesize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  TEST_ASSERT(mem != MAP_FAILED);
+  gran = gran_initialize(mem, 64 * pagesize, log2page, log2page);
+  TEST_ASSERT(gran != NULL && gran_compact_remap(gran) == 0);
+
+  filler[0] = gran_alloc(gran, 2 * pagesize);
+  TEST_ASSERT(gran_alloc_movable(gran, &x, 2 * pagesize, NULL, NULL) == 0);
+  p = x.mem;
+  memset(p, 'r', 2 * pagesize);
+  gran_free(gran, filler[0], 2 * pagesize);
+
+  TEST_ASSERT(gran_compact(gran, 1 << 20) == (ssize_t)(2 * pagesize));
+  TEST_ASSERT(x.mem == filler[0]);
+  TEST_ASSERT(((uint8_t *)x.mem)[0] == 'r' &&
+              ((uint8_t *)x.mem)[2 * pagesize - 1] == 'r');
+  TEST_ASSERT(p[0] == 0 && p[2 * pagesize - 1] == 0);
+
+  gran_free_movable(gran, &x);
+  gran_release(gran);
+  munmap(mem, 64 * pagesize);
+  return 0;
+}
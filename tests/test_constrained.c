@@ -0,0 +1,221 @@
+/****************************************************************************
+ * tests/test_constrained.c
+ * gran_alloc_constrained() must only return memory inside [lo, hi) that
+ * does not cross the boundary, and must find the first such run, also
+ * when it continues across GAT entries.  Random requests are checked
+ * against a first fit search over a shadow map of the heap.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+#define NGRAN     256
+#define MAXGRAN   (NGRAN + 64)
+#define NROUNDS   20000
+
+static uintptr_t g_base;
+static uint32_t  g_n;
+static uint8_t   g_used[MAXGRAN];
+static uint8_t   g_size[MAXGRAN];
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+/* The first run of n free granules inside [lo, hi) that does not cross
+ * the boundary, or -1.
+ */
+
+static int reference(unsigned int n, uintptr_t lo, uintptr_t hi, size_t boundary)
+{
+  uintptr_t    start;
+  uintptr_t    end;
+  unsigned int g;
+  unsigned int i;
+
+  for (g = 0; g + n <= g_n; g++)
+    {
+      start = (uintptr_t)gran_at(g);
+      end   = start + n * GRANSIZE;
+      if (start < lo || end > hi)
+        {
+          continue;
+        }
+
+      if (boundary != 0 && (start & ~(boundary - 1)) != ((end - 1) & ~(boundary - 1)))
+        {
+          continue;
+        }
+
+      for (i = 0; i < n && !g_used[g + i]; i++)
+        {
+        }
+
+      if (i == n)
+        {
+          return g;
+        }
+    }
+
+  return -1;
+}
+
+int main(void)
+{
+  struct mm_gran *gran;
+  uintptr_t       lo;
+  uintptr_t       hi;
+  uintptr_t       b;
+  size_t          boundary;
+  unsigned int    n;
+  unsigned int    g;
+  unsigned int    i;
+  void           *mem;
+  void           *p;
+  int             expect;
+  int             round;
+
+  gran   = test_heap(4096 + (NGRAN << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(gran);
+  g_n    = test_nfree(gran);
+  TEST_ASSERT(g_n >= 128 && g_n <= MAXGRAN);
+
+  /* Range: first fit inside, hi exclusive, lo rounded up to a granule */
+
+  TEST_ASSERT(gran_alloc_constrained(gran, 2 * GRANSIZE, (uintptr_t)gran_at(50),
+                                     (uintptr_t)gran_at(60), 0) == gran_at(50));
+  TEST_ASSERT(gran_alloc_constrained(gran, 2 * GRANSIZE, (uintptr_t)gran_at(50),
+                                     (uintptr_t)gran_at(60), 0) == gran_at(52));
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, (uintptr_t)gran_at(70) + 1,
+                                     UINTPTR_MAX, 0) == gran_at(71));
+  TEST_ASSERT(gran_alloc_constrained(gran, 2 * GRANSIZE, (uintptr_t)gran_at(80),
+                                     (uintptr_t)gran_at(82), 0) == gran_at(80));
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, (uintptr_t)gran_at(80),
+                                     (uintptr_t)gran_at(82), 0) == NULL);
+
+  /* Rejected: empty, too small or outside of the heap */
+
+  TEST_ASSERT(gran_alloc_constrained(gran, 0, 0, UINTPTR_MAX, 0) == NULL);
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, (uintptr_t)gran_at(90),
+                                     (uintptr_t)gran_at(90), 0) == NULL);
+  TEST_ASSERT(gran_alloc_constrained(gran, 3 * GRANSIZE, (uintptr_t)gran_at(90),
+                                     (uintptr_t)gran_at(92), 0) == NULL);
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, 0, g_base, 0) == NULL);
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, (uintptr_t)gran_at(g_n),
+                                     UINTPTR_MAX, 0) == NULL);
+  TEST_ASSERT(gran_alloc_constrained(gran, GRANSIZE, 0, UINTPTR_MAX, 0) == gran_at(0));
+
+  gran_free(gran, gran_at(0), GRANSIZE);
+  gran_free(gran, gran_at(50), 4 * GRANSIZE);
+  gran_free(gran, gran_at(71), GRANSIZE);
+  gran_free(gran, gran_at(80), 2 * GRANSIZE);
+  TEST_ASSERT(test_nfree(gran) == g_n);
+
+  /* Boundary: a run that would cross moves up to the boundary */
+
+  boundary = 16 * GRANSIZE;
+  b = ((uintptr_t)gran_at(40) + boundary - 1) & ~(boundary - 1);
+  g = (b - g_base) >> LOG2GRAN;
+  TEST_ASSERT(b == (uintptr_t)gran_at(g));
+
+  TEST_ASSERT(gran_alloc_constrained(gran, 4 * GRANSIZE, b - 2 * GRANSIZE,
+                                     UINTPTR_MAX, 0) == gran_at(g - 2));
+  gran_free(gran, gran_at(g - 2), 4 * GRANSIZE);
+  TEST_ASSERT(gran_alloc_constrained(gran, 4 * GRANSIZE, b - 2 * GRANSIZE,
+                                     UINTPTR_MAX, boundary) == gran_at(g));
+  gran_free(gran, gran_at(g), 4 * GRANSIZE);
+
+  TEST_ASSERT(gran_alloc_constrained(gran, boundary + 1, 0, UINTPTR_MAX, boundary) == NULL);
+  TEST_ASSERT(test_nfree(gran) == g_n);
+
+  /* A run that starts in one GAT entry and ends in the next */
+
+  for (i = 0; i < g_n; i++)
+    {
+      TEST_ASSERT(gran_alloc(gran, GRANSIZE) == gran_at(i));
+    }
+
+  gran_free(gran, gran_at(30), 4 * GRANSIZE);
+  TEST_ASSERT(gran_alloc_constrained(gran, 4 * GRANSIZE, 0, UINTPTR_MAX, 0) == gran_at(30));
+  for (i = 0; i < g_n; i++)
+    {
+      gran_free(gran, gran_at(i), GRANSIZE);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == g_n);
+
+  /* Random requests and frees against the reference */
+
+  srand(59);
+  for (round = 0; round < NROUNDS; round++)
+    {
+      g = rand() % g_n;
+      if (rand() % 3 == 0)
+        {
+          /* Free the allocation starting at or after g, if any */
+
+          while (g < g_n && g_size[g] == 0)
+            {
+              g++;
+            }
+
+          if (g < g_n)
+            {
+              gran_free(gran, gran_at(g), g_size[g] * GRANSIZE);
+              memset(&g_used[g], 0, g_size[g]);
+              g_size[g] = 0;
+            }
+
+          continue;
+        }
+
+      n        = 1 + rand() % 8;
+      lo       = (uintptr_t)gran_at(g) + (rand() % 2) * (rand() % GRANSIZE);
+      hi       = (uintptr_t)gran_at(g + rand() % 64);
+      boundary = rand() % 2 ? (size_t)GRANSIZE << (3 + rand() % 3) : 0;
+
+      expect = reference(n, lo, hi, boundary);
+      p      = gran_alloc_constrained(gran, n * GRANSIZE, lo, hi, boundary);
+      if (expect < 0)
+        {
+          TEST_ASSERT(p == NULL);
+          continue;
+        }
+
+      TEST_ASSERT(p == gran_at(expect));
+      memset(&g_used[expect], 1, n);
+      g_size[expect] = n;
+    }
+
+  for (g = 0; g < g_n; g++)
+    {
+      if (g_size[g] != 0)
+        {
+          gran_free(gran, gran_at(g), g_size[g] * GRANSIZE);
+        }
+    }
+
+  TEST_ASSERT(test_nfree(gran) == g_n);
+  test_heap_free(gran, mem);
+  return 0;
+}
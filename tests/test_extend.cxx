@@ -0,0 +1,93 @@
+/****************************************************************************
+ * tests/test_extend.cxx
+ * gran_extend() must resize in place or fail without side effects, and
+ * gran::extent must own exactly one allocation.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "gran.hxx"
+
+#include "tests/gran_test.h"
+
+int main(void)
+{
+  struct mm_gran *gran;
+  void           *mem;
+  uint32_t        nfree;
+  char           *a;
+  char           *b;
+
+  gran  = test_heap(1 << 16, 6, &mem);
+  nfree = test_nfree(gran);
+
+  /* Grow into free granules, fail when blocked, shrink */
+
+  a = (char *)gran_alloc(gran, 64);
+  TEST_ASSERT(gran_extend(gran, a, 64, 256) == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 4);
+
+  b = (char *)gran_alloc(gran, 64);
+  TEST_ASSERT(b == a + 256);
+  TEST_ASSERT(gran_extend(gran, a, 256, 300) == -ENOMEM);
+  TEST_ASSERT(test_nfree(gran) == nfree - 5);
+
+  TEST_ASSERT(gran_extend(gran, a, 256, 100) == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 3);
+  TEST_ASSERT(gran_alloc(gran, 128) == a + 128);
+  gran_free(gran, a + 128, 128);
+  gran_free(gran, a, 100);
+  gran_free(gran, b, 64);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* extent */
+
+  {
+    gran::extent e(gran, 100);
+    gran::extent empty(gran, 33 << 6);
+
+    TEST_ASSERT(e && !empty);
+    TEST_ASSERT(e.size() == 128 && e.ngranules() == 2);
+    TEST_ASSERT(e.gran() == gran);
+    TEST_ASSERT(test_nfree(gran) == nfree - 2);
+
+    TEST_ASSERT(e.grow(64 * 10));
+    TEST_ASSERT(e.size() == 640);
+
+    gran::extent moved(std::move(e));
+    TEST_ASSERT(!e && moved && moved.size() == 640);
+    TEST_ASSERT(test_nfree(gran) == nfree - 10);
+
+    gran::extent other(gran, 64);
+    other = std::move(moved);
+    TEST_ASSERT(other.size() == 640 && test_nfree(gran) == nfree - 10);
+
+    std::size_t size = other.size();
+    void       *raw  = other.release();
+
+    TEST_ASSERT(!other && raw != nullptr);
+    gran_free(gran, raw, size);
+    TEST_ASSERT(test_nfree(gran) == nfree);
+
+    gran::extent last(gran, 64);
+    last.data()[63] = std::byte(1);
+  }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  test_heap_free(gran, mem);
+  return 0;
+}
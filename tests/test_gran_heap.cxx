@@ -0,0 +1,123 @@
+/****************************************************************************
+ * tests/test_gran_heap.cxx
+ * gran_heap must place allocations exactly like a run time heap of the
+ * same geometry, and its C shim must reach the same instance.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "gran.hxx"
+
+#include "tests/gran_test.h"
+
+/* 100 granules, so the last GAT entry is partly used */
+
+#define LOG2GRAN   6
+#define NGRANULES  100
+
+static gran_heap<LOG2GRAN, 4, NGRANULES << LOG2GRAN> g_heap;
+
+GRAN_HEAP_DEFINE(g_shim, 8, 8, 4096)
+GRAN_HEAP_DECLARE(g_shim);
+
+int main(void)
+{
+  struct graninfo  a;
+  struct graninfo  b;
+  struct mm_gran  *gran;
+  void            *mem;
+  uintptr_t        base;
+  void            *p[NGRANULES];
+  void            *q[NGRANULES];
+  size_t           size[NGRANULES];
+  int              i;
+  int              round;
+
+  /* A run time heap with at least NGRANULES granules */
+
+  gran = test_heap(4096 + (NGRANULES << LOG2GRAN), LOG2GRAN, &mem);
+  gran_info(gran, &a);
+  base = (uintptr_t)gran_alloc(gran, 1);
+  gran_free(gran, (void *)base, 1);
+
+  /* Reserve the extra granules so both heaps have the same size */
+
+  for (i = NGRANULES; i < (int)a.ngranules; i++)
+    {
+      gran_reserve(gran, base + ((uintptr_t)i << LOG2GRAN), 1 << LOG2GRAN);
+    }
+
+  srand(1);
+  for (i = 0; i < NGRANULES; i++)
+    {
+      p[i] = q[i] = nullptr;
+    }
+
+  for (round = 0; round < 20000; round++)
+    {
+      i = rand() % NGRANULES;
+      if (p[i] != nullptr)
+        {
+          g_heap.free(p[i], size[i]);
+          gran_free(gran, q[i], size[i]);
+          p[i] = q[i] = nullptr;
+        }
+      else
+        {
+          size[i] = 1 + rand() % (32 << LOG2GRAN);
+          p[i] = g_heap.alloc(size[i]);
+          q[i] = gran_alloc(gran, size[i]);
+          TEST_ASSERT((p[i] == nullptr) == (q[i] == nullptr));
+          if (p[i] != nullptr)
+            {
+              TEST_ASSERT((uintptr_t)p[i] % 16 == 0);
+              TEST_ASSERT((uintptr_t)p[i] - (uintptr_t)g_heap.base() ==
+                          (uintptr_t)q[i] - base);
+              TEST_ASSERT(g_heap.contains(p[i]));
+            }
+        }
+
+      if (round % 97 == 0)
+        {
+          g_heap.info(&a);
+          gran_info(gran, &b);
+          TEST_ASSERT(a.ngranules == NGRANULES);
+          TEST_ASSERT(a.nfree == b.nfree);
+          TEST_ASSERT(a.mxfree == b.mxfree);
+        }
+    }
+
+  TEST_ASSERT(g_heap.alloc(0) == nullptr);
+  TEST_ASSERT(g_heap.alloc((32 << LOG2GRAN) + 1) == nullptr);
+  test_heap_free(gran, mem);
+
+  /* The C shim: 16 granules of 256 bytes */
+
+  void *s1 = g_shim_alloc(300);
+  void *s2 = g_shim_alloc(256);
+
+  TEST_ASSERT(s1 != nullptr && s2 != nullptr);
+  TEST_ASSERT((uintptr_t)s2 - (uintptr_t)s1 == 512);
+  TEST_ASSERT((uintptr_t)s1 % 256 == 0);
+  g_shim_info(&a);
+  TEST_ASSERT(a.log2gran == 8 && a.ngranules == 16 && a.nfree == 13);
+  g_shim_free(s1, 300);
+  g_shim_free(s2, 256);
+  g_shim_info(&a);
+  TEST_ASSERT(a.nfree == 16 && a.mxfree == 16);
+  return 0;
+}
@@ -0,0 +1,143 @@
+/****************************************************************************
+ * tests/test_granmalloc.c
+ * Unmodified programs must run under libgranmalloc.so, including a
+ * multithreaded program that forks while other threads allocate.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "tests/gran_test.h"
+
+#define NTHREADS  4
+#define NFORKS    200
+
+static volatile int g_stop;
+
+static void *churn(void *arg)
+{
+  void *p[64] = { 0 };
+  int   i = 0;
+
+  (void)arg;
+  while (!g_stop)
+    {
+      free(p[i]);
+      p[i] = malloc(1 + (i * 977) % 20000);
+      i    = (i + 1) % 64;
+    }
+
+  for (i = 0; i < 64; i++)
+    {
+      free(p[i]);
+    }
+
+  return NULL;
+}
+
+/* Runs under the interposer: fork while other threads allocate */
+
+static int forker(void)
+{
+  pthread_t thread[NTHREADS];
+  pid_t     pid;
+  int       status;
+  int       i;
+
+  for (i = 0; i < NTHREADS; i++)
+    {
+      pthread_create(&thread[i], NULL, churn, NULL);
+    }
+
+  for (i = 0; i < NFORKS; i++)
+    {
+      pid = fork();
+      if (pid == 0)
+        {
+          void *p = malloc(5000);
+
+          memset(p, 1, 5000);
+          free(p);
+          _exit(0);
+        }
+
+      if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+          WEXITSTATUS(status) != 0)
+        {
+          return 1;
+        }
+    }
+
+  g_stop = 1;
+  for (i = 0; i < NTHREADS; i++)
+    {
+      pthread_join(thread[i], NULL);
+    }
+
+  return 0;
+}
+
+/* Run argv with the interposer preloaded; a hang counts as failure */
+
+static int run(char *const argv[])
+{
+  pid_t pid;
+  int   status;
+
+  pid = fork();
+  if (pid == 0)
+    {
+      setenv("LD_PRELOAD", getenv("GRAN_MALLOC_LIB"), 1);
+      setenv("LD_BIND_NOW", "1", 1);
+      alarm(60);
+      execv(argv[0], argv);
+      _exit(127);
+    }
+
+  TEST_ASSERT(waitpid(pid, &status, 0) == pid);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int main(int argc, char *argv[])
+{
+  char  self[4096];
+  char *ls[]   = { "/bin/ls", "-lR", "/usr/include", NULL };
+  char *fork[] = { self, "fork", NULL };
+  int   fd;
+
+  if (argc > 1 && strcmp(argv[1], "fork") == 0)
+    {
+      return forker();
+    }
+
+  TEST_ASSERT(getenv("GRAN_MALLOC_LIB") != NULL);
+  TEST_ASSERT(realpath("/proc/self/exe", self) != NULL);
+
+  /* Keep the output of ls out of the test log */
+
+  fd = dup(1);
+  TEST_ASSERT(freopen("/dev/null", "w", stdout) != NULL);
+  TEST_ASSERT(run(ls) == 0);
+  dup2(fd, 1);
+
+  TEST_ASSERT(run(fork) == 0);
+  return 0;
+}
@@ -0,0 +1,76 @@
+/****************************************************************************
+ * tests/test_handle.c
+ * Allocation handles must convert to the same memory as the pointers
+ * and must not depend on where the granule area is mapped.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+int main(void)
+{
+  struct mm_gran *gran;
+  void           *mem;
+  void           *base;
+  char           *copy;
+  uint32_t        nfree;
+  uint32_t        h[3];
+  uint8_t         log2gran;
+  size_t          areasize;
+
+  gran     = test_heap(1 << 16, 8, &mem);
+  base     = gran_heapstart(gran);
+  log2gran = gran_log2gran(gran);
+  nfree    = test_nfree(gran);
+  TEST_ASSERT(log2gran == 8);
+
+  h[0] = gran_alloc_handle(gran, 100);
+  h[1] = gran_alloc_handle(gran, 600);
+  h[2] = gran_alloc_handle(gran, 256);
+  TEST_ASSERT(h[0] == 0 && h[1] == 1 && h[2] == 4);
+
+  strcpy(gran_handle_to_ptr(base, log2gran, h[1]), "handle");
+  TEST_ASSERT(gran_ptr_to_handle(base, log2gran,
+                                 gran_handle_to_ptr(base, log2gran, h[2])) == h[2]);
+
+  /* The same handle resolves in a copy of the granule area */
+
+  areasize = (size_t)nfree << log2gran;
+  copy     = malloc(areasize);
+  memcpy(copy, base, areasize);
+  TEST_ASSERT(strcmp(gran_handle_to_ptr(copy, log2gran, h[1]), "handle") == 0);
+  free(copy);
+
+  gran_free_handle(gran, h[1], 600);
+  TEST_ASSERT(gran_alloc_handle(gran, 512) == 1);
+  gran_free_handle(gran, 1, 512);
+  gran_free_handle(gran, h[0], 100);
+  gran_free_handle(gran, h[2], 256);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* Exhaust the heap */
+
+  while (gran_alloc_handle(gran, 32 << 8) != GRAN_INVALID_HANDLE);
+  while (gran_alloc_handle(gran, 1) != GRAN_INVALID_HANDLE);
+  TEST_ASSERT(test_nfree(gran) == 0);
+
+  test_heap_free(gran, mem);
+  return 0;
+}
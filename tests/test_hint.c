@@ -0,0 +1,173 @@
+/****************************************************************************
+ * tests/test_hint.c
+ * Lifetime hinted allocations must be placed by class, and the pinned
+ * region must shrink again when its lowest allocation goes away.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+
+static struct mm_gran *g_gran;
+static uintptr_t       g_base;
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+/* Reserve every granule except [hole, hole + n), place a pinned
+ * allocation of n granules there and free the rest again.
+ */
+
+static void *pin_at(unsigned int hole, unsigned int n, uint32_t ngranules)
+{
+  unsigned int i;
+  void        *pinned;
+
+  for (i = 0; i < ngranules; i++)
+    {
+      if (i < hole || i >= hole + n)
+        {
+          TEST_ASSERT(gran_reserve(g_gran, (uintptr_t)gran_at(i), GRANSIZE) == 0);
+        }
+    }
+
+  pinned = gran_alloc_hint(g_gran, n * GRANSIZE, GRAN_HINT_PINNED);
+  TEST_ASSERT(pinned == gran_at(hole));
+
+  for (i = 0; i < ngranules; i++)
+    {
+      if (i < hole || i >= hole + n)
+        {
+          gran_free(g_gran, gran_at(i), GRANSIZE);
+        }
+    }
+
+  return pinned;
+}
+
+int main(void)
+{
+  struct gran_hintinfo info;
+  uint32_t             n;
+  void                *mem;
+  void                *pinned;
+  void                *p;
+  void                *q;
+  void                *r;
+
+  g_gran = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(g_gran);
+  n      = test_nfree(g_gran);
+
+  /* Short from the bottom, pinned at the top, long right below pinned */
+
+  p = gran_alloc_hint(g_gran, 2 * GRANSIZE, GRAN_HINT_SHORT);
+  TEST_ASSERT(p == gran_at(0));
+  pinned = gran_alloc_hint(g_gran, 2 * GRANSIZE, GRAN_HINT_PINNED);
+  TEST_ASSERT(pinned == gran_at(n - 2));
+  q = gran_alloc_hint(g_gran, 3 * GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(n - 5));
+
+  gran_hint_info(g_gran, GRAN_HINT_LONG, &info);
+  TEST_ASSERT(info.nalloc == 1 && info.nlive == 3 && info.nfallback == 0);
+
+  gran_free_hint(g_gran, p, 2 * GRANSIZE, GRAN_HINT_SHORT);
+  gran_free_hint(g_gran, q, 3 * GRANSIZE, GRAN_HINT_LONG);
+  gran_free_hint(g_gran, pinned, 2 * GRANSIZE, GRAN_HINT_PINNED);
+  gran_hint_info(g_gran, GRAN_HINT_LONG, &info);
+  TEST_ASSERT(info.nlive == 0);
+  TEST_ASSERT(test_nfree(g_gran) == n);
+
+  /* A pinned allocation that had to go low pushes long ones below it,
+   * and only while it exists.
+   */
+
+  pinned = pin_at(10, 2, n);
+  q = gran_alloc_hint(g_gran, 2 * GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(8));
+  gran_free_hint(g_gran, q, 2 * GRANSIZE, GRAN_HINT_LONG);
+
+  gran_free_hint(g_gran, pinned, 2 * GRANSIZE, GRAN_HINT_PINNED);
+  q = gran_alloc_hint(g_gran, 2 * GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(n - 2));
+  gran_free_hint(g_gran, q, 2 * GRANSIZE, GRAN_HINT_LONG);
+
+  /* The same when the pinned memory is freed with gran_free() */
+
+  pinned = pin_at(20, 1, n);
+  gran_free(g_gran, pinned, GRANSIZE);
+  q = gran_alloc_hint(g_gran, GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(n - 1));
+  gran_free_hint(g_gran, q, GRANSIZE, GRAN_HINT_LONG);
+
+  /* The pinned region ends at the next pinned allocation */
+
+  pinned = pin_at(30, 1, n);
+  p      = gran_alloc_hint(g_gran, GRANSIZE, GRAN_HINT_PINNED);
+  TEST_ASSERT(p == gran_at(n - 1));
+  gran_free(g_gran, pinned, GRANSIZE);
+  q = gran_alloc_hint(g_gran, GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(n - 2));
+
+  gran_hint_info(g_gran, GRAN_HINT_LONG, &info);
+  TEST_ASSERT(info.nfallback == 0 && info.nfail == 0);
+
+  gran_free_hint(g_gran, q, GRANSIZE, GRAN_HINT_LONG);
+  gran_free_hint(g_gran, p, GRANSIZE, GRAN_HINT_PINNED);
+  TEST_ASSERT(test_nfree(g_gran) == n);
+
+  /* The long region is as large as the long demand and reuses its holes
+   * best fit before it grows downwards.
+   */
+
+  p = gran_alloc_hint(g_gran, 2 * GRANSIZE, GRAN_HINT_LONG);
+  q = gran_alloc_hint(g_gran, 1 * GRANSIZE, GRAN_HINT_LONG);
+  r = gran_alloc_hint(g_gran, 3 * GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(p == gran_at(n - 2) && q == gran_at(n - 3) && r == gran_at(n - 6));
+
+  gran_free_hint(g_gran, q, 1 * GRANSIZE, GRAN_HINT_LONG);
+  q = gran_alloc_hint(g_gran, 1 * GRANSIZE, GRAN_HINT_LONG);
+  TEST_ASSERT(q == gran_at(n - 3));
+
+  gran_hint_info(g_gran, GRAN_HINT_LONG, &info);
+  TEST_ASSERT(info.nfallback == 0 && info.nlive == 6);
+  gran_free_hint(g_gran, p, 2 * GRANSIZE, GRAN_HINT_LONG);
+  gran_free_hint(g_gran, q, 1 * GRANSIZE, GRAN_HINT_LONG);
+  gran_free_hint(g_gran, r, 3 * GRANSIZE, GRAN_HINT_LONG);
+
+  /* A short allocation that does not fit in its region spills right
+   * above it and counts as a fallback.
+   */
+
+  q = gran_alloc(g_gran, 8 * GRANSIZE);
+  TEST_ASSERT(q == gran_at(0));
+  p = gran_alloc_hint(g_gran, GRANSIZE, GRAN_HINT_SHORT);
+  TEST_ASSERT(p == gran_at(8));
+  gran_hint_info(g_gran, GRAN_HINT_SHORT, &info);
+  TEST_ASSERT(info.nfallback == 1 && info.nlive == 1);
+  gran_free_hint(g_gran, p, GRANSIZE, GRAN_HINT_SHORT);
+  gran_free(g_gran, q, 8 * GRANSIZE);
+  TEST_ASSERT(test_nfree(g_gran) == n);
+
+  test_heap_free(g_gran, mem);
+  return 0;
+}
@@ -0,0 +1,156 @@
+/****************************************************************************
+ * tests/test_iopool.c
+ * An I/O pool buffer must never cross a 1 GiB region boundary and must
+ * report the fixed buffer index of its region.  A pool set up without a
+ * ring skips registration but still allocates, frees and releases.  The
+ * registered path is only run if the kernel provides io_uring.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "tests/gran_test.h"
+
+#define REGION    ((uintptr_t)1 << 30)
+#define LOG2GRAN  16
+#define GRANSIZE  ((size_t)1 << LOG2GRAN)
+#define HEAPSIZE  (64 * GRANSIZE)
+#define BUFSIZE   (5 * GRANSIZE)
+#define MAXBUFS   64
+
+/* Build a heap whose granules straddle a region boundary: the first 32
+ * granules are below it and the rest above.
+ */
+
+static struct mm_gran *test_straddle(uint8_t *reserve)
+{
+  uintptr_t boundary = ((uintptr_t)reserve + REGION) & ~(REGION - 1);
+
+  return gran_initialize((void *)(boundary - 32 * GRANSIZE - GRANSIZE),
+                         HEAPSIZE + GRANSIZE, LOG2GRAN, LOG2GRAN);
+}
+
+int main(void)
+{
+  struct io_uring_params params;
+  struct gran_iopool     pool;
+  struct mm_gran        *gran;
+  unsigned int           bufidx;
+  unsigned int           nbuf[2];
+  uint8_t               *reserve;
+  uint8_t               *buf[MAXBUFS];
+  uint32_t               nfree;
+  int                    ringfd;
+  int                    ret;
+  int                    n;
+  int                    i;
+
+  reserve = mmap(NULL, REGION + 2 * HEAPSIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  TEST_ASSERT(reserve != MAP_FAILED);
+
+  /* Registration is skipped without a ring */
+
+  gran = test_straddle(reserve);
+  TEST_ASSERT(gran != NULL);
+  nfree = test_nfree(gran);
+
+  TEST_ASSERT(gran_iopool_register(&pool, gran, -1) == 0);
+  TEST_ASSERT(pool.ringfd == -1 && pool.nbufs == 2);
+
+  /* Fill the heap.  Granules 30..34 span the boundary and are skipped. */
+
+  nbuf[0] = nbuf[1] = 0;
+  for (n = 0; n < MAXBUFS; n++)
+    {
+      buf[n] = gran_iopool_alloc(&pool, BUFSIZE, &bufidx);
+      if (buf[n] == NULL)
+        {
+          break;
+        }
+
+      TEST_ASSERT(((uintptr_t)buf[n] & ~(REGION - 1)) ==
+                  ((uintptr_t)(buf[n] + BUFSIZE - 1) & ~(REGION - 1)));
+      TEST_ASSERT(bufidx < 2);
+      TEST_ASSERT(gran_iopool_bufindex(&pool, buf[n]) == bufidx);
+      TEST_ASSERT(gran_iopool_bufindex(&pool, buf[n] + BUFSIZE - 1) ==
+                  bufidx);
+
+      memset(buf[n], n, BUFSIZE);
+      nbuf[bufidx]++;
+    }
+
+  TEST_ASSERT(n < MAXBUFS);
+  TEST_ASSERT(nbuf[0] == 32 / 5 && nbuf[1] == (nfree - 32) / 5);
+
+  for (i = 0; i < n; i++)
+    {
+      TEST_ASSERT(buf[i][0] == (uint8_t)i &&
+                  buf[i][BUFSIZE - 1] == (uint8_t)i);
+      gran_iopool_free(&pool, buf[i], BUFSIZE);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* Release */
+
+  TEST_ASSERT(gran_iopool_unregister(&pool) == 0);
+  TEST_ASSERT(pool.nbufs == 0);
+  gran_release(gran);
+
+  /* Register with a real ring where the kernel allows it */
+
+  memset(&params, 0, sizeof(params));
+  ringfd = syscall(__NR_io_uring_setup, 1, &params);
+  if (ringfd < 0)
+    {
+      printf("io_uring not available, registration not tested\n");
+    }
+  else
+    {
+      gran = test_straddle(reserve);
+      TEST_ASSERT(gran != NULL);
+
+      ret = gran_iopool_register(&pool, gran, ringfd);
+      if (ret < 0)
+        {
+          printf("gran_iopool_register: %s, registration not tested\n",
+                 strerror(-ret));
+        }
+      else
+        {
+          TEST_ASSERT(pool.ringfd == ringfd && pool.nbufs == 2);
+
+          buf[0] = gran_iopool_alloc(&pool, BUFSIZE, &bufidx);
+          TEST_ASSERT(buf[0] != NULL && bufidx == 0);
+          gran_iopool_free(&pool, buf[0], BUFSIZE);
+
+          TEST_ASSERT(gran_iopool_unregister(&pool) == 0);
+        }
+
+      gran_release(gran);
+      close(ringfd);
+    }
+
+  munmap(reserve, REGION + 2 * HEAPSIZE);
+  return 0;
+}
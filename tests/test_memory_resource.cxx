@@ -0,0 +1,131 @@
+/****************************************************************************
+ * tests/test_memory_resource.cxx
+ * Containers on gran_memory_resource and gran_allocator must take their
+ * memory from the heap and give all of it back.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "gran.hxx"
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "tests/gran_test.h"
+
+static bool inheap(struct mm_gran *gran, const void *p)
+{
+  struct graninfo info;
+
+  gran_info(gran, &info);
+  return (uintptr_t)p - (uintptr_t)gran_heapstart(gran) <
+         ((uintptr_t)info.ngranules << info.log2gran);
+}
+
+int main(void)
+{
+  struct mm_gran *gran;
+  void           *mem;
+  uint32_t        nfree;
+  bool            thrown;
+
+  gran  = test_heap(1 << 20, 8, &mem);
+  nfree = test_nfree(gran);
+
+  /* std::pmr containers */
+
+  {
+    gran_memory_resource res(gran);
+    gran_memory_resource same(gran);
+    std::pmr::vector<int> v(&res);
+    std::pmr::unordered_map<int, int> m(&res);
+
+    for (int i = 0; i < 500; i++)
+      {
+        v.push_back(i);
+        m[i] = 2 * i;
+      }
+
+    TEST_ASSERT(inheap(gran, v.data()));
+    TEST_ASSERT(inheap(gran, &m.at(250)));
+    TEST_ASSERT(m.at(499) == 998 && v[499] == 499);
+    TEST_ASSERT(test_nfree(gran) < nfree);
+    TEST_ASSERT(res.is_equal(same));
+    TEST_ASSERT(!res.is_equal(*std::pmr::new_delete_resource()));
+
+    /* Larger than 32 granules, and over-aligned */
+
+    thrown = false;
+    try
+      {
+        (void)res.allocate(33 << 8);
+      }
+    catch (const std::bad_alloc &)
+      {
+        thrown = true;
+      }
+
+    TEST_ASSERT(thrown);
+
+    thrown = false;
+    try
+      {
+        (void)res.allocate(64, 512);
+      }
+    catch (const std::bad_alloc &)
+      {
+        thrown = true;
+      }
+
+    TEST_ASSERT(thrown);
+
+    /* Zero sized requests get distinct addresses */
+
+    void *a = res.allocate(0);
+    void *b = res.allocate(0);
+
+    TEST_ASSERT(a != b);
+    res.deallocate(a, 0);
+    res.deallocate(b, 0);
+  }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* gran_allocator with the standard containers */
+
+  {
+    gran_allocator<long> alloc(gran);
+    std::vector<long, gran_allocator<long>> v(alloc);
+    std::list<long, gran_allocator<long>> l(alloc);
+
+    for (long i = 0; i < 300; i++)
+      {
+        v.push_back(i);
+        l.push_back(i);
+      }
+
+    TEST_ASSERT(inheap(gran, v.data()));
+    TEST_ASSERT(inheap(gran, &l.back()));
+    TEST_ASSERT(l.get_allocator() == gran_allocator<int>(gran));
+    TEST_ASSERT(test_nfree(gran) < nfree);
+  }
+
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  test_heap_free(gran, mem);
+  return 0;
+}
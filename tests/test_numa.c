@@ -0,0 +1,148 @@
+/****************************************************************************
+ * tests/test_numa.c
+ * On a simulated topology allocations must come from the calling CPU's
+ * node while it has room, fall back to the following nodes in order and
+ * count as remote hits of the caller's node, and be freed to the sub-heap
+ * that contains them.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  12
+#define GRANSIZE  (1 << LOG2GRAN)
+#define NNODES    4
+#define NODESIZE  (64 * GRANSIZE)
+#define MAXGRAN   64
+
+static struct gran_numa_info info(struct gran_numa *numa, unsigned int node)
+{
+  struct gran_numa_info info;
+
+  TEST_ASSERT(gran_numa_info(numa, node, &info) == 0);
+  return info;
+}
+
+int main(void)
+{
+  struct gran_numa_info ni;
+  struct gran_numa     *numa;
+  cpu_set_t             cpus;
+  unsigned int          home;
+  unsigned int          next;
+  unsigned int          node;
+  uint32_t              nfree;
+  uint32_t              n;
+  void                 *p[MAXGRAN];
+  void                 *q;
+  void                 *r;
+  int                   cpu;
+
+  TEST_ASSERT(gran_numa_initialize(NODESIZE, LOG2GRAN, 65, GRAN_NUMA_SIMULATE) == NULL);
+
+  /* Stay on one CPU so the home node does not change under the test */
+
+  cpu = sched_getcpu();
+  TEST_ASSERT(cpu >= 0);
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  TEST_ASSERT(sched_setaffinity(0, sizeof(cpus), &cpus) == 0);
+
+  home = cpu % NNODES;
+  next = (home + 1) % NNODES;
+
+  numa = gran_numa_initialize(NODESIZE, LOG2GRAN, NNODES,
+                              GRAN_NUMA_SIMULATE | GRAN_NUMA_INTERLEAVE);
+  TEST_ASSERT(numa != NULL);
+
+  nfree = info(numa, 0).nfree;
+  TEST_ASSERT(nfree > 0 && nfree <= MAXGRAN);
+  for (node = 0; node < NNODES; node++)
+    {
+      ni = info(numa, node);
+      TEST_ASSERT(ni.nfree == nfree && ni.nlocal == 0 && ni.nremote == 0);
+    }
+
+  TEST_ASSERT(gran_numa_info(numa, NNODES, &ni) == -EINVAL);
+
+  /* The home node serves every allocation until it is full */
+
+  for (n = 0; n < nfree; n++)
+    {
+      p[n] = gran_numa_alloc(numa, GRANSIZE);
+      TEST_ASSERT(p[n] != NULL);
+    }
+
+  ni = info(numa, home);
+  TEST_ASSERT(ni.nfree == 0 && ni.nlocal == nfree && ni.nremote == 0);
+
+  /* Then the next node, counted as remote for the home node */
+
+  q = gran_numa_alloc(numa, 2 * GRANSIZE);
+  TEST_ASSERT(q != NULL);
+  ni = info(numa, home);
+  TEST_ASSERT(ni.nlocal == nfree && ni.nremote == 1);
+  ni = info(numa, next);
+  TEST_ASSERT(ni.nfree == nfree - 2 && ni.nlocal == 0 && ni.nremote == 0);
+
+  /* Interleaved memory comes from neither */
+
+  r = gran_numa_alloc_interleaved(numa, GRANSIZE);
+  TEST_ASSERT(r != NULL);
+  for (node = 0; node < NNODES; node++)
+    {
+      TEST_ASSERT(info(numa, node).nfree == (node == home ? 0 : node == next ? nfree - 2 : nfree));
+    }
+
+  /* Frees go to the sub-heap that holds the memory; a freed home granule
+   * is used locally again.
+   */
+
+  gran_numa_free(numa, q, 2 * GRANSIZE);
+  TEST_ASSERT(info(numa, next).nfree == nfree);
+  gran_numa_free(numa, r, GRANSIZE);
+
+  gran_numa_free(numa, p[3], GRANSIZE);
+  TEST_ASSERT(info(numa, home).nfree == 1);
+  TEST_ASSERT(gran_numa_alloc(numa, GRANSIZE) == p[3]);
+  TEST_ASSERT(info(numa, home).nlocal == nfree + 1);
+
+  for (n = 0; n < nfree; n++)
+    {
+      gran_numa_free(numa, p[n], GRANSIZE);
+    }
+
+  for (node = 0; node < NNODES; node++)
+    {
+      TEST_ASSERT(info(numa, node).nfree == nfree);
+    }
+
+  gran_numa_release(numa);
+
+  /* Without GRAN_NUMA_INTERLEAVE there is no interleaved sub-heap */
+
+  numa = gran_numa_initialize(NODESIZE, LOG2GRAN, NNODES, GRAN_NUMA_SIMULATE);
+  TEST_ASSERT(numa != NULL);
+  TEST_ASSERT(gran_numa_alloc_interleaved(numa, GRANSIZE) == NULL);
+  gran_numa_release(numa);
+  return 0;
+}
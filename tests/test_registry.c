@@ -0,0 +1,98 @@
+/****************************************************************************
+ * tests/test_registry.c
+ * gran_lookup() must find every registered heap, also while another heap
+ * that shares a registry chunk with it is registered and unregistered.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+
+#include "tests/gran_test.h"
+
+#define HEAPSIZE  (64 << 10)
+
+static struct mm_gran *g_b;
+static void           *g_bmem;
+static volatile int    g_stop;
+static int             g_misses;
+
+static void *lookup_b(void *arg)
+{
+  (void)arg;
+  while (!g_stop)
+    {
+      if (gran_lookup(g_bmem) != g_b)
+        {
+          __atomic_fetch_add(&g_misses, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+  return NULL;
+}
+
+int main(void)
+{
+  struct mm_gran *a;
+  pthread_t       thread;
+  char           *mem;
+  void           *amem;
+  int             i;
+
+  /* Two small heaps next to each other share a 1 MiB registry chunk */
+
+  mem = aligned_alloc(1 << 20, 2 * HEAPSIZE);
+  a   = gran_initialize(mem, HEAPSIZE, 8, 8);
+  g_b = gran_initialize(mem + HEAPSIZE, HEAPSIZE, 8, 8);
+
+  TEST_ASSERT(gran_register(a) == 0);
+  TEST_ASSERT(gran_register(a) == -EEXIST);
+  TEST_ASSERT(gran_register(g_b) == 0);
+
+  amem   = gran_alloc(a, 100);
+  g_bmem = gran_alloc(g_b, 100);
+  TEST_ASSERT(gran_lookup(amem) == a);
+  TEST_ASSERT(gran_lookup(g_bmem) == g_b);
+  TEST_ASSERT(gran_lookup(&i) == NULL);
+
+  /* Lock-free lookups of b while a comes and goes */
+
+  pthread_create(&thread, NULL, lookup_b, NULL);
+  for (i = 0; i < 20000; i++)
+    {
+      gran_unregister(a);
+      TEST_ASSERT(gran_register(a) == 0);
+    }
+
+  g_stop = 1;
+  pthread_join(thread, NULL);
+  TEST_ASSERT(g_misses == 0);
+
+  gran_free_any(amem, 100);
+  gran_free_any(g_bmem, 100);
+  TEST_ASSERT(test_nfree(a) == test_mxfree(a));
+  TEST_ASSERT(test_nfree(g_b) == test_mxfree(g_b));
+
+  gran_unregister(a);
+  gran_unregister(g_b);
+  TEST_ASSERT(gran_lookup(g_bmem) == NULL);
+  gran_release(a);
+  gran_release(g_b);
+  free(mem);
+  return 0;
+}
@@ -0,0 +1,159 @@
+/****************************************************************************
+ * tests/test_reset.c
+ * gran_reset() must free everything except reserved granules, and the
+ * epochs must refuse to begin while busy and free exactly their own
+ * allocations on release.  Memory owned by streams, arenas and buffers is
+ * never part of an epoch, and an extended allocation stays in its epoch.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+
+int main(void)
+{
+  struct gran_hintinfo hinfo;
+  struct gran_stream   stream;
+  struct gran_arena    arena;
+  struct gran_buf      buf;
+  struct mm_gran      *gran;
+  uintptr_t            base;
+  uint32_t             nfree;
+  void                *mem;
+  void                *p[4];
+  int                  i;
+
+  gran  = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  base  = (uintptr_t)gran_heapstart(gran);
+  nfree = test_nfree(gran);
+
+  /* Reset frees every allocation */
+
+  for (i = 0; i < 4; i++)
+    {
+      p[i] = gran_alloc(gran, (i + 1) << LOG2GRAN);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == nfree - 10);
+  gran_reset(gran);
+  TEST_ASSERT(test_nfree(gran) == nfree && test_mxfree(gran) == nfree);
+  TEST_ASSERT(gran_alloc(gran, 1 << LOG2GRAN) == p[0]);
+
+  /* Reserved granules survive a reset; freeing them unreserves them */
+
+  TEST_ASSERT(gran_reserve(gran, base + (20 << LOG2GRAN), 3 << LOG2GRAN) == 0);
+  TEST_ASSERT(gran_reserve(gran, base + (100 << LOG2GRAN) + 1, 1 << LOG2GRAN) == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1 - 5);
+  gran_reset(gran);
+  TEST_ASSERT(test_nfree(gran) == nfree - 5);
+  TEST_ASSERT(gran_alloc(gran, 32 << LOG2GRAN) == (void *)(base + (23 << LOG2GRAN)));
+
+  gran_free(gran, (void *)(base + (20 << LOG2GRAN)), 3 << LOG2GRAN);
+  gran_reset(gran);
+  TEST_ASSERT(test_nfree(gran) == nfree - 2);
+  gran_free(gran, (void *)(base + (100 << LOG2GRAN)), 2 << LOG2GRAN);
+  gran_reset(gran);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* Hint statistics and the pinned region start over */
+
+  TEST_ASSERT(gran_alloc_hint(gran, 1 << LOG2GRAN, GRAN_HINT_PINNED) != NULL);
+  TEST_ASSERT(gran_alloc_hint(gran, 2 << LOG2GRAN, GRAN_HINT_LONG) != NULL);
+  gran_reset(gran);
+  gran_hint_info(gran, GRAN_HINT_PINNED, &hinfo);
+  TEST_ASSERT(hinfo.nlive == 0);
+  gran_hint_info(gran, GRAN_HINT_LONG, &hinfo);
+  TEST_ASSERT(hinfo.nlive == 0 && hinfo.nfallback == 0);
+  TEST_ASSERT(gran_alloc_hint(gran, 2 << LOG2GRAN, GRAN_HINT_LONG) ==
+              (void *)(base + ((uintptr_t)(nfree - 2) << LOG2GRAN)));
+  gran_hint_info(gran, GRAN_HINT_LONG, &hinfo);
+  TEST_ASSERT(hinfo.nlive == 2 && hinfo.nfallback == 0);
+  gran_reset(gran);
+
+  /* Epochs: begin fails while the next epoch holds allocations */
+
+  TEST_ASSERT(gran_epoch_initialize(gran) == 0);
+  p[0] = gran_alloc(gran, 1 << LOG2GRAN);
+  TEST_ASSERT(gran_epoch_begin(gran) == 1);
+  p[1] = gran_alloc(gran, 2 << LOG2GRAN);
+  TEST_ASSERT(gran_epoch_begin(gran) == 2);
+  TEST_ASSERT(gran_epoch_begin(gran) == 3);
+  TEST_ASSERT(gran_epoch_begin(gran) == -EBUSY);
+  p[3] = gran_alloc(gran, 3 << LOG2GRAN);
+  TEST_ASSERT(test_nfree(gran) == nfree - 6);
+
+  /* Release frees exactly the allocations of one epoch */
+
+  gran_epoch_release(gran, 1);
+  TEST_ASSERT(test_nfree(gran) == nfree - 4);
+  gran_epoch_release(gran, 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 3);
+  TEST_ASSERT(gran_epoch_begin(gran) == 0);
+
+  /* A freed allocation no longer belongs to its epoch */
+
+  gran_free(gran, p[3], 3 << LOG2GRAN);
+  p[0] = gran_alloc(gran, 1 << LOG2GRAN);
+  gran_free(gran, p[0], 1 << LOG2GRAN);
+  TEST_ASSERT(gran_epoch_begin(gran) == 1);
+  TEST_ASSERT(gran_epoch_begin(gran) == 2);
+  TEST_ASSERT(gran_epoch_begin(gran) == 3);
+
+  /* Reserved granules are not tagged and survive the release */
+
+  TEST_ASSERT(gran_reserve(gran, base, 1 << LOG2GRAN) == 0);
+  p[0] = gran_alloc(gran, 1 << LOG2GRAN);
+  gran_epoch_release(gran, 3);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+  TEST_ASSERT(gran_epoch_begin(gran) == 0);
+
+  /* Streams, arenas and buffers keep their memory across a release */
+
+  TEST_ASSERT(gran_stream_initialize(&stream, gran, 40 << LOG2GRAN) == 0);
+  TEST_ASSERT(gran_stream_alloc(&stream, 2 << LOG2GRAN) != NULL);
+  gran_arena_begin(&arena, gran);
+  TEST_ASSERT(gran_arena_alloc(&arena, 8) != NULL);
+  TEST_ASSERT(gran_buf_initialize(gran) == 0);
+  TEST_ASSERT(gran_buf_alloc(gran, 1 << LOG2GRAN, &buf) == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1 - 40 - 32 - 1);
+
+  gran_epoch_release(gran, 0);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1 - 40 - 32 - 1);
+  TEST_ASSERT(gran_epoch_begin(gran) == 1);
+
+  gran_buf_unref(gran, &buf);
+  gran_arena_end(&arena);
+  gran_stream_release(&stream);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+
+  /* Granules added by gran_extend() belong to the epoch of the allocation */
+
+  p[0] = gran_alloc(gran, 1 << LOG2GRAN);
+  TEST_ASSERT(gran_epoch_begin(gran) == 2);
+  TEST_ASSERT(gran_extend(gran, p[0], 1 << LOG2GRAN, 3 << LOG2GRAN) == 0);
+  gran_epoch_release(gran, 2);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1 - 3);
+  gran_epoch_release(gran, 1);
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+
+  test_heap_free(gran, mem);
+  return 0;
+}
@@ -0,0 +1,144 @@
+/****************************************************************************
+ * tests/test_ring.c
+ * A ring must show the same granules through both views, so data written
+ * across the wrap point reads back from the start of the run.  Freeing the
+ * ring must unmap both views and return the granules, and heaps that are
+ * not backed by a memfd must refuse rings.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "tests/gran_test.h"
+
+#define HEAPSIZE  (64 * 4096)
+#define LOG2GRAN  12
+
+/* True if no page of base..base+len is mapped */
+
+static int test_unmapped(void *base, size_t len)
+{
+  size_t pagesize = sysconf(_SC_PAGESIZE);
+  size_t off;
+
+  for (off = 0; off < len; off += pagesize)
+    {
+      if (msync((uint8_t *)base + off, pagesize, MS_ASYNC) == 0 ||
+          errno != ENOMEM)
+        {
+          return 0;
+        }
+    }
+
+  return 1;
+}
+
+int main(void)
+{
+  struct gran_ring  ring;
+  struct gran_ring  ring2;
+  struct mm_gran   *gran;
+  uint8_t          *base;
+  uint8_t          *alloc;
+  uint32_t          nfree;
+  size_t            size;
+  void             *mem;
+  size_t            i;
+
+  gran = gran_initialize_memfd(HEAPSIZE, LOG2GRAN);
+  TEST_ASSERT(gran != NULL);
+  nfree = test_nfree(gran);
+
+  /* Sizes are rounded up to whole granules */
+
+  TEST_ASSERT(gran_alloc_ring(gran, 3 * 4096 - 100, &ring) == 0);
+  size  = ring.size;
+  base  = ring.base;
+  alloc = ring.alloc;
+  TEST_ASSERT(size == 3 * 4096);
+  TEST_ASSERT(test_nfree(gran) == nfree - 3);
+
+  /* Write a record across the wrap point through the first view and read
+   * it back through the second view, and from the heap itself.
+   */
+
+  for (i = 0; i < 1000; i++)
+    {
+      base[size - 500 + i] = (uint8_t)(i * 7 + 1);
+    }
+
+  for (i = 0; i < 500; i++)
+    {
+      TEST_ASSERT(base[2 * size - 500 + i] == (uint8_t)(i * 7 + 1));
+      TEST_ASSERT(alloc[size - 500 + i] == (uint8_t)(i * 7 + 1));
+    }
+
+  for (i = 500; i < 1000; i++)
+    {
+      TEST_ASSERT(base[i - 500] == (uint8_t)(i * 7 + 1));
+      TEST_ASSERT(alloc[i - 500] == (uint8_t)(i * 7 + 1));
+    }
+
+  /* Writes through the second view show up in the first */
+
+  memset(base + size + 100, 0xa5, 200);
+  TEST_ASSERT(base[100] == 0xa5 && base[299] == 0xa5);
+
+  /* A second ring does not share memory with the first */
+
+  TEST_ASSERT(gran_alloc_ring(gran, 4096, &ring2) == 0);
+  TEST_ASSERT(ring2.size == 4096 && ring2.base != ring.base);
+  memset(ring2.base, 0, 2 * 4096);
+  TEST_ASSERT(base[100] == 0xa5 && base[0] == (uint8_t)(500 * 7 + 1));
+
+  /* Freeing unmaps both views and returns the granules */
+
+  gran_free_ring(gran, &ring);
+  TEST_ASSERT(ring.base == NULL && ring.alloc == NULL && ring.size == 0);
+  TEST_ASSERT(test_unmapped(base, 2 * size));
+  TEST_ASSERT(test_nfree(gran) == nfree - 1);
+
+  base = ring2.base;
+  gran_free_ring(gran, &ring2);
+  TEST_ASSERT(test_unmapped(base, 2 * 4096));
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  /* A ring that does not fit fails without leaking granules */
+
+  TEST_ASSERT(gran_alloc_ring(gran, 32 * 4096, &ring) == 0);
+  TEST_ASSERT(gran_alloc_ring(gran, 32 * 4096, &ring2) == -ENOMEM);
+  TEST_ASSERT(test_nfree(gran) == nfree - 32);
+  gran_free_ring(gran, &ring);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+
+  gran_release(gran);
+
+  /* Heaps on caller memory cannot map their granules twice */
+
+  gran = test_heap(HEAPSIZE, LOG2GRAN, &mem);
+  TEST_ASSERT(gran != NULL);
+  nfree = test_nfree(gran);
+  TEST_ASSERT(gran_alloc_ring(gran, 4096, &ring) == -EINVAL);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  test_heap_free(gran, mem);
+
+  return 0;
+}
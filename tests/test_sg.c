@@ -0,0 +1,135 @@
+/****************************************************************************
+ * tests/test_sg.c
+ * gran_alloc_sg() must serve a request from the largest free runs, largest
+ * first, also from runs that continue across GAT entries or end at the end
+ * of the heap, allocate nothing when maxsegs runs are not enough, and hand
+ * out a run of more than 32 granules as a single segment.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+
+static struct mm_gran *g_gran;
+static uintptr_t       g_base;
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+static void free_range(unsigned int first, unsigned int n)
+{
+  while (n-- > 0)
+    {
+      gran_free(g_gran, gran_at(first++), GRANSIZE);
+    }
+}
+
+int main(void)
+{
+  struct iovec iov[4];
+  uint32_t     n;
+  uint32_t     i;
+  void        *mem;
+
+  g_gran = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(g_gran);
+  n      = test_nfree(g_gran);
+  TEST_ASSERT(n >= 96);
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 0, 4, iov) == -EINVAL);
+
+  /* An empty heap: one segment, however many granules it spans */
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 40 * GRANSIZE - 10, 4, iov) == 1);
+  TEST_ASSERT(iov[0].iov_base == gran_at(0) && iov[0].iov_len == 40 * GRANSIZE - 10);
+  TEST_ASSERT(test_nfree(g_gran) == n - 40);
+  memset(iov[0].iov_base, 0xa5, iov[0].iov_len);
+
+  gran_free_sg(g_gran, iov, 1);
+  TEST_ASSERT(test_nfree(g_gran) == n && test_mxfree(g_gran) == n);
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 64 * GRANSIZE, 1, iov) == 1);
+  TEST_ASSERT(iov[0].iov_base == gran_at(0) && iov[0].iov_len == 64 * GRANSIZE);
+  TEST_ASSERT(test_nfree(g_gran) == n - 64);
+  TEST_ASSERT(gran_alloc(g_gran, GRANSIZE) == gran_at(64));
+  gran_free(g_gran, gran_at(64), GRANSIZE);
+
+  gran_free_sg(g_gran, iov, 1);
+  TEST_ASSERT(test_nfree(g_gran) == n && test_mxfree(g_gran) == n);
+
+  /* Free runs of 8 (28..35, across GAT entries 0 and 1), 3, 2 and 4 at
+   * the end of the heap.
+   */
+
+  for (i = 0; i < n; i++)
+    {
+      TEST_ASSERT(gran_alloc(g_gran, GRANSIZE) == gran_at(i));
+    }
+
+  free_range(28, 8);
+  free_range(70, 3);
+  free_range(90, 2);
+  free_range(n - 4, 4);
+
+  /* Not enough in two segments: nothing is allocated */
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 13 * GRANSIZE, 2, iov) == -ENOMEM);
+  TEST_ASSERT(test_nfree(g_gran) == 17);
+  TEST_ASSERT(gran_alloc_sg(g_gran, 18 * GRANSIZE, 4, iov) == -ENOMEM);
+  TEST_ASSERT(test_nfree(g_gran) == 17);
+
+  /* Largest first, the last run only as far as needed */
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 14 * GRANSIZE - 1, 3, iov) == 3);
+  TEST_ASSERT(iov[0].iov_base == gran_at(28) && iov[0].iov_len == 8 * GRANSIZE);
+  TEST_ASSERT(iov[1].iov_base == gran_at(n - 4) && iov[1].iov_len == 4 * GRANSIZE);
+  TEST_ASSERT(iov[2].iov_base == gran_at(70) && iov[2].iov_len == 2 * GRANSIZE - 1);
+  TEST_ASSERT(test_nfree(g_gran) == 3);
+
+  /* Whatever is left, in one request */
+
+  TEST_ASSERT(gran_alloc_sg(g_gran, 3 * GRANSIZE, 1, iov + 3) == -ENOMEM);
+  TEST_ASSERT(gran_alloc_sg(g_gran, 2 * GRANSIZE, 1, iov + 3) == 1);
+  TEST_ASSERT(iov[3].iov_base == gran_at(90));
+  TEST_ASSERT(gran_alloc(g_gran, GRANSIZE) == gran_at(72));
+  TEST_ASSERT(test_nfree(g_gran) == 0);
+  TEST_ASSERT(gran_alloc_sg(g_gran, 1, 4, iov) == -ENOMEM);
+
+  /* Everything goes back */
+
+  gran_free_sg(g_gran, iov, 4);
+  gran_free_sg(g_gran, iov, 0);
+  TEST_ASSERT(test_nfree(g_gran) == 16);
+  free_range(72, 1);
+  free_range(0, 28);
+  free_range(36, 34);
+  free_range(73, 17);
+  free_range(92, n - 96);
+  TEST_ASSERT(test_nfree(g_gran) == n && test_mxfree(g_gran) == n);
+
+  test_heap_free(g_gran, mem);
+  return 0;
+}
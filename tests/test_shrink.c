@@ -0,0 +1,260 @@
+/****************************************************************************
+ * tests/test_shrink.c
+ * Shrinkers must be called in order of priority (registration order for
+ * equal priorities), the allocation must be retried after each one that
+ * freed memory, and an allocation made by a shrinker must not start
+ * another shrink pass of the same heap, while other heaps can still be
+ * shrunk.  Shrinkers can register and unregister shrinkers.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+
+/* Each cache frees its next granule per call, if it has one left */
+
+struct cache
+{
+  char          name;
+  unsigned int  granno[4];
+  unsigned int  ngranules;
+  int           nested;     /* Allocate from inside shrink() */
+  void         *nestedmem;
+};
+
+static uintptr_t            g_base;
+static char                 g_log[32];
+static size_t               g_want;
+static struct gran_shrinker g_late;
+static void                *g_crossmem;
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+static size_t shrink(struct mm_gran *gran, size_t ngranules, void *arg)
+{
+  struct cache *cache = arg;
+
+  g_log[strlen(g_log)] = cache->name;
+  TEST_ASSERT(ngranules == g_want);
+
+  if (cache->nested)
+    {
+      /* Fails without calling the shrinkers again */
+
+      cache->nestedmem = gran_alloc(gran, GRANSIZE);
+    }
+
+  if (cache->ngranules == 0)
+    {
+      return 0;
+    }
+
+  gran_free(gran, gran_at(cache->granno[--cache->ngranules]), GRANSIZE);
+  return 1;
+}
+
+/* Unregisters itself and registers g_late, without freeing anything */
+
+static size_t reshuffle(struct mm_gran *gran, size_t ngranules, void *arg)
+{
+  g_log[strlen(g_log)] = 'R';
+  gran_shrinker_unregister(gran, arg);
+  gran_shrinker_register(gran, &g_late);
+  return 0;
+}
+
+/* Allocates from another heap, which has shrinkers of its own */
+
+static size_t cross(struct mm_gran *gran, size_t ngranules, void *arg)
+{
+  g_log[strlen(g_log)] = 'X';
+  g_crossmem = gran_alloc(arg, GRANSIZE);
+  return 0;
+}
+
+/* Frees the granule that arg points to, once */
+
+static size_t free_one(struct mm_gran *gran, size_t ngranules, void *arg)
+{
+  void **mem = arg;
+
+  if (*mem == NULL)
+    {
+      return 0;
+    }
+
+  gran_free(gran, *mem, GRANSIZE);
+  *mem = NULL;
+  return 1;
+}
+
+static void *alloc(struct mm_gran *gran, size_t ngranules)
+{
+  memset(g_log, 0, sizeof(g_log));
+  g_want = ngranules;
+  return gran_alloc(gran, ngranules * GRANSIZE);
+}
+
+int main(void)
+{
+  struct gran_shrinker s[4];
+  struct gran_shrinker r;
+  struct cache         c[5];
+  struct mm_gran      *gran;
+  struct mm_gran      *gran2;
+  uint32_t             n;
+  uint32_t             i;
+  void                *mem;
+  void                *mem2;
+  void                *victim;
+  void                *p;
+
+  gran   = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(gran);
+  n      = test_nfree(gran);
+
+  for (i = 0; i < n; i++)
+    {
+      TEST_ASSERT(gran_alloc(gran, GRANSIZE) == gran_at(i));
+    }
+
+  /* A (10) frees 11, B (5) nothing, C (5, after B) 10, D (20) 12 */
+
+  memset(c, 0, sizeof(c));
+  c[0].name = 'A';
+  c[0].granno[0] = 11;
+  c[0].ngranules = 1;
+  c[1].name = 'B';
+  c[2].name = 'C';
+  c[2].granno[0] = 10;
+  c[2].ngranules = 1;
+  c[3].name = 'D';
+  c[3].granno[0] = 12;
+  c[3].ngranules = 1;
+
+  for (i = 0; i < 4; i++)
+    {
+      s[i].shrink = shrink;
+      s[i].arg    = &c[i];
+    }
+
+  s[0].priority = 10;
+  s[1].priority = 5;
+  s[2].priority = 5;
+  s[3].priority = 20;
+
+  gran_shrinker_register(gran, &s[3]);
+  gran_shrinker_register(gran, &s[0]);
+  gran_shrinker_register(gran, &s[1]);
+  gran_shrinker_register(gran, &s[2]);
+
+  /* C frees one granule, not enough for two; A frees the neighbour and
+   * the retry after A succeeds, so D is never asked.
+   */
+
+  TEST_ASSERT(alloc(gran, 2) == gran_at(10));
+  TEST_ASSERT(strcmp(g_log, "BCA") == 0);
+  TEST_ASSERT(c[3].ngranules == 1);
+
+  /* One granule: the retry after D's granule succeeds */
+
+  TEST_ASSERT(alloc(gran, 1) == gran_at(12));
+  TEST_ASSERT(strcmp(g_log, "BCAD") == 0);
+
+  /* Nothing left to free: every shrinker is asked once and it fails */
+
+  TEST_ASSERT(alloc(gran, 1) == NULL);
+  TEST_ASSERT(strcmp(g_log, "BCAD") == 0);
+
+  /* A shrinker that allocates does not recurse into the shrinkers */
+
+  c[1].nested    = 1;
+  c[1].granno[0] = 40;
+  c[1].ngranules = 1;
+  TEST_ASSERT(alloc(gran, 1) == gran_at(40));
+  TEST_ASSERT(strcmp(g_log, "B") == 0 && c[1].nestedmem == NULL);
+
+  /* Unregistered shrinkers are not called */
+
+  gran_shrinker_unregister(gran, &s[1]);
+  gran_shrinker_unregister(gran, &s[3]);
+  c[0].granno[0] = 50;
+  c[0].ngranules = 1;
+  TEST_ASSERT(alloc(gran, 1) == gran_at(50));
+  TEST_ASSERT(strcmp(g_log, "CA") == 0);
+
+  gran_shrinker_unregister(gran, &s[0]);
+  gran_shrinker_unregister(gran, &s[2]);
+  TEST_ASSERT(alloc(gran, 1) == NULL && g_log[0] == '\0');
+
+  /* A shrinker changes the list: the new one is called by the next pass */
+
+  c[4].name      = 'E';
+  c[4].granno[0] = 60;
+  c[4].ngranules = 1;
+  g_late.shrink   = shrink;
+  g_late.arg      = &c[4];
+  g_late.priority = 0;
+  r.shrink        = reshuffle;
+  r.arg           = &r;
+  r.priority      = 0;
+
+  gran_shrinker_register(gran, &r);
+  TEST_ASSERT(alloc(gran, 1) == NULL);
+  TEST_ASSERT(strcmp(g_log, "R") == 0);
+  TEST_ASSERT(alloc(gran, 1) == gran_at(60));
+  TEST_ASSERT(strcmp(g_log, "E") == 0);
+  gran_shrinker_unregister(gran, &g_late);
+
+  /* A shrinker can allocate from another heap that needs shrinking */
+
+  gran2  = test_heap(4096 + (64 << LOG2GRAN), LOG2GRAN, &mem2);
+  victim = NULL;
+  while ((p = gran_alloc(gran2, GRANSIZE)) != NULL)
+    {
+      victim = p;
+    }
+
+  s[0].shrink   = free_one;
+  s[0].arg      = &victim;
+  s[0].priority = 0;
+  s[1].shrink   = cross;
+  s[1].arg      = gran2;
+  s[1].priority = 0;
+  gran_shrinker_register(gran2, &s[0]);
+  gran_shrinker_register(gran, &s[1]);
+
+  p = victim;
+  TEST_ASSERT(alloc(gran, 1) == NULL);
+  TEST_ASSERT(strcmp(g_log, "X") == 0);
+  TEST_ASSERT(g_crossmem == p && victim == NULL);
+
+  gran_shrinker_unregister(gran, &s[1]);
+  gran_shrinker_unregister(gran2, &s[0]);
+  test_heap_free(gran2, mem2);
+
+  test_heap_free(gran, mem);
+  return 0;
+}
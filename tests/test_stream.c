@@ -0,0 +1,151 @@
+/****************************************************************************
+ * tests/test_stream.c
+ * A stream must wrap when an allocation ends exactly at the end of its
+ * window, report full when every granule is in use, and reuse out of
+ * order frees at once, skipping over memory that is still in use.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+#define WINDOW    8
+
+static uintptr_t g_base;
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+int main(void)
+{
+  struct gran_stream s;
+  struct mm_gran    *gran;
+  uint32_t           nfree;
+  void              *mem;
+  void              *blocker;
+  void              *a;
+  void              *b;
+  void              *c;
+  void              *d;
+
+  gran   = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(gran);
+
+  /* Keep the window off granule 0 */
+
+  blocker = gran_alloc(gran, 3 * GRANSIZE);
+  nfree   = test_nfree(gran);
+
+  TEST_ASSERT(gran_stream_initialize(&s, gran, WINDOW * GRANSIZE) == 0);
+  TEST_ASSERT(s.first == 3 && s.end == 3 + WINDOW);
+  TEST_ASSERT(test_nfree(gran) == nfree - WINDOW);
+  TEST_ASSERT(gran_alloc(gran, GRANSIZE) == gran_at(3 + WINDOW));
+  gran_free(gran, gran_at(3 + WINDOW), GRANSIZE);
+
+  TEST_ASSERT(gran_stream_alloc(&s, 0) == NULL);
+  TEST_ASSERT(gran_stream_alloc(&s, 128 * GRANSIZE) == NULL);
+
+  /* An allocation that ends exactly at the end of the window, then a
+   * wrap with no granules to skip.
+   */
+
+  a = gran_stream_alloc(&s, 3 * GRANSIZE);
+  b = gran_stream_alloc(&s, 5 * GRANSIZE);
+  TEST_ASSERT(a == gran_at(3) && b == gran_at(6));
+  TEST_ASSERT(s.head == s.end && s.used == WINDOW);
+  TEST_ASSERT(gran_stream_alloc(&s, GRANSIZE) == NULL);
+
+  gran_stream_free(&s, a);
+  TEST_ASSERT(s.used == 5);
+  c = gran_stream_alloc(&s, 3 * GRANSIZE);
+  TEST_ASSERT(c == gran_at(3) && s.used == WINDOW);
+  TEST_ASSERT(gran_stream_alloc(&s, GRANSIZE) == NULL);
+
+  gran_stream_free(&s, b);
+  TEST_ASSERT(s.used == 3);
+  gran_stream_free(&s, c);
+  TEST_ASSERT(s.used == 0);
+
+  /* A long lived buffer at the front does not hold up the rest:  out of
+   * order frees are reused at once and the head skips over the buffer.
+   */
+
+  a = gran_stream_alloc(&s, 1 * GRANSIZE);
+  b = gran_stream_alloc(&s, 2 * GRANSIZE);
+  c = gran_stream_alloc(&s, 3 * GRANSIZE);
+  TEST_ASSERT(a == gran_at(3) && b == gran_at(4) && c == gran_at(6));
+
+  gran_stream_free(&s, c);
+  gran_stream_free(&s, b);
+  TEST_ASSERT(s.used == 1);
+
+  d = gran_stream_alloc(&s, 3 * GRANSIZE);
+  TEST_ASSERT(d == gran_at(4));
+  b = gran_stream_alloc(&s, 4 * GRANSIZE);
+  TEST_ASSERT(b == gran_at(7) && s.used == WINDOW);
+  TEST_ASSERT(gran_stream_alloc(&s, GRANSIZE) == NULL);
+
+  gran_stream_free(&s, d);
+  gran_stream_free(&s, a);
+  gran_stream_free(&s, b);
+  TEST_ASSERT(s.used == 0);
+  a = gran_stream_alloc(&s, WINDOW * GRANSIZE);
+  TEST_ASSERT(a == gran_at(3));
+  gran_stream_free(&s, a);
+
+  /* A wrap leaves the end of the window for later */
+
+  a = gran_stream_alloc(&s, 6 * GRANSIZE);
+  b = gran_stream_alloc(&s, 1 * GRANSIZE);
+  gran_stream_free(&s, a);
+  TEST_ASSERT(s.used == 1);
+
+  c = gran_stream_alloc(&s, 3 * GRANSIZE);
+  TEST_ASSERT(c == gran_at(3) && s.used == 4);
+  d = gran_stream_alloc(&s, 1 * GRANSIZE);
+  TEST_ASSERT(d == gran_at(6));
+  gran_stream_free(&s, b);
+  gran_stream_free(&s, c);
+  gran_stream_free(&s, d);
+  TEST_ASSERT(s.used == 0);
+
+  /* Free granules that are not contiguous do not make a larger run */
+
+  a = gran_stream_alloc(&s, 2 * GRANSIZE);
+  b = gran_stream_alloc(&s, 2 * GRANSIZE);
+  c = gran_stream_alloc(&s, 2 * GRANSIZE);
+  d = gran_stream_alloc(&s, 2 * GRANSIZE);
+  gran_stream_free(&s, a);
+  gran_stream_free(&s, c);
+  TEST_ASSERT(s.used == 4);
+  TEST_ASSERT(gran_stream_alloc(&s, 3 * GRANSIZE) == NULL);
+  a = gran_stream_alloc(&s, 2 * GRANSIZE);
+  c = gran_stream_alloc(&s, 2 * GRANSIZE);
+  TEST_ASSERT(a == gran_at(3) && c == gran_at(7));
+
+  /* The window goes back to the heap */
+
+  gran_stream_release(&s);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  gran_free(gran, blocker, 3 * GRANSIZE);
+  test_heap_free(gran, mem);
+  return 0;
+}
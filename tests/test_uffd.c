@@ -0,0 +1,173 @@
+/****************************************************************************
+ * tests/test_uffd.c
+ * A userfaultfd backed heap must populate pages on first touch only,
+ * count every fault in the histogram, hand free pages back on reclaim and
+ * serve threads that fault on the same pages at the same time.  The test
+ * is skipped if the kernel does not permit userfaultfd.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "tests/gran_test.h"
+
+#define HEAPSIZE  ((size_t)1 << 30)
+#define LOG2GRAN  12
+#define NPAGES    32
+#define NTHREADS  4
+
+static volatile uint8_t *g_shared;
+static size_t            g_pagesize;
+
+static uint64_t test_nfaults(struct mm_gran *gran)
+{
+  struct gran_uffd_stats stats;
+  uint64_t               sum = 0;
+  int                    i;
+
+  TEST_ASSERT(gran_uffd_stats(gran, &stats) == 0);
+  for (i = 0; i < GRAN_UFFD_NBUCKETS; i++)
+    {
+      sum += stats.hist[i];
+    }
+
+  TEST_ASSERT(sum == stats.nfaults);
+  return stats.nfaults;
+}
+
+/* Every thread reads and writes every page of the shared allocation */
+
+static void *toucher(void *arg)
+{
+  uintptr_t id = (uintptr_t)arg;
+  int       i;
+
+  for (i = 0; i < NPAGES; i++)
+    {
+      TEST_ASSERT(g_shared[i * g_pagesize + id] == 0);
+      g_shared[i * g_pagesize + id] = 1;
+    }
+
+  return NULL;
+}
+
+int main(void)
+{
+  struct gran_uffd_stats stats;
+  struct mm_gran        *gran;
+  struct mm_gran        *plain;
+  pthread_t              thread[NTHREADS];
+  uint64_t               nfaults;
+  uint8_t               *p;
+  void                  *mem;
+  ssize_t                npages;
+  int                    i;
+
+  g_pagesize = sysconf(_SC_PAGESIZE);
+
+  gran = gran_initialize_uffd(HEAPSIZE, LOG2GRAN, 0);
+  if (gran == NULL)
+    {
+      fprintf(stderr, "userfaultfd not permitted, skipped\n");
+      return 0;
+    }
+
+  /* Initialization only touched the heap state */
+
+  nfaults = test_nfaults(gran);
+  TEST_ASSERT(nfaults > 0 && nfaults < 64);
+  TEST_ASSERT(test_nfree(gran) > (HEAPSIZE >> LOG2GRAN) - 64);
+
+  /* Allocating does not fault; the first touch of each page does, once */
+
+  p = gran_alloc(gran, NPAGES * g_pagesize);
+  TEST_ASSERT(p != NULL);
+  TEST_ASSERT(test_nfaults(gran) == nfaults);
+
+  TEST_ASSERT(p[0] == 0);
+  TEST_ASSERT(test_nfaults(gran) == nfaults + 1);
+  for (i = 0; i < NPAGES; i++)
+    {
+      p[i * g_pagesize + 1] = 0xa5;
+    }
+
+  TEST_ASSERT(test_nfaults(gran) == nfaults + NPAGES);
+  nfaults += NPAGES;
+
+  /* Free pages go back to the kernel and come back zeroed */
+
+  gran_free(gran, p, NPAGES * g_pagesize);
+  npages = gran_uffd_reclaim(gran);
+  TEST_ASSERT(npages >= NPAGES);
+  TEST_ASSERT(gran_uffd_stats(gran, &stats) == 0);
+  TEST_ASSERT(stats.nreclaimed == (uint64_t)npages);
+  TEST_ASSERT(gran_uffd_reclaim(gran) == npages);
+
+  TEST_ASSERT(gran_alloc(gran, NPAGES * g_pagesize) == p);
+  for (i = 0; i < NPAGES; i++)
+    {
+      TEST_ASSERT(p[i * g_pagesize + 1] == 0);
+    }
+
+  TEST_ASSERT(test_nfaults(gran) == nfaults + NPAGES);
+
+  /* Pages of live allocations are not reclaimed */
+
+  npages = gran_uffd_reclaim(gran);
+  TEST_ASSERT(p[1] == 0 && test_nfaults(gran) == nfaults + NPAGES);
+  nfaults += NPAGES;
+
+  /* Threads that fault on the same pages at once all get through */
+
+  g_shared = gran_alloc(gran, NPAGES * g_pagesize);
+  TEST_ASSERT(g_shared != NULL);
+  for (i = 0; i < NTHREADS; i++)
+    {
+      TEST_ASSERT(pthread_create(&thread[i], NULL, toucher, (void *)(uintptr_t)i) == 0);
+    }
+
+  for (i = 0; i < NTHREADS; i++)
+    {
+      pthread_join(thread[i], NULL);
+    }
+
+  TEST_ASSERT(test_nfaults(gran) >= nfaults + NPAGES);
+  gran_release(gran);
+
+  /* With the shared zero page only the read faults */
+
+  gran = gran_initialize_uffd(HEAPSIZE, LOG2GRAN, GRAN_UFFD_ZEROPAGE);
+  TEST_ASSERT(gran != NULL);
+  nfaults = test_nfaults(gran);
+  p = gran_alloc(gran, g_pagesize);
+  TEST_ASSERT(p[100] == 0);
+  TEST_ASSERT(test_nfaults(gran) == nfaults + 1);
+  p[100] = 1;
+  TEST_ASSERT(test_nfaults(gran) == nfaults + 1 && p[100] == 1);
+  gran_release(gran);
+
+  /* Other heaps are rejected */
+
+  plain = test_heap(1 << 16, 6, &mem);
+  TEST_ASSERT(gran_uffd_reclaim(plain) == -EINVAL);
+  TEST_ASSERT(gran_uffd_stats(plain, &stats) == -EINVAL);
+  test_heap_free(plain, mem);
+  return 0;
+}
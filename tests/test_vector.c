@@ -0,0 +1,85 @@
+/****************************************************************************
+ * tests/test_vector.c
+ * gran_vector must grow in place while the following granules are free
+ * and keep its contents when it has to relocate.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+
+#include "tests/gran_test.h"
+
+int main(void)
+{
+  struct gran_vector vec;
+  struct mm_gran    *gran;
+  void              *mem;
+  void              *data;
+  void              *block;
+  uint32_t           nfree;
+  int                value;
+  int               *elem;
+  int                i;
+
+  gran  = test_heap(1 << 16, 6, &mem);
+  nfree = test_nfree(gran);
+
+  gran_vector_init(&vec, gran, sizeof(int));
+  TEST_ASSERT(vec.data == NULL && vec.nelem == 0);
+
+  for (i = 0; i < 16; i++)
+    {
+      TEST_ASSERT(gran_vector_append(&vec, &i, 1) != NULL);
+    }
+
+  /* Grows in place while nothing follows the storage */
+
+  data = vec.data;
+  for (; i < 64; i++)
+    {
+      TEST_ASSERT(gran_vector_append(&vec, &i, 1) != NULL);
+    }
+
+  TEST_ASSERT(vec.data == data && vec.nelem == 64 && vec.capacity >= 64 * sizeof(int));
+
+  /* Block the following granule; the next growth relocates */
+
+  block = gran_alloc(gran, 64);
+  TEST_ASSERT(block == (char *)vec.data + vec.capacity);
+  elem = gran_vector_append(&vec, NULL, vec.capacity / sizeof(int) - vec.nelem + 1);
+  TEST_ASSERT(elem != NULL && vec.data != data);
+
+  for (i = 0; i < 64; i++)
+    {
+      TEST_ASSERT(((int *)vec.data)[i] == i);
+    }
+
+  /* Reserve beyond the 32 granule limit fails and leaves the vector alone */
+
+  data  = vec.data;
+  value = (int)vec.nelem;
+  TEST_ASSERT(gran_vector_reserve(&vec, (33 << 6) / sizeof(int)) == -ENOMEM);
+  TEST_ASSERT(vec.data == data && vec.nelem == (size_t)value);
+
+  gran_vector_release(&vec);
+  gran_free(gran, block, 64);
+  TEST_ASSERT(vec.data == NULL && vec.nelem == 0);
+  TEST_ASSERT(test_nfree(gran) == nfree);
+  test_heap_free(gran, mem);
+  return 0;
+}
@@ -0,0 +1,125 @@
+/****************************************************************************
+ * tests/test_wait.c
+ * gran_alloc_wait() must time out on a full heap and must be woken by a
+ * free that makes room, including a run freed across two GAT entries.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define NGRANULES 256
+
+static struct mm_gran *g_gran;
+static void           *g_result;
+
+static long test_msec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *waiter(void *arg)
+{
+  g_result = gran_alloc_wait(g_gran, 20 << LOG2GRAN, *(int *)arg);
+  return NULL;
+}
+
+int main(void)
+{
+  pthread_t  thread;
+  uintptr_t  base;
+  void      *mem;
+  void      *run;
+  void      *single[NGRANULES + 64];
+  long       start;
+  int        timeout;
+  int        n;
+  int        i;
+
+  g_gran = test_heap(4096 + (NGRANULES << LOG2GRAN), LOG2GRAN, &mem);
+  base   = (uintptr_t)gran_heapstart(g_gran);
+
+  /* Granules 0..21 and 42.. hold single granules, 22..41 one run that
+   * spans the first two GAT entries.
+   */
+
+  for (i = 0; i < 22; i++)
+    {
+      single[i] = gran_alloc(g_gran, 1 << LOG2GRAN);
+    }
+
+  run = gran_alloc(g_gran, 20 << LOG2GRAN);
+  TEST_ASSERT(run == (void *)(base + (22 << LOG2GRAN)));
+
+  for (n = 22; (single[n] = gran_alloc(g_gran, 1 << LOG2GRAN)) != NULL; n++);
+  TEST_ASSERT(test_nfree(g_gran) == 0);
+
+  /* A full heap times out */
+
+  TEST_ASSERT(gran_alloc_wait(g_gran, 1, 0) == NULL);
+  start = test_msec();
+  TEST_ASSERT(gran_alloc_wait(g_gran, 1, 50) == NULL);
+  TEST_ASSERT(test_msec() - start >= 50);
+
+  /* Freeing the run wakes a waiter that needs all of it */
+
+  timeout = 5000;
+  start   = test_msec();
+  TEST_ASSERT(pthread_create(&thread, NULL, waiter, &timeout) == 0);
+  usleep(100000);
+  gran_free(g_gran, run, 20 << LOG2GRAN);
+  pthread_join(thread, NULL);
+  TEST_ASSERT(g_result == run);
+  TEST_ASSERT(test_msec() - start < 2000);
+
+  /* The same without a timeout */
+
+  timeout = -1;
+  TEST_ASSERT(pthread_create(&thread, NULL, waiter, &timeout) == 0);
+  usleep(100000);
+  gran_free(g_gran, run, 20 << LOG2GRAN);
+  pthread_join(thread, NULL);
+  TEST_ASSERT(g_result == run);
+
+  /* Freeing granules that cannot make room does not satisfy the waiter */
+
+  timeout = 300;
+  TEST_ASSERT(pthread_create(&thread, NULL, waiter, &timeout) == 0);
+  usleep(50000);
+  gran_free(g_gran, single[0], 1 << LOG2GRAN);
+  pthread_join(thread, NULL);
+  TEST_ASSERT(g_result == NULL);
+  single[0] = gran_alloc(g_gran, 1 << LOG2GRAN);
+
+  gran_free(g_gran, run, 20 << LOG2GRAN);
+  for (i = 0; i < n; i++)
+    {
+      gran_free(g_gran, single[i], 1 << LOG2GRAN);
+    }
+
+  TEST_ASSERT(test_mxfree(g_gran) == test_nfree(g_gran));
+  test_heap_free(g_gran, mem);
+  return 0;
+}
@@ -0,0 +1,173 @@
+/****************************************************************************
+ * tests/test_wmark.c
+ * Watermark conditions must follow nfree and mxfree with hysteresis, be
+ * reported exactly once per crossing through both notify() and the
+ * eventfd, and see free runs that continue across GAT entries.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "tests/gran_test.h"
+
+#define LOG2GRAN  6
+#define GRANSIZE  (1 << LOG2GRAN)
+
+static struct mm_gran *g_gran;
+static uintptr_t       g_base;
+static int             g_nevents;
+static unsigned int    g_state;
+
+static void *gran_at(unsigned int granno)
+{
+  return (void *)(g_base + ((uintptr_t)granno << LOG2GRAN));
+}
+
+static void notify(struct mm_gran *gran, unsigned int state, void *arg)
+{
+  TEST_ASSERT(gran == g_gran && arg == &g_nevents);
+  g_nevents++;
+  g_state = state;
+}
+
+/* Free or take back granules [first, first + n) one at a time */
+
+static void free_range(unsigned int first, unsigned int n)
+{
+  while (n-- > 0)
+    {
+      gran_free(g_gran, gran_at(first++), GRANSIZE);
+    }
+}
+
+static void take(unsigned int granno)
+{
+  TEST_ASSERT(gran_reserve(g_gran, (uintptr_t)gran_at(granno), GRANSIZE) == 0);
+}
+
+/* Number of events delivered through the eventfd since the last call */
+
+static uint64_t drain(int efd)
+{
+  uint64_t count;
+
+  if (read(efd, &count, sizeof(count)) != sizeof(count))
+    {
+      TEST_ASSERT(errno == EAGAIN);
+      return 0;
+    }
+
+  return count;
+}
+
+int main(void)
+{
+  struct gran_watermarks wm;
+  uint32_t               n;
+  uint32_t               i;
+  void                  *mem;
+  int                    efd;
+
+  g_gran = test_heap(4096 + (256 << LOG2GRAN), LOG2GRAN, &mem);
+  g_base = (uintptr_t)gran_heapstart(g_gran);
+  n      = test_nfree(g_gran);
+  efd    = eventfd(0, EFD_NONBLOCK);
+  TEST_ASSERT(n >= 96 && efd >= 0);
+
+  for (i = 0; i < n; i++)
+    {
+      TEST_ASSERT(gran_alloc(g_gran, GRANSIZE) == gran_at(i));
+    }
+
+  wm.nfree_low   = 16;
+  wm.nfree_high  = 24;
+  wm.mxfree_low  = 8;
+  wm.mxfree_high = 12;
+  wm.notify      = notify;
+  wm.arg         = &g_nevents;
+  wm.eventfd     = efd;
+
+  wm.nfree_low = 25;
+  TEST_ASSERT(gran_watermark_set(g_gran, &wm) == -EINVAL);
+  wm.nfree_low = 16;
+
+  /* The initial state is taken without a notification */
+
+  TEST_ASSERT(gran_watermark_set(g_gran, &wm) == 0);
+  TEST_ASSERT(gran_watermark_state(g_gran) == (GRAN_WMARK_NFREE | GRAN_WMARK_MXFREE));
+  TEST_ASSERT(g_nevents == 0 && drain(efd) == 0);
+
+  /* Granules 26..37 cross from GAT entry 0 into entry 1; neither entry
+   * has more than 6 free granules of its own.  mxfree stays asserted
+   * between the watermarks and clears at 12, with one event.
+   */
+
+  free_range(26, 8);
+  TEST_ASSERT(g_nevents == 0);
+  free_range(34, 4);
+  TEST_ASSERT(g_nevents == 1 && g_state == GRAN_WMARK_NFREE);
+  TEST_ASSERT(gran_watermark_state(g_gran) == GRAN_WMARK_NFREE);
+  TEST_ASSERT(drain(efd) == 1);
+
+  /* Splitting the run asserts it again, joining it clears it again */
+
+  take(31);
+  TEST_ASSERT(g_nevents == 2 && g_state == (GRAN_WMARK_NFREE | GRAN_WMARK_MXFREE));
+  free_range(31, 1);
+  TEST_ASSERT(g_nevents == 3 && g_state == GRAN_WMARK_NFREE);
+
+  /* A run between the watermarks changes nothing */
+
+  take(35);
+  TEST_ASSERT(g_nevents == 3 && gran_watermark_state(g_gran) == GRAN_WMARK_NFREE);
+  free_range(35, 1);
+  TEST_ASSERT(g_nevents == 3 && drain(efd) == 2);
+
+  /* nfree: 12 free now.  Passing the low watermark upwards is not
+   * enough, the condition clears at the high one.
+   */
+
+  free_range(60, 11);
+  TEST_ASSERT(g_nevents == 3 && gran_watermark_state(g_gran) == GRAN_WMARK_NFREE);
+  free_range(71, 1);
+  TEST_ASSERT(g_nevents == 4 && g_state == 0);
+
+  take(71);
+  take(70);
+  TEST_ASSERT(g_nevents == 4 && gran_watermark_state(g_gran) == 0);
+  for (i = 60; i < 70; i++)
+    {
+      take(i);
+    }
+
+  TEST_ASSERT(g_nevents == 5 && g_state == GRAN_WMARK_NFREE);
+  TEST_ASSERT(drain(efd) == 2);
+
+  /* Disabled watermarks report nothing */
+
+  TEST_ASSERT(gran_watermark_set(g_gran, NULL) == 0);
+  TEST_ASSERT(gran_watermark_state(g_gran) == 0);
+  free_range(60, 12);
+  TEST_ASSERT(g_nevents == 5 && drain(efd) == 0);
+
+  close(efd);
+  test_heap_free(g_gran, mem);
+  return 0;
+}
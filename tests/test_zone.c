@@ -0,0 +1,194 @@
+/****************************************************************************
+ * tests/test_zone.c
+ * A mixed granularity heap must route requests by size class, spill into
+ * the other zones only when the zone of the class is full, free by
+ * address, report all zones in gran_info() and keep the first zone
+ * interfaces inside it.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.  The
+ * ASF licenses this file to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance with the
+ * License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+ * License for the specific language governing permissions and limitations
+ * under the License.
+ *
+ ****************************************************************************/
+
+#include <string.h>
+
+#include "tests/gran_test.h"
+
+#define ZONE0SIZE  (16 << 10)
+#define HEAPSIZE   (ZONE0SIZE + (256 << 10))
+#define NSMALL     512
+#define NMEDIUM    128
+
+int main(void)
+{
+  struct gran_zone zones[2] =
+    {
+      { 6,  ZONE0SIZE },
+      { 12, 0 },
+    };
+
+  struct gran_arena arena;
+  struct graninfo   info;
+  struct mm_gran   *gran;
+  uintptr_t         zone1;
+  uint32_t          total;
+  char             *mem;
+  char             *large;
+  char             *small[NSMALL];
+  char             *medium[NMEDIUM];
+  char             *spill;
+  void             *p;
+  int               n;
+  int               i;
+
+  mem = aligned_alloc(4096, HEAPSIZE);
+  TEST_ASSERT(mem != NULL);
+  zone1 = (uintptr_t)mem + ZONE0SIZE;
+
+  /* Zones out of order or too small are rejected */
+
+  TEST_ASSERT(gran_initialize_zoned(mem, 1024, zones, 2) == NULL);
+
+  gran = gran_initialize_zoned(mem, HEAPSIZE, zones, 2);
+  TEST_ASSERT(gran != NULL);
+
+  /* gran_info() counts both zones in 64 byte granules */
+
+  gran_info(gran, &info);
+  total = info.ngranules;
+  TEST_ASSERT(info.log2gran == 6 && info.nfree == total);
+  TEST_ASSERT(total > (ZONE0SIZE >> 7) + (56 << 6) &&
+              total < (HEAPSIZE >> 6));
+  TEST_ASSERT(info.mxfree >= 56 << 6);
+
+  /* Small requests go to the first zone, large ones to the second */
+
+  small[0] = gran_alloc(gran, 100);
+  large    = gran_alloc(gran, 8192);
+  TEST_ASSERT(small[0] != NULL && (uintptr_t)small[0] < zone1);
+  TEST_ASSERT(large != NULL && (uintptr_t)large >= zone1 &&
+              (uintptr_t)large < (uintptr_t)mem + HEAPSIZE);
+  TEST_ASSERT(((uintptr_t)large & 4095) == 0);
+  TEST_ASSERT(test_nfree(gran) == total - 2 - 128);
+
+  /* gran_extend() resizes memory of the second zone in that zone */
+
+  TEST_ASSERT(gran_extend(gran, large, 8192, 12288) == 0);
+  TEST_ASSERT(test_nfree(gran) == total - 2 - 192);
+  TEST_ASSERT(gran_extend(gran, large, 12288, 4096) == 0);
+  TEST_ASSERT(test_nfree(gran) == total - 2 - 64);
+
+  /* Free by address */
+
+  gran_free(gran, large, 4096);
+  gran_free(gran, small[0], 100);
+  TEST_ASSERT(test_nfree(gran) == total);
+
+  /* Up to CONFIG_GRAN_ZONE_NGRANULES (8) small granules stay in the first
+   * zone; larger requests take one granule of the second zone until it
+   * is full and only then spill back into the first.
+   */
+
+  small[0]  = gran_alloc(gran, 8 * 64);
+  medium[0] = gran_alloc(gran, 8 * 64 + 1);
+  TEST_ASSERT(small[0] != NULL && (uintptr_t)small[0] < zone1);
+  TEST_ASSERT(medium[0] != NULL && (uintptr_t)medium[0] >= zone1);
+  TEST_ASSERT(test_nfree(gran) == total - 8 - 64);
+  gran_free(gran, small[0], 8 * 64);
+  gran_free(gran, medium[0], 8 * 64 + 1);
+
+  for (n = 0; n < NMEDIUM; n++)
+    {
+      medium[n] = gran_alloc(gran, 600);
+      TEST_ASSERT(medium[n] != NULL);
+      if ((uintptr_t)medium[n] < zone1)
+        {
+          break;
+        }
+    }
+
+  TEST_ASSERT(n > 0 && n < NMEDIUM);
+  TEST_ASSERT(test_nfree(gran) == total - n * 64 - 10);
+  TEST_ASSERT(gran_alloc(gran, 4096) == NULL);
+
+  for (i = 0; i <= n; i++)
+    {
+      gran_free(gran, medium[i], 600);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == total);
+
+  /* Fill the first zone until the requests spill into the second */
+
+  for (n = 0; n < NSMALL; n++)
+    {
+      small[n] = gran_alloc(gran, 64);
+      TEST_ASSERT(small[n] != NULL);
+      if ((uintptr_t)small[n] >= zone1)
+        {
+          break;
+        }
+    }
+
+  TEST_ASSERT(n > 0 && n < NSMALL);
+  spill = small[n];
+  TEST_ASSERT(test_nfree(gran) == total - n - 64);
+
+  /* The first zone interfaces do not follow the spill */
+
+  gran_arena_begin(&arena, gran);
+  TEST_ASSERT(gran_arena_alloc(&arena, 100) == NULL);
+  gran_arena_end(&arena);
+  TEST_ASSERT(gran_alloc_handle(gran, 64) == GRAN_INVALID_HANDLE);
+
+  gran_free(gran, small[n / 2], 64);
+  gran_free(gran, small[n / 2 + 1], 64);
+  gran_arena_begin(&arena, gran);
+  p = gran_arena_alloc(&arena, 64);
+  TEST_ASSERT(p != NULL && (uintptr_t)p < zone1);
+  memset(p, 0x5a, 64);
+  gran_arena_end(&arena);
+  small[n / 2]     = gran_alloc(gran, 64);
+  small[n / 2 + 1] = gran_alloc(gran, 64);
+  TEST_ASSERT((uintptr_t)small[n / 2] < zone1 &&
+              (uintptr_t)small[n / 2 + 1] < zone1);
+
+  /* The registry maps every zone to the heap handle */
+
+  TEST_ASSERT(gran_register(gran) == 0);
+  TEST_ASSERT(gran_lookup(spill) == gran);
+  TEST_ASSERT(gran_lookup(small[0]) == gran);
+  gran_free_any(spill, 64);
+  gran_unregister(gran);
+
+  for (i = 0; i < n; i++)
+    {
+      gran_free(gran, small[i], 64);
+    }
+
+  TEST_ASSERT(test_nfree(gran) == total);
+
+  /* gran_reset() frees the memory of every zone */
+
+  TEST_ASSERT(gran_alloc(gran, 100) != NULL);
+  TEST_ASSERT(gran_alloc(gran, 65536) != NULL);
+  TEST_ASSERT(test_nfree(gran) < total);
+  gran_reset(gran);
+  TEST_ASSERT(test_nfree(gran) == total);
+
+  gran_release(gran);
+  free(mem);
+  return 0;
+}